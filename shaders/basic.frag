@@ -1,29 +1,34 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "entities.glsl"
+
+#define LIGHTS_SET 3
+#include "lights.glsl"
 
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec3 normalWS;
 layout (location = 2) in vec2 fragTexCoord;
+layout (location = 3) in vec3 positionWS;
 
 layout (location = 0) out vec4 outColor;
 
-layout (binding = 0) uniform UniformBufferObject {
-    mat4 projectionView;
-    mat4 model;
-    mat4 normalMatrix;
-    vec3 camPos;
-} ubo;
-
-layout(binding = 1) uniform sampler2D texSampler;
-
-
-const vec3 DIRECTION_TO_LIGHT = normalize(vec3(1.0, -3.0, -1.0));
 vec3 AMBIENT = vec3(0.1);
 
-layout(push_constant) uniform Push {
-    float brightness;
-} push;
-
 void main() {
-    vec3 lightIntensity = AMBIENT + vec3(max(dot(normalWS, DIRECTION_TO_LIGHT), 0));
-    outColor = texture(texSampler,fragTexCoord) * vec4(fragColor * lightIntensity, 1.0) + vec4(vec3(push.brightness), 0.0);
+    vec3 normal = normalize(normalWS);
+    vec3 lightIntensity = AMBIENT;
+    for (uint i = 0; i < directionalCount; i++) {
+        lightIntensity += lights[i].color.rgb * max(dot(normal, lights[i].direction.xyz), 0.0);
+    }
+
+    uint cluster = clusterIndex(gl_FragCoord);
+    for (uint i = 0; i < clusterCounts[cluster]; i++) {
+        Light light = lights[clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+        vec3 toLight = light.position.xyz - positionWS;
+        float lightDistance = length(toLight);
+        lightIntensity += light.color.rgb * max(dot(normal, toLight / lightDistance), 0.0) * pointAttenuation(lightDistance, light.position.w);
+    }
+    outColor = texture(textures[entities[push.entity].albedo], fragTexCoord) * vec4(fragColor * lightIntensity, 1.0) + vec4(vec3(push.brightness), 0.0);
 }
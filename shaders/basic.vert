@@ -1,4 +1,8 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "entities.glsl"
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
@@ -8,19 +12,15 @@ layout(location = 3) in vec2 uv;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 normalWS;
 layout(location = 2) out vec2 fragTexCoord;
-
-layout (binding = 0) uniform UniformBufferObject {
-    mat4 projectionView;
-    mat4 model;
-    mat4 normalMatrix;
-    vec3 camPos;
-} ubo;
+layout(location = 3) out vec3 positionWS;
 
 void main() {
-    vec4 positionWS = ubo.model * vec4(position, 1.0);
-    gl_Position = ubo.projectionView * positionWS;
+    EntityData entity = entities[push.entity];
+    vec4 positionWS4 = entity.model * vec4(position, 1.0);
+    gl_Position = projectionView * positionWS4;
+    positionWS = positionWS4.xyz;
 
-    normalWS = normalize(mat3(ubo.normalMatrix) * normal);
+    normalWS = normalize(mat3(entity.normalMatrix) * normal);
     fragColor = color;
     fragTexCoord = vec2(uv.x, 1-uv.y);
 }
@@ -0,0 +1,23 @@
+// Data of the entities drawn in the frame and the textures they sample, indexed by the entity of
+// the draw. See RenderSystem. Requires GL_EXT_nonuniform_qualifier for the texture array.
+
+struct EntityData {
+    mat4 model;
+    mat4 normalMatrix;
+    uint albedo;  // in textures
+};
+
+layout(set = 0, binding = 0) readonly buffer Entities {
+    mat4 projectionView;
+    vec4 camPos;
+    EntityData entities[];
+};
+
+layout(set = 0, binding = 1) uniform sampler2D textures[];
+layout(set = 0, binding = 2) uniform samplerCube skyboxTexture;
+
+layout(push_constant) uniform Push {
+    uint entity;
+    float brightness;
+    float opacity;  // scales the strand opacity of transparent hair
+} push;
@@ -1,25 +1,26 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "entities.glsl"
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec3 direction;
+layout(location = 3) in float opacity;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 directionWS;
 layout(location = 2) out vec3 positionWS;
-
-layout (binding = 0) uniform UniformBufferObject {
-    mat4 projectionView;
-    mat4 model;
-    mat4 normalMatrix;
-    vec3 camPos;
-} ubo;
+layout(location = 3) out float fragOpacity;
 
 void main() {
-    vec4 positionWS4 = ubo.model * vec4(position, 1.0);
-    gl_Position = ubo.projectionView * positionWS4;
+    EntityData entity = entities[push.entity];
+    vec4 positionWS4 = entity.model * vec4(position, 1.0);
+    gl_Position = projectionView * positionWS4;
 
     positionWS = positionWS4.xyz;
-    directionWS = normalize(mat3(ubo.normalMatrix) * direction);
+    directionWS = normalize(mat3(entity.normalMatrix) * direction);
     fragColor = color;
+    fragOpacity = opacity;
 }
@@ -0,0 +1,58 @@
+#version 450
+
+// Sorts the nearest fragments of the pixel list built by hair_list.frag and blends them over the
+// scene. Farther ones are dropped, barely visible behind that many strands.
+#define MAX_FRAGMENTS 16
+
+struct Node {
+    uint color;
+    float depth;
+    uint next;
+};
+
+layout(set = 0, binding = 2) readonly buffer Heads {
+    uint fragmentCount;
+    uint width;
+    uint heads[];
+};
+
+layout(set = 0, binding = 3) readonly buffer Nodes {
+    Node nodes[];
+};
+
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint index = heads[pixel.y * width + pixel.x];
+    if (index == 0xFFFFFFFFu) discard;
+
+    // Insertion sort into a k-buffer, nearest first
+    uint colors[MAX_FRAGMENTS];
+    float depths[MAX_FRAGMENTS];
+    int count = 0;
+    while (index != 0xFFFFFFFFu) {
+        Node node = nodes[index];
+        if (count < MAX_FRAGMENTS || node.depth < depths[MAX_FRAGMENTS - 1]) {
+            int j = min(count, MAX_FRAGMENTS - 1);
+            while (j > 0 && depths[j - 1] > node.depth) {
+                depths[j] = depths[j - 1];
+                colors[j] = colors[j - 1];
+                j--;
+            }
+            depths[j] = node.depth;
+            colors[j] = node.color;
+            count = min(count + 1, MAX_FRAGMENTS);
+        }
+        index = node.next;
+    }
+
+    // Front to back, premultiplied and blended with ONE, ONE_MINUS_SRC_ALPHA
+    vec4 result = vec4(0.0);
+    for (int i = 0; i < count; i++) {
+        vec4 color = unpackUnorm4x8(colors[i]);
+        result.rgb += (1.0 - result.a) * color.a * color.rgb;
+        result.a += (1.0 - result.a) * color.a;
+    }
+    outColor = result;
+}
@@ -0,0 +1,39 @@
+// Resolves the weighted blended accumulation over the scene, see hair_weighted.frag.
+// Multisampled targets are averaged per pixel.
+
+#ifdef MULTISAMPLED
+layout (input_attachment_index = 0, set = 0, binding = 0) uniform subpassInputMS accumInput;
+layout (input_attachment_index = 1, set = 0, binding = 1) uniform subpassInputMS revealageInput;
+#else
+layout (input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput accumInput;
+layout (input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput revealageInput;
+#endif
+
+layout(push_constant) uniform Push {
+    uint sampleCount;
+} push;
+
+layout (location = 0) out vec4 outColor;
+
+void main() {
+#ifdef MULTISAMPLED
+    vec4 accum = vec4(0.0);
+    float revealage = 0.0;
+    for (int i = 0; i < int(push.sampleCount); i++) {
+        accum += subpassLoad(accumInput, i);
+        revealage += subpassLoad(revealageInput, i).r;
+    }
+    accum /= float(push.sampleCount);
+    revealage /= float(push.sampleCount);
+#else
+    vec4 accum = subpassLoad(accumInput);
+    float revealage = subpassLoad(revealageInput).r;
+#endif
+
+    float alpha = 1.0 - revealage;
+    if (alpha <= 0.0) discard;
+
+    // Premultiplied, blended with ONE, ONE_MINUS_SRC_ALPHA
+    vec3 averageColor = accum.rgb / max(accum.a, 1e-5);
+    outColor = vec4(averageColor * alpha, alpha);
+}
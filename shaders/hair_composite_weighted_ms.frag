@@ -0,0 +1,5 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#define MULTISAMPLED
+#include "hair_composite_weighted.glsl"
@@ -0,0 +1,37 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "hair_shading.glsl"
+
+// Fragments hidden by the opaque depth must not allocate nodes
+layout(early_fragment_tests) in;
+
+// Per pixel linked lists of the transparent hair fragments, see HairTransparency
+struct Node {
+    uint color;  // RGBA8, alpha the opacity
+    float depth;
+    uint next;
+};
+
+layout(set = 1, binding = 2) buffer Heads {
+    uint fragmentCount;
+    uint width;
+    uint heads[];
+};
+
+layout(set = 1, binding = 3) writeonly buffer Nodes {
+    Node nodes[];
+};
+
+void main() {
+    uint index = atomicAdd(fragmentCount, 1);
+    // Out of budget, the fragment is dropped
+    if (index >= nodes.length()) return;
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint next = atomicExchange(heads[pixel.y * width + pixel.x], index);
+    nodes[index].color = packUnorm4x8(vec4(shadeHair().rgb, hairOpacity()));
+    nodes[index].depth = gl_FragCoord.z;
+    nodes[index].next = next;
+}
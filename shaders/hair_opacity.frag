@@ -0,0 +1,33 @@
+#version 450
+
+// Accumulates strand opacity into the layers of a deep opacity map. Each layer holds the opacity
+// of every strand up to its far end, so a strand is added to its own layer and all the ones
+// behind it. Layers are packed four per target.
+layout(location = 0) in float fragOpacity;
+
+layout(location = 0) out vec4 outLayers0;
+layout(location = 1) out vec4 outLayers1;
+layout(location = 2) out vec4 outLayers2;
+layout(location = 3) out vec4 outLayers3;
+
+layout(set = 0, binding = 0) uniform sampler2DArray depthMaps;
+
+layout(push_constant) uniform Push {
+    mat4 transform;
+    uint light;
+    uint layerCount;
+    float layerSpacing;
+} push;
+
+void main() {
+    float z0 = texelFetch(depthMaps, ivec3(gl_FragCoord.xy, push.light), 0).r;
+    float layer = min(floor(max(gl_FragCoord.z - z0, 0.0) / push.layerSpacing), float(push.layerCount - 1));
+
+    // Strands past the last layer still shade everything behind them
+    const vec4 channels = vec4(0.0, 1.0, 2.0, 3.0);
+    float alpha = clamp(fragOpacity, 0.0, 1.0);
+    outLayers0 = alpha * step(vec4(layer), channels);
+    outLayers1 = alpha * step(vec4(layer), channels + 4.0);
+    outLayers2 = alpha * step(vec4(layer), channels + 8.0);
+    outLayers3 = alpha * step(vec4(layer), channels + 12.0);
+}
@@ -0,0 +1,110 @@
+// Hair shading shared by the opaque and transparent hair pipelines
+
+#include "entities.glsl"
+
+#define LIGHTS_SET 3
+#include "lights.glsl"
+
+layout (location = 0) in vec3 fragColor;
+layout (location = 1) in vec3 directionWS;
+layout (location = 2) in vec3 positionWS;
+layout (location = 3) in float fragOpacity;
+
+// Deep opacity maps of the first directional lights, see HairShadows
+#define MAX_SHADOWS 4
+
+layout(set = 2, binding = 0) uniform HairShadows {
+    mat4 viewProjection[MAX_SHADOWS];
+    uint lightCount;
+    uint layerCount;  // 0 without shadows
+    float layerSpacing;
+    float density;
+} shadows;
+
+layout(set = 2, binding = 1) uniform sampler2DArray depthMaps;
+layout(set = 2, binding = 2) uniform sampler2DArray opacityMaps;
+
+// Marschner lobes, see MarschnerLUT. Layer 0: M_R, M_TT, M_TRT and cos(theta_d) from
+// (sin theta_i, sin theta_o). Layer 1: N_R, N_TT, N_TRT from (cos phi, cos theta_d).
+layout(set = 2, binding = 3) uniform sampler2DArray marschnerLUT;
+
+vec3 AMBIENT = vec3(0.0);
+
+
+// Single scattering of the fiber towards V. The strand color stands for the absorption, once
+// through the fiber for TT and twice for TRT.
+vec3 marschner(vec3 L, vec3 V, vec3 T, vec3 strandColor) {
+    float sinThetaI = dot(L, T);
+    float sinThetaO = dot(V, T);
+    vec4 M = texture(marschnerLUT, vec3(vec2(sinThetaI, sinThetaO) * 0.5 + 0.5, 0.0));
+
+    // Relative azimuth, between the projections on the normal plane
+    vec3 Lp = L - T * sinThetaI;
+    vec3 Vp = V - T * sinThetaO;
+    float cosPhi = dot(Lp, Vp) * inversesqrt(dot(Lp, Lp) * dot(Vp, Vp) + 1e-4);
+    vec3 N = texture(marschnerLUT, vec3(cosPhi * 0.5 + 0.5, M.a, 1.0)).rgb;
+
+    vec3 lobes = M.r * N.r + M.g * N.g * strandColor + M.b * N.b * strandColor * strandColor;
+    return lobes / max(M.a * M.a, 1e-2);
+}
+
+float layerOpacity(uint light, uint layer, vec2 uv) {
+    uint targetCount = (shadows.layerCount + 3) / 4;
+    return texture(opacityMaps, vec3(uv, light * targetCount + layer / 4))[layer % 4];
+}
+
+// Fraction of the light reaching the fragment through the hair in front of it
+float transmittance(uint light) {
+    if (shadows.layerCount == 0) return 1.0;
+
+    vec4 positionLS = shadows.viewProjection[light] * vec4(positionWS, 1.0);
+    vec2 uv = positionLS.xy * 0.5 + 0.5;
+    float z0 = texture(depthMaps, vec3(uv, light)).r;
+    float depth = max(positionLS.z - z0, 0.0) / shadows.layerSpacing;
+
+    // Layers hold the opacity up to their far end, interpolated from the one before
+    float opacity;
+    if (depth >= float(shadows.layerCount)) {
+        opacity = layerOpacity(light, shadows.layerCount - 1, uv);
+    } else {
+        uint layer = uint(depth);
+        float previous = layer > 0 ? layerOpacity(light, layer - 1, uv) : 0.0;
+        opacity = mix(previous, layerOpacity(light, layer, uv), fract(depth));
+    }
+    return exp(-shadows.density * opacity);
+}
+
+// Multiple scattering between strands, approximated by a diffuse term
+const float KD = 0.4;
+
+vec3 shadeLight(vec3 L, vec3 V, vec3 T, vec3 radiance) {
+    float cosThetaI = sqrt(max(1.0 - dot(L, T) * dot(L, T), 0.0));
+    return radiance * (marschner(L, V, T, fragColor) + KD * fragColor) * cosThetaI;
+}
+
+vec4 shadeHair() {
+    vec3 V = normalize(camPos.xyz - positionWS);
+    vec3 T = normalize(directionWS);
+
+    vec4 color = vec4(KD * AMBIENT * fragColor, 1.0);
+    for (uint i = 0; i < directionalCount; i++) {
+        // Self-shadowing dims the light reaching the strand, specular included
+        float visibility = i < shadows.lightCount ? transmittance(i) : 1.0;
+        color.rgb += shadeLight(lights[i].direction.xyz, V, T, lights[i].color.rgb * visibility);
+    }
+
+    uint cluster = clusterIndex(gl_FragCoord);
+    for (uint i = 0; i < clusterCounts[cluster]; i++) {
+        Light light = lights[clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+        vec3 toLight = light.position.xyz - positionWS;
+        float lightDistance = length(toLight);
+        vec3 radiance = light.color.rgb * pointAttenuation(lightDistance, light.position.w);
+        color.rgb += shadeLight(toLight / lightDistance, V, T, radiance);
+    }
+    return color;
+}
+
+// Strand opacity from the hair file, scaled by the user setting
+float hairOpacity() {
+    return clamp(fragOpacity * push.opacity, 0.0, 1.0);
+}
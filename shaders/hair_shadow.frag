@@ -0,0 +1,5 @@
+#version 450
+
+// Depth of the hair nearest to the light, where the opacity layers start
+void main() {
+}
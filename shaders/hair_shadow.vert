@@ -0,0 +1,19 @@
+#version 450
+
+// Hair seen from a light, for the deep opacity maps of HairShadows
+layout(location = 0) in vec3 position;
+layout(location = 3) in float opacity;
+
+layout(location = 0) out float fragOpacity;
+
+layout(push_constant) uniform Push {
+    mat4 transform;
+    uint light;
+    uint layerCount;
+    float layerSpacing;
+} push;
+
+void main() {
+    gl_Position = push.transform * vec4(position, 1.0);
+    fragOpacity = opacity;
+}
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "hair_shading.glsl"
+
+// Weighted blended order independent transparency (McGuire and Bavoil 2013). Accumulated
+// additively, while the revealage is multiplied by 1 - alpha.
+layout (location = 0) out vec4 outAccum;
+layout (location = 1) out float outRevealage;
+
+void main() {
+    vec3 color = shadeHair().rgb;
+    float alpha = hairOpacity();
+
+    // Depth weight of equation 10 of the paper, favoring the nearest fragments
+    float weight = clamp(alpha * max(1e-2, 3e3 * pow(1.0 - gl_FragCoord.z, 3.0)), 1e-2, 3e3);
+    outAccum = vec4(color * alpha, alpha) * weight;
+    outRevealage = alpha;
+}
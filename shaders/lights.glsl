@@ -0,0 +1,52 @@
+// Scene lights and their froxels, see LightClusters. Includers define LIGHTS_SET, and
+// CLUSTERS_ACCESS when they write the froxels.
+
+#define TILES_X 16
+#define TILES_Y 9
+#define SLICES 24
+#define CLUSTER_COUNT (TILES_X * TILES_Y * SLICES)
+#define MAX_LIGHTS_PER_CLUSTER 64
+
+#ifndef CLUSTERS_ACCESS
+#define CLUSTERS_ACCESS readonly
+#endif
+
+struct Light {
+    vec4 position;   // world space, w the range of point lights
+    vec4 direction;  // towards the light, for directional lights
+    vec4 color;      // intensity included
+};
+
+layout(std430, set = LIGHTS_SET, binding = 0) readonly buffer Lights {
+    mat4 view;
+    vec4 projection;  // x and y scales of the projection, near and far planes
+    vec2 extent;
+    uint directionalCount;  // directional lights come first
+    uint lightCount;
+    Light lights[];
+};
+
+layout(std430, set = LIGHTS_SET, binding = 1) CLUSTERS_ACCESS buffer ClusterCounts {
+    uint clusterCounts[];
+};
+
+layout(std430, set = LIGHTS_SET, binding = 2) CLUSTERS_ACCESS buffer ClusterLights {
+    uint clusterLights[];  // MAX_LIGHTS_PER_CLUSTER per froxel
+};
+
+// Froxel of a fragment, from its window coordinates
+uint clusterIndex(vec4 fragCoord) {
+    float near = projection.z;
+    float far = projection.w;
+    float viewZ = near * far / (far - fragCoord.z * (far - near));
+    uint slice = uint(clamp(log(viewZ / near) / log(far / near) * SLICES, 0.0, SLICES - 1.0));
+    uvec2 tile = min(uvec2(fragCoord.xy / extent * vec2(TILES_X, TILES_Y)), uvec2(TILES_X - 1, TILES_Y - 1));
+    return (slice * TILES_Y + tile.y) * TILES_X + tile.x;
+}
+
+// Inverse square falloff, windowed to reach zero at the range of the light
+float pointAttenuation(float lightDistance, float range) {
+    float ratio = lightDistance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (lightDistance * lightDistance + 1.0);
+}
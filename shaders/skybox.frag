@@ -1,4 +1,8 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "entities.glsl"
 
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec3 normalWS;
@@ -7,16 +11,7 @@ layout (location = 3) in vec3 UVW;
 
 layout (location = 0) out vec4 outColor;
 
-layout (binding = 0) uniform UniformBufferObject {
-    mat4 projectionView;
-    mat4 model;
-    mat4 normalMatrix;
-    vec3 camPos;
-} ubo;
-
-layout (binding = 1) uniform samplerCube samplerCubeMap;
-
 void main() {
-    outColor = texture(samplerCubeMap, UVW);
+    outColor = texture(skyboxTexture, UVW);
     // outColor = vec4(UVW, 1.0);
 }
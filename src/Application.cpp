@@ -5,9 +5,12 @@
 */
 
 #include <Application.hpp>
+#include <Buffer.hpp>
 #include <FrameInfo.hpp>
+#include <ImageWriter.hpp>
 #include <ImGuiHelper.hpp>
 #include <InputController.hpp>
+#include <Profiler.hpp>
 #include <RenderSystem.hpp>
 #include <Utils.hpp>
 
@@ -25,82 +28,417 @@
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 
 namespace vkr {
 
-Application::Application() { scene.initialize(); }
+Application::Application(bool headless, bool withUI)
+    : window{WIDTH, HEIGHT, "Vulkan Tutorial", headless}, renderer{window, device, withUI && !headless} {
+    scene.initialize();
+    // Headless frames are compared across runs, they all render the complete scene
+    if (headless) {
+        scene.finishLoading();
+    }
+}
 
 Application::~Application() {
 }
 
+// Simulation tracks follow the hair entities, which must be resident to be counted
+void Application::recordSimulation(const std::string& filepath) {
+    scene.finishLoading();
+    scene.startRecording(filepath);
+}
+
+void Application::exportSimulationCache(const std::string& filepath) {
+    scene.finishLoading();
+    scene.startCacheExport(filepath);
+}
+
+void Application::playSimulationCache(const std::string& filepath) {
+    scene.finishLoading();
+    scene.playCache(filepath);
+}
+
+void Application::setHairTransparency(TransparencyMode mode, VkDeviceSize linkedListBudget) {
+    this->linkedListBudget = linkedListBudget;
+    renderer.recreateSwapChain(renderer.getSwapChain()->usesMSAA(), mode);
+}
+
+void Application::editForceField(Entity entity) {
+    Registry& registry = scene.getRegistry();
+    ForceField& forces = registry.get<ForceField>(entity);
+
+    ImGui::PushID(static_cast<int>(entity));
+    if (ImGui::CollapsingHeader(("Forces (entity " + std::to_string(entity) + ")").c_str())) {
+        ImGui::DragFloat3("Wind", &forces.wind.x, 0.1f);
+        ImGui::DragFloat("Drag", &forces.drag, 0.01f, 0.f, 10.f);
+        ImGui::DragFloat("Turbulence", &forces.turbulence, 0.05f, 0.f, 20.f);
+        ImGui::DragFloat("Turbulence Scale", &forces.turbulenceScale, 0.01f, 0.f, 10.f);
+        ImGui::DragFloat("Turbulence Speed", &forces.turbulenceSpeed, 0.01f, 0.f, 10.f);
+
+        for (size_t i = 0; i < forces.attractors.size(); i++) {
+            ImGui::PushID(static_cast<int>(i));
+            ImGui::Text("Attractor %zu", i);
+            ImGui::DragFloat3("Position", &forces.attractors[i].position.x, 0.05f);
+            ImGui::DragFloat("Strength", &forces.attractors[i].strength, 0.05f);
+            ImGui::DragFloat("Radius", &forces.attractors[i].radius, 0.01f, 0.f, 100.f);
+            bool removed = ImGui::Button("Remove");
+            ImGui::PopID();
+
+            if (removed) {
+                forces.attractors.erase(forces.attractors.begin() + i);
+                break;
+            }
+        }
+        if (ImGui::Button("Add Attractor")) {
+            Attractor attractor{};
+            if (auto world = registry.tryGet<WorldTransform>(entity)) {
+                attractor.position = glm::vec3(world->model[3]);
+            }
+            forces.attractors.push_back(attractor);
+        }
+    }
+    ImGui::PopID();
+}
+
+void Application::showGpuProfiler(GpuProfiler& gpuProfiler) {
+    if (!ImGui::CollapsingHeader("GPU Profiler")) return;
+    if (!gpuProfiler.isSupported()) {
+        ImGui::Text("Timestamps not supported");
+        return;
+    }
+
+    // Plots read the history through a callback, it is not contiguous per zone. Indices start at
+    // firstFrame, the offset of PlotLines would wrap around inside the plotted frames instead.
+    struct PlotData {
+        const std::deque<GpuProfiler::Frame>* history;
+        size_t zone;
+        int firstFrame;
+    };
+    auto zoneTime = [](void* data, int index) {
+        auto plotData = static_cast<PlotData*>(data);
+        const auto& zoneTimes = (*plotData->history)[plotData->firstFrame + index].zoneTimes;
+        return plotData->zone < zoneTimes.size() ? zoneTimes[plotData->zone] : 0.f;
+    };
+
+    const auto& history = gpuProfiler.getHistory();
+    const auto& zoneNames = gpuProfiler.getZoneNames();
+    const int frameCount = static_cast<int>(std::min<size_t>(history.size(), 240));
+    const int firstFrame = static_cast<int>(history.size()) - frameCount;
+    for (size_t zone = 0; zone < zoneNames.size(); zone++) {
+        PlotData plotData{&history, zone, firstFrame};
+        float latest = frameCount == 0 ? 0.f : zoneTime(&plotData, frameCount - 1);
+        char label[64];
+        snprintf(label, sizeof(label), "%s: %.3f ms", zoneNames[zone].c_str(), latest);
+        ImGui::PlotLines(label, zoneTime, &plotData, frameCount, 0, nullptr, 0.f, FLT_MAX,
+                         ImVec2(0.f, 40.f));
+    }
+
+    if (ImGui::Button("Export CSV")) {
+        gpuProfiler.exportCSV("gpu_profile.csv");
+        printf("GPU profile written to \"gpu_profile.csv\"\n");
+    }
+}
+
 void Application::run() {
-    RenderSystem renderSystem{device, renderer.getSwapChainRenderPass(), scene};
-    ImGuiHelper imGuiHelper(*this);
+    RenderSystem renderSystem{device, pipelineCache, *renderer.getSwapChain(), scene, recordingThreads,
+                              linkedListBudget, hairShadowSettings};
+    // Without UI, ImGui is never initialized
+    std::unique_ptr<ImGuiHelper> imGuiHelper;
+    if (renderer.hasUI()) {
+        imGuiHelper = std::make_unique<ImGuiHelper>(*this);
+    }
+    GpuProfiler gpuProfiler{device};
 
-    auto viewerObject = Entity::createEntity();
-    viewerObject.transform.translation = {0.f, 3.f, -2.f};
+    TransformComponent viewerTransform{glm::vec3{0.f, 3.f, -2.f}};
     InputController cameraController{};
+    Entity pickedEntity = NULL_ENTITY;
 
-    bool useMSAA = true;
+    bool useMSAA = renderer.getSwapChain()->usesMSAA();
     bool switchedMSAA = false;
+    int transparencyMode = static_cast<int>(renderer.getSwapChain()->getTransparencyMode());
+    bool switchedTransparency = false;
+    HairShadowSettings shadowSettings = renderSystem.getHairShadowSettings();
+    // Resizes recreate the swap chain as well, the render system follows it
+    SwapChain* renderedSwapChain = renderer.getSwapChain().get();
 
     auto currentTime = std::chrono::high_resolution_clock::now();
     while (!window.shouldClose()) {
+        PROFILE_SCOPE("Frame");
         glfwPollEvents();
 
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        if (imGuiHelper) {
+            ImGui_ImplVulkan_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
 
-        ImGui::Begin("App window");
-        ImGui::Checkbox("Use Skybox", &scene.getMainCamera().hasSkybox());
-        switchedMSAA = ImGui::Checkbox("Use MSAA", &useMSAA);
+            ImGui::Begin("App window");
+            ImGui::Checkbox("Use Skybox", &scene.getMainCamera().hasSkybox());
+            switchedMSAA = ImGui::Checkbox("Use MSAA", &useMSAA);
+            SwapChain::AttachmentMemory attachmentMemory = renderer.getSwapChain()->getAttachmentMemory();
+            ImGui::Text("Attachment memory: %.1f MiB, %.1f MiB saved", attachmentMemory.allocated / 1048576.0,
+                        (attachmentMemory.unshared - attachmentMemory.allocated) / 1048576.0);
+            const char* transparencyModes[] = {"Opaque", "Weighted Blended", "Linked Lists"};
+            switchedTransparency = ImGui::Combo("Hair Transparency", &transparencyMode, transparencyModes, 3);
+            if (transparencyMode != static_cast<int>(TransparencyMode::Opaque)) {
+                float hairOpacity = renderSystem.getHairOpacity();
+                if (ImGui::SliderFloat("Hair Opacity", &hairOpacity, 0.f, 1.f)) {
+                    renderSystem.setHairOpacity(hairOpacity);
+                }
+                const HairTransparency& hairTransparency = renderSystem.getHairTransparency();
+                ImGui::Text("Transparency memory: %.1f MiB", hairTransparency.getMemoryUsage() / 1048576.0);
+                if (hairTransparency.getMode() == TransparencyMode::LinkedList) {
+                    ImGui::Text("Fragment capacity: %u", hairTransparency.getNodeCapacity());
+                }
+            }
+            if (ImGui::CollapsingHeader("Hair Shadows")) {
+                // Applied once the frame is submitted, resolution and layers recreate the maps
+                int shadowLayers = static_cast<int>(shadowSettings.layerCount);
+                if (ImGui::SliderInt("Layers", &shadowLayers, 0, static_cast<int>(HairShadows::MAX_LAYERS))) {
+                    shadowSettings.layerCount = static_cast<uint32_t>(shadowLayers);
+                }
+                const uint32_t shadowResolutions[] = {128, 256, 512, 1024, 2048};
+                const char* shadowResolutionNames[] = {"128", "256", "512", "1024", "2048"};
+                int shadowResolution = 0;
+                while (shadowResolution < 4 && shadowResolutions[shadowResolution] < shadowSettings.resolution) {
+                    shadowResolution++;
+                }
+                if (ImGui::Combo("Resolution", &shadowResolution, shadowResolutionNames, 5)) {
+                    shadowSettings.resolution = shadowResolutions[shadowResolution];
+                }
+                ImGui::SliderFloat("Layer Spacing", &shadowSettings.layerSpacing, 0.005f, 0.2f);
+                ImGui::SliderFloat("Density", &shadowSettings.density, 0.f, 4.f);
+                ImGui::Text("Shadow memory: %.1f MiB", renderSystem.getHairShadowMemory() / 1048576.0);
+            }
+            ImGui::Checkbox("Simulate Hair", &scene.isSimulating());
+            if (pickedEntity != NULL_ENTITY) {
+                ImGui::Text("Picked entity: %u", pickedEntity);
+            } else {
+                ImGui::Text("Picked entity: none");
+            }
+            // Editing never adds or removes force fields, so their pool can be walked directly
+            for (Entity entity : scene.getRegistry().pool<ForceField>().entities()) {
+                editForceField(entity);
+            }
+            if (scene.isExportingCache() && ImGui::Button("Finish Cache Export")) {
+                scene.finishCacheExport();
+            }
+            if (scene.isPlayingCache()) {
+                ImGui::Text("Cache time: %.2f s", scene.getCacheTime());
+            }
+            showGpuProfiler(gpuProfiler);
 
-        ImGui::End();
+            ImGui::End();
 
-        ImGui::ShowDemoWindow();
-        ImGui::Render();
+            ImGui::ShowDemoWindow();
+            ImGui::Render();
+        }
 
         auto newTime = std::chrono::high_resolution_clock::now();
         float frameTime =
             std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
         currentTime = newTime;
 
-        cameraController.moveInPlaneXZ(window.getGLFWwindow(), frameTime, viewerObject);
-        scene.getMainCamera().update(viewerObject.transform, renderer.getAspectRatio());
-        scene.updateScene();
+        cameraController.moveInPlaneXZ(window.getGLFWwindow(), frameTime, viewerTransform);
+        scene.getMainCamera().update(viewerTransform, renderer.getAspectRatio());
+
+        // Left clicks outside the UI pick the entity under the cursor
+        GLFWwindow* glfwWindow = window.getGLFWwindow();
+        int windowWidth, windowHeight;
+        glfwGetWindowSize(glfwWindow, &windowWidth, &windowHeight);
+        if (imGuiHelper && !ImGui::GetIO().WantCaptureMouse && windowWidth > 0 && windowHeight > 0 &&
+            glfwGetMouseButton(glfwWindow, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+            double cursorX, cursorY;
+            glfwGetCursorPos(glfwWindow, &cursorX, &cursorY);
+            glm::vec2 ndc{2.f * static_cast<float>(cursorX) / windowWidth - 1.f,
+                          2.f * static_cast<float>(cursorY) / windowHeight - 1.f};
+            glm::vec3 origin, direction;
+            scene.getMainCamera().screenRay(ndc, origin, direction);
+            pickedEntity = scene.pick(origin, direction);
+        }
+        scene.updateScene(frameTime);
 
         if (auto commandBuffer = renderer.beginFrame()) {
-            FrameInfo frameInfo{renderer.getFrameIndex(), frameTime, commandBuffer, scene.getMainCamera()};
+            if (renderer.getSwapChain().get() != renderedSwapChain) {
+                renderedSwapChain = renderer.getSwapChain().get();
+                renderSystem.recreateSwapChainResources(*renderedSwapChain);
+            }
+
+            FrameInfo frameInfo{renderer.getFrameIndex(), frameTime, commandBuffer, scene.getMainCamera(), &gpuProfiler,
+                                renderer.getSwapChainRenderPass(), renderer.getCurrentFramebuffer(), renderer.getSwapChainExtent()};
 
             renderer.beginCommandBuffer(commandBuffer);
-            renderer.beginSwapChainRenderPass(commandBuffer);
+            gpuProfiler.beginFrame(commandBuffer, frameInfo.frameIndex);
+            scene.updateAssets(commandBuffer);
+            renderSystem.updateHairBuffers(frameInfo);
+            renderSystem.updateLights(frameInfo);
+            renderSystem.renderHairShadows(frameInfo);
+            {
+                // Includes the clears, the MSAA resolve and the UI, on top of the passes profiled inside
+                GpuZone zone{&gpuProfiler, commandBuffer, "Main Pass"};
+                renderer.beginSwapChainRenderPass(commandBuffer, renderSystem.getSubpassContents());
 
-            renderSystem.renderEntities(frameInfo);
+                renderSystem.renderEntities(frameInfo);
+                if (imGuiHelper) {
+                    imGuiHelper->renderImGui(commandBuffer, &gpuProfiler);
+                }
 
-            renderer.endSwapChainRenderPass(commandBuffer);
+                renderer.endSwapChainRenderPass(commandBuffer);
+            }
+            gpuProfiler.endFrame(commandBuffer);
             renderer.endCommandBuffer(commandBuffer);
 
-            VkCommandBuffer imGuiCommandBuffer = imGuiHelper.renderImGui();
-
             bool wasWindowResized = false;
-            renderer.endFrame(std::vector<VkCommandBuffer>({commandBuffer, imGuiCommandBuffer}), wasWindowResized);
+            renderer.endFrame(std::vector<VkCommandBuffer>({commandBuffer}), wasWindowResized);
+        }
 
-            if (wasWindowResized) {
-                imGuiHelper.updateImGuiFramebuffers();
-            }
+        if (switchedMSAA || switchedTransparency) {
+            // Both change the render pass, the render system follows on the next frame
+            renderer.recreateSwapChain(useMSAA, static_cast<TransparencyMode>(transparencyMode));
+            transparencyMode = static_cast<int>(renderer.getSwapChain()->getTransparencyMode());
+            imGuiHelper->recreate();
         }
+        renderSystem.setHairShadowSettings(shadowSettings);
+    }
+
+    vkDeviceWaitIdle(device.device());
+}
+
+// Scripted camera for headless runs: circles the head, starting at the interactive viewpoint
+static void orbitCamera(TransformComponent& transform, float time) {
+    const glm::vec3 target{0.f, 3.f, 2.5f};
+    const float radius = 4.5f;
+    const float yaw = 0.5f * time;
 
-        if (switchedMSAA) {
-            renderer.recreateSwapChain(useMSAA);
-            renderSystem.recreatePipelines(renderer.getSwapChainRenderPass(), useMSAA);
-            imGuiHelper.recreate();
+    transform.setRotation({0.f, yaw, 0.f});
+    transform.setTranslation(target - radius * glm::vec3{std::sin(yaw), 0.f, std::cos(yaw)});
+}
+
+void Application::recordFrameReadback(VkCommandBuffer commandBuffer, VkBuffer buffer) {
+    VkImage image = renderer.getSwapChain()->getImage(renderer.getImageIndex());
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {renderer.getSwapChain()->width(), renderer.getSwapChain()->height(), 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+}
+
+std::vector<FrameStatistics> Application::runHeadless(uint32_t frameCount, const std::string& frameDirectory) {
+    RenderSystem renderSystem{device, pipelineCache, *renderer.getSwapChain(), scene, recordingThreads,
+                              linkedListBudget, hairShadowSettings};
+
+    // Keeps every frame, profiler frame numbers then match the statistics entries
+    GpuProfiler gpuProfiler{device, frameCount};
+    std::vector<FrameStatistics> statistics;
+    statistics.reserve(frameCount);
+
+    const uint32_t width = renderer.getSwapChain()->width();
+    const uint32_t height = renderer.getSwapChain()->height();
+    std::vector<std::unique_ptr<Buffer>> readbackBuffers;
+    if (!frameDirectory.empty()) {
+        readbackBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto& readbackBuffer : readbackBuffers) {
+            readbackBuffer = std::make_unique<Buffer>(device, 4, width * height, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            readbackBuffer->map();
         }
     }
 
+    TransformComponent viewerTransform{};
+
+    printf("Rendering %u headless frames at %ux%u\n", frameCount, width, height);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        PROFILE_SCOPE("Frame");
+        auto frameStartTime = std::chrono::high_resolution_clock::now();
+
+        // Fixed timestep, so runs are comparable whatever the frame rate
+        orbitCamera(viewerTransform, frame * HEADLESS_FRAME_TIME);
+        scene.getMainCamera().update(viewerTransform, renderer.getAspectRatio());
+        scene.updateScene(HEADLESS_FRAME_TIME);
+
+        auto commandBuffer = renderer.beginFrame();
+        if (!commandBuffer) continue;
+
+        FrameInfo frameInfo{renderer.getFrameIndex(), HEADLESS_FRAME_TIME, commandBuffer, scene.getMainCamera(), &gpuProfiler,
+                            renderer.getSwapChainRenderPass(), renderer.getCurrentFramebuffer(), renderer.getSwapChainExtent()};
+
+        renderer.beginCommandBuffer(commandBuffer);
+        gpuProfiler.beginFrame(commandBuffer, frameInfo.frameIndex);
+        renderSystem.updateHairBuffers(frameInfo);
+        renderSystem.updateLights(frameInfo);
+        renderSystem.renderHairShadows(frameInfo);
+        {
+            GpuZone zone{&gpuProfiler, commandBuffer, "Main Pass"};
+            renderer.beginSwapChainRenderPass(commandBuffer, renderSystem.getSubpassContents());
+
+            renderSystem.renderEntities(frameInfo);
+
+            renderer.endSwapChainRenderPass(commandBuffer);
+        }
+        gpuProfiler.endFrame(commandBuffer);
+        if (!readbackBuffers.empty()) {
+            recordFrameReadback(commandBuffer, readbackBuffers[frameInfo.frameIndex]->getBuffer());
+        }
+        renderer.endCommandBuffer(commandBuffer);
+
+        bool wasWindowResized = false;
+        renderer.endFrame(std::vector<VkCommandBuffer>({commandBuffer}), wasWindowResized);
+
+        auto frameEndTime = std::chrono::high_resolution_clock::now();
+        SwapChain::AttachmentMemory attachmentMemory = renderer.getSwapChain()->getAttachmentMemory();
+        statistics.push_back({std::chrono::duration<double, std::milli>(frameEndTime - frameStartTime).count(), 0.0,
+                              renderSystem.getRecordTime(), renderSystem.getDrawCount(),
+                              device.allocatedMemory() - (attachmentMemory.allocated - attachmentMemory.committed)});
+
+        if (!readbackBuffers.empty()) {
+            // Dumping stalls on every frame, timings are only meaningful without it
+            vkQueueWaitIdle(device.graphicsQueue());
+
+            char filename[32];
+            snprintf(filename, sizeof(filename), "/frame_%05u.png", frame);
+            writePNG(frameDirectory + filename, width, height,
+                     static_cast<const uint8_t*>(readbackBuffers[frameInfo.frameIndex]->getMappedMemory()));
+        }
+    }
     vkDeviceWaitIdle(device.device());
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double totalTime = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    printf("Rendered %u frames in %.1f ms (%.3f ms per frame)\n", frameCount, totalTime,
+           frameCount > 0 ? totalTime / frameCount : 0.0);
+
+    SwapChain::AttachmentMemory attachmentMemory = renderer.getSwapChain()->getAttachmentMemory();
+    printf("Attachments: %.1f MiB committed of %.1f MiB allocated, %.1f MiB saved over fully backed copies per image\n",
+           attachmentMemory.committed / 1048576.0, attachmentMemory.allocated / 1048576.0,
+           (attachmentMemory.unshared - attachmentMemory.committed) / 1048576.0);
+
+    gpuProfiler.collect();
+    for (const auto& frame : gpuProfiler.getHistory()) {
+        if (frame.number < statistics.size()) {
+            statistics[frame.number].gpuTime = frame.zoneTimes[0];
+        }
+    }
+    return statistics;
 }
 
 }  // namespace vkr
@@ -8,12 +8,17 @@
 
 #include <Device.hpp>
 #include <Entity.hpp>
+#include <FrameInfo.hpp>
+#include <HairShadows.hpp>
+#include <HairTransparency.hpp>
+#include <PipelineCache.hpp>
 #include <Renderer.hpp>
 #include <Scene.hpp>
 #include <Window.hpp>
 
 // std
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace vkr {
@@ -22,7 +27,9 @@ class Application {
     static constexpr int WIDTH = 800;
     static constexpr int HEIGHT = 600;
 
-    Application();
+    // Headless applications render offscreen, without window, surface or presentation. The UI
+    // is left out of those, and of production runs with withUI false.
+    Application(bool headless = false, bool withUI = true);
     ~Application();
 
     Application(const Application&) = delete;
@@ -31,14 +38,44 @@ class Application {
     Device& getDevice() { return device; }
     Window& getWindow() { return window; }
     Renderer& getRenderer() { return renderer; }
+    PipelineCache& getPipelineCache() { return pipelineCache; }
+    Scene& getScene() { return scene; }
+    // Threads recording the draws, see RenderSystem
+    void setRecordingThreads(uint32_t threadCount) { recordingThreads = threadCount; }
+    // Blending of the hair, linkedListBudget bytes of fragments for linked lists. Also switchable
+    // from the UI.
+    void setHairTransparency(TransparencyMode mode,
+                             VkDeviceSize linkedListBudget = HairTransparency::DEFAULT_LINKED_LIST_BUDGET);
+    // Deep opacity maps of the hair, see HairShadows. Also tunable from the UI.
+    void setHairShadows(const HairShadowSettings& settings) { hairShadowSettings = settings; }
 
+    // Simulates the hair from the first frame, writing every step to filepath
+    void recordSimulation(const std::string& filepath);
+    void exportSimulationCache(const std::string& filepath);
+    void playSimulationCache(const std::string& filepath);
     void run();
+    // Renders frameCount frames at a fixed timestep with a camera orbiting the scene. Frames are
+    // written to frameDirectory as PNG files unless it is empty.
+    std::vector<FrameStatistics> runHeadless(uint32_t frameCount, const std::string& frameDirectory = "");
 
    private:
-    Window window{WIDTH, HEIGHT, "Vulkan Tutorial"};
+    static constexpr float HEADLESS_FRAME_TIME = 1.f / 60.f;
+    static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+    void editForceField(Entity entity);
+    // Rolling graph of each profiled pass, with CSV export
+    void showGpuProfiler(GpuProfiler& gpuProfiler);
+    // Copies the swap chain image just rendered into buffer, must follow the render pass
+    void recordFrameReadback(VkCommandBuffer commandBuffer, VkBuffer buffer);
+
+    Window window;
     Device device{window};
-    Renderer renderer{window, device};
+    PipelineCache pipelineCache{device, PIPELINE_CACHE_PATH};
+    Renderer renderer;
 
     Scene scene{device};
+    uint32_t recordingThreads = 0;
+    VkDeviceSize linkedListBudget = HairTransparency::DEFAULT_LINKED_LIST_BUDGET;
+    HairShadowSettings hairShadowSettings;
 };
 }  // namespace vkr
@@ -0,0 +1,232 @@
+#include <AssetLoader.hpp>
+#include <Profiler.hpp>
+
+// std
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace vkr {
+
+AssetLoader::AssetLoader(Device &device, uint32_t threadCount) : device{device} {
+    device.createCommandPool(commandPool, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, device.queueFamilyIndices().transferFamily);
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&AssetLoader::work, this);
+    }
+}
+
+AssetLoader::~AssetLoader() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (auto &submission : submissions) {
+        vkWaitForFences(device.device(), 1, &submission.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        destroySubmission(submission);
+    }
+    submissions.clear();
+    decoded.clear();
+    vkDestroyCommandPool(device.device(), commandPool, nullptr);
+}
+
+AssetHandle<Mesh> AssetLoader::loadMesh(const std::string &filepath) {
+    auto asset = std::make_shared<Asset<Mesh>>();
+    enqueue([this, asset, filepath]() -> Creator {
+        auto builder = std::make_shared<Mesh::Builder>();
+        builder->loadModel(filepath);
+        return [this, asset, builder](UploadBatch &uploads) {
+            return publish(asset, std::make_shared<Mesh>(device, *builder, &uploads));
+        };
+    });
+    return asset;
+}
+
+AssetHandle<Hair> AssetLoader::loadHair(const std::string &filepath) {
+    auto asset = std::make_shared<Asset<Hair>>();
+    enqueue([this, asset, filepath]() -> Creator {
+        auto builder = std::make_shared<Hair::Builder>();
+        builder->loadHairModel(filepath.c_str());
+        return [this, asset, builder, filepath](UploadBatch &uploads) {
+            return publish(asset, std::make_shared<Hair>(device, std::move(*builder), filepath, &uploads));
+        };
+    });
+    return asset;
+}
+
+AssetHandle<Texture> AssetLoader::loadTexture(const std::string &filepath) {
+    auto asset = std::make_shared<Asset<Texture>>();
+    enqueue([this, asset, filepath]() -> Creator {
+        auto builder = std::make_shared<Texture::Builder>(Texture::loadBuilder(device, filepath));
+        builder->decodeImages();
+        // Copied on the transfer queue, the mip chain is blitted once acquired on the graphics queue
+        return [this, asset, builder](UploadBatch &uploads) {
+            return publish(asset, std::make_shared<Texture>(device, *builder, &uploads));
+        };
+    });
+    return asset;
+}
+
+void AssetLoader::enqueue(std::function<Creator()> job) {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        jobs.push_back(std::move(job));
+    }
+    wakeCondition.notify_one();
+}
+
+void AssetLoader::work() {
+    while (true) {
+        std::function<Creator()> job;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            wakeCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busyWorkers++;
+        }
+
+        Creator creator;
+        std::exception_ptr jobError;
+        try {
+            creator = job();
+        } catch (...) {
+            jobError = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            busyWorkers--;
+            if (creator) decoded.push_back(std::move(creator));
+            if (jobError && !error) error = jobError;
+        }
+        doneCondition.notify_all();
+    }
+}
+
+void AssetLoader::rethrowError() {
+    std::exception_ptr jobError;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        std::swap(jobError, error);
+    }
+    if (jobError) std::rethrow_exception(jobError);
+}
+
+bool AssetLoader::createDecoded() {
+    std::vector<Creator> creators;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        std::swap(creators, decoded);
+    }
+    if (creators.empty()) return false;
+
+    PROFILE_FUNCTION();
+    auto uploads = std::make_unique<UploadBatch>(device);
+    std::vector<Publish> publishes;
+    for (auto &creator : creators) {
+        publishes.push_back(creator(*uploads));
+    }
+
+    if (uploads->empty()) {
+        for (auto &publish : publishes) publish();
+        return true;
+    }
+    submit(std::move(uploads), std::move(publishes));
+    return false;
+}
+
+void AssetLoader::submit(std::unique_ptr<UploadBatch> uploads, std::vector<Publish> publishes) {
+    Submission submission{std::move(uploads), std::move(publishes), VK_NULL_HANDLE, VK_NULL_HANDLE};
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device.device(), &allocInfo, &submission.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(submission.commandBuffer, &beginInfo);
+    submission.uploads->recordCopies(submission.commandBuffer);
+    vkEndCommandBuffer(submission.commandBuffer);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device.device(), &fenceInfo, nullptr, &submission.fence) != VK_SUCCESS) {
+        vkFreeCommandBuffers(device.device(), commandPool, 1, &submission.commandBuffer);
+        throw std::runtime_error("failed to create upload fence!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &submission.commandBuffer;
+    if (vkQueueSubmit(device.transferQueue(), 1, &submitInfo, submission.fence) != VK_SUCCESS) {
+        destroySubmission(submission);
+        throw std::runtime_error("failed to submit upload command buffer!");
+    }
+    submissions.push_back(std::move(submission));
+}
+
+bool AssetLoader::retireSubmissions(VkCommandBuffer commandBuffer) {
+    bool published = false;
+    for (auto it = submissions.begin(); it != submissions.end();) {
+        if (vkGetFenceStatus(device.device(), it->fence) != VK_SUCCESS) {
+            ++it;
+            continue;
+        }
+
+        it->uploads->recordAcquire(commandBuffer);
+        for (auto &publish : it->publishes) publish();
+        destroySubmission(*it);
+        it = submissions.erase(it);
+        published = true;
+    }
+    return published;
+}
+
+void AssetLoader::destroySubmission(Submission &submission) {
+    vkDestroyFence(device.device(), submission.fence, nullptr);
+    vkFreeCommandBuffers(device.device(), commandPool, 1, &submission.commandBuffer);
+    submission.uploads.reset();
+}
+
+bool AssetLoader::update(VkCommandBuffer commandBuffer) {
+    rethrowError();
+    bool published = createDecoded();
+    return retireSubmissions(commandBuffer) || published;
+}
+
+void AssetLoader::finish() {
+    PROFILE_FUNCTION();
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        doneCondition.wait(lock, [this] { return jobs.empty() && busyWorkers == 0; });
+    }
+    rethrowError();
+    createDecoded();
+    if (submissions.empty()) return;
+
+    for (auto &submission : submissions) {
+        vkWaitForFences(device.device(), 1, &submission.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
+    VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+    retireSubmissions(commandBuffer);
+    device.endSingleTimeCommands(commandBuffer);
+}
+
+}  // namespace vkr
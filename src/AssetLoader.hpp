@@ -0,0 +1,113 @@
+#pragma once
+
+#include <Device.hpp>
+#include <Hair.hpp>
+#include <Mesh.hpp>
+#include <Texture.hpp>
+#include <UploadBatch.hpp>
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vkr {
+
+// A resource streamed in by the AssetLoader. Only read and published on the thread calling update.
+template <typename T>
+class Asset {
+   public:
+    // Null until resident
+    std::shared_ptr<T> get() const { return resident ? resource : nullptr; }
+    bool isResident() const { return resident; }
+
+   private:
+    friend class AssetLoader;
+
+    std::shared_ptr<T> resource;
+    bool resident = false;
+};
+
+template <typename T>
+using AssetHandle = std::shared_ptr<Asset<T>>;
+
+// Loads meshes, hair and textures in the background. Files are read and decoded on worker threads,
+// then update creates the device resources and submits their copies to the transfer queue, without
+// waiting for them. Assets become resident once their copies have completed. The mip chains of
+// textures are blitted on the graphics command buffer the copies are acquired on.
+class AssetLoader {
+   public:
+    // threadCount workers read the files, 0 picks one per hardware thread
+    explicit AssetLoader(Device &device, uint32_t threadCount = 0);
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+
+    // Return at once, the handles stay empty until the asset is resident
+    AssetHandle<Mesh> loadMesh(const std::string &filepath);
+    AssetHandle<Hair> loadHair(const std::string &filepath);
+    AssetHandle<Texture> loadTexture(const std::string &filepath);
+
+    // Submits the copies of the assets decoded since the last call, and publishes the ones whose
+    // copies have completed. Their buffers and images are acquired on commandBuffer, a graphics
+    // command buffer which must be submitted before they are used. Rethrows the errors of the workers. Returns
+    // whether any asset became resident.
+    bool update(VkCommandBuffer commandBuffer);
+    // Blocks until every requested asset is resident
+    void finish();
+
+   private:
+    // Runs on the thread calling update: creates the device resources, recording their copies, and
+    // returns the step publishing them once the copies have completed
+    using Publish = std::function<void()>;
+    using Creator = std::function<Publish(UploadBatch &)>;
+
+    // Copies submitted to the transfer queue, in flight until their fence is signaled
+    struct Submission {
+        std::unique_ptr<UploadBatch> uploads;
+        std::vector<Publish> publishes;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+    };
+
+    template <typename T>
+    static Publish publish(const AssetHandle<T> &asset, std::shared_ptr<T> resource) {
+        return [asset, resource] {
+            asset->resource = resource;
+            asset->resident = true;
+        };
+    }
+
+    void enqueue(std::function<Creator()> job);
+    void work();
+    void rethrowError();
+    // Returns whether assets without copies were published right away
+    bool createDecoded();
+    void submit(std::unique_ptr<UploadBatch> uploads, std::vector<Publish> publishes);
+    bool retireSubmissions(VkCommandBuffer commandBuffer);
+    void destroySubmission(Submission &submission);
+
+    Device &device;
+    VkCommandPool commandPool;
+    std::vector<Submission> submissions;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    std::deque<std::function<Creator()>> jobs;
+    std::vector<Creator> decoded;
+    uint32_t busyWorkers = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+};
+
+}  // namespace vkr
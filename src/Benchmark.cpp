@@ -0,0 +1,252 @@
+#include <Benchmark.hpp>
+#include <HairSimulation.hpp>
+#include <Utils.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace vkr {
+
+static constexpr uint32_t BENCHMARK_STRAND_POINTS = 32;
+static constexpr uint32_t BENCHMARK_RUNS = 15;
+
+// Median time in milliseconds of the runs, after one warm up run
+static double medianTime(const std::function<void(uint32_t)> &run) {
+    run(0);
+
+    std::vector<double> times(BENCHMARK_RUNS);
+    for (uint32_t i = 0; i < BENCHMARK_RUNS; i++) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        run(i + 1);
+        auto endTime = std::chrono::high_resolution_clock::now();
+        times[i] = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+struct BenchmarkScene {
+    const char *name;
+    bool skybox;
+    bool simulation;
+    float turbulence;
+    uint32_t crowdSize;  // copies of the first mesh added around the scene
+    uint32_t pointLights;  // colored point lights over the crowd
+};
+
+static const BenchmarkScene BENCHMARK_SCENES[] = {
+    {"static", false, false, 0.f, 0, 0},       // head and hair at rest
+    {"skybox", true, false, 0.f, 0, 0},        // static with the skybox
+    {"simulation", false, true, 0.f, 0, 0},    // hair simulated under gravity, colliding with the head
+    {"turbulence", false, true, 1.f, 0, 0},    // simulation with wind and curl noise turbulence
+    {"crowd", false, false, 0.f, 1600, 0},     // static with thousands of draws, bound by command recording
+    {"lights", false, false, 0.f, 400, 512},   // smaller crowd under hundreds of clustered point lights
+};
+
+// Square grid of small copies of the first mesh entity on the ground, sharing its mesh and material
+static void addCrowd(Scene &scene, uint32_t crowdSize) {
+    Registry &registry = scene.getRegistry();
+    const auto &meshEntities = registry.pool<MeshComponent>().entities();
+    if (meshEntities.empty()) return;
+    const Entity source = meshEntities.front();
+    std::shared_ptr<Mesh> mesh = registry.get<MeshComponent>(source).mesh;
+    MaterialComponent *sourceMaterial = registry.tryGet<MaterialComponent>(source);
+    std::shared_ptr<Material> material = sourceMaterial ? sourceMaterial->material : nullptr;
+
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(crowdSize))));
+    const float spacing = 0.6f;
+    for (uint32_t i = 0; i < crowdSize; i++) {
+        Entity entity = registry.create();
+        registry.emplace<TransformComponent>(
+            entity, glm::vec3{(i % side - 0.5f * side) * spacing, 0.3f, 2.5f + (i / side - 0.5f * side) * spacing},
+            glm::vec3{0.5f}, glm::vec3{0.f, PI, 0.f});
+        registry.emplace<MeshComponent>(entity, mesh);
+        if (material) registry.emplace<MaterialComponent>(entity, material);
+    }
+}
+
+// Grid of point lights above the crowd, cycling through a few saturated colors
+static void addPointLights(Scene &scene, uint32_t lightCount) {
+    static const glm::vec3 COLORS[] = {{1.f, 0.3f, 0.2f}, {0.3f, 1.f, 0.3f}, {0.2f, 0.4f, 1.f}, {1.f, 0.9f, 0.3f}};
+
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(lightCount))));
+    const float spacing = 12.f / std::max(side, 1u);
+    for (uint32_t i = 0; i < lightCount; i++) {
+        Entity entity = scene.getRegistry().create();
+        scene.getRegistry().emplace<Light>(entity, 2.f, COLORS[i % 4], Light::Type::Point, 1.5f);
+        scene.getRegistry().emplace<TransformComponent>(
+            entity, glm::vec3{(i % side - 0.5f * side) * spacing, -0.3f, 2.5f + (i / side - 0.5f * side) * spacing});
+    }
+}
+
+void configureBenchmarkScene(Scene &scene, const std::string &name) {
+    for (const auto &benchmarkScene : BENCHMARK_SCENES) {
+        if (name != benchmarkScene.name) continue;
+
+        scene.getMainCamera().hasSkybox() = benchmarkScene.skybox;
+        scene.isSimulating() = benchmarkScene.simulation;
+        for (auto &forces : scene.getRegistry().pool<ForceField>().data()) {
+            forces.turbulence = benchmarkScene.turbulence;
+            forces.wind = benchmarkScene.turbulence > 0.f ? glm::vec3{1.f, 0.f, 0.f} : glm::vec3{0.f};
+        }
+        addCrowd(scene, benchmarkScene.crowdSize);
+        addPointLights(scene, benchmarkScene.pointLights);
+        return;
+    }
+
+    std::string names;
+    for (const auto &benchmarkScene : BENCHMARK_SCENES) {
+        names += std::string(names.empty() ? "" : ", ") + benchmarkScene.name;
+    }
+    throw std::runtime_error("unknown benchmark scene \"" + name + "\" (known: " + names + ")");
+}
+
+// Nearest rank percentile of sorted, non empty values
+template <typename T>
+static T percentile(const std::vector<T> &sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+template <typename T>
+static void writePercentiles(std::ofstream &file, const char *name, std::vector<T> values) {
+    std::sort(values.begin(), values.end());
+
+    file << "    \"" << name << "\": {";
+    if (!values.empty()) {
+        file << "\"min\": " << values.front() << ", \"p50\": " << percentile(values, 50)
+             << ", \"p90\": " << percentile(values, 90) << ", \"p95\": " << percentile(values, 95)
+             << ", \"p99\": " << percentile(values, 99) << ", \"max\": " << values.back();
+    }
+    file << "}";
+}
+
+template <typename T>
+static void writeValues(std::ofstream &file, const char *name, const std::vector<T> &values) {
+    file << "    \"" << name << "\": [";
+    for (size_t i = 0; i < values.size(); i++) {
+        file << (i > 0 ? ", " : "") << values[i];
+    }
+    file << "]";
+}
+
+void writeBenchmarkResults(const std::string &filepath, const std::string &sceneName,
+                           const std::vector<FrameStatistics> &frames) {
+    std::ofstream file{filepath};
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open benchmark results: " + filepath);
+    }
+
+    std::vector<double> cpuTimes, gpuTimes, recordTimes;
+    std::vector<uint32_t> drawCounts;
+    std::vector<uint64_t> deviceMemory;
+    for (const auto &frame : frames) {
+        cpuTimes.push_back(frame.cpuTime);
+        gpuTimes.push_back(frame.gpuTime);
+        recordTimes.push_back(frame.recordTime);
+        drawCounts.push_back(frame.drawCount);
+        deviceMemory.push_back(frame.deviceMemory);
+    }
+
+    file << "{\n  \"scene\": \"" << sceneName << "\",\n  \"frames\": " << frames.size() << ",\n";
+    file << "  \"units\": {\"cpuTime\": \"ms\", \"gpuTime\": \"ms\", \"recordTime\": \"ms\", \"deviceMemory\": \"bytes\"},\n";
+    file << "  \"percentiles\": {\n";
+    writePercentiles(file, "cpuTime", cpuTimes);
+    file << ",\n";
+    writePercentiles(file, "gpuTime", gpuTimes);
+    file << ",\n";
+    writePercentiles(file, "recordTime", recordTimes);
+    file << ",\n";
+    writePercentiles(file, "drawCount", drawCounts);
+    file << ",\n";
+    writePercentiles(file, "deviceMemory", deviceMemory);
+    file << "\n  },\n  \"perFrame\": {\n";
+    writeValues(file, "cpuTime", cpuTimes);
+    file << ",\n";
+    writeValues(file, "gpuTime", gpuTimes);
+    file << ",\n";
+    writeValues(file, "recordTime", recordTimes);
+    file << ",\n";
+    writeValues(file, "drawCount", drawCounts);
+    file << ",\n";
+    writeValues(file, "deviceMemory", deviceMemory);
+    file << "\n  }\n}\n";
+
+    if (!file) {
+        throw std::runtime_error("failed to write benchmark results: " + filepath);
+    }
+    if (!frames.empty()) {
+        std::sort(cpuTimes.begin(), cpuTimes.end());
+        std::sort(gpuTimes.begin(), gpuTimes.end());
+        std::sort(recordTimes.begin(), recordTimes.end());
+        printf("Benchmark \"%s\": CPU p50 %.3f ms p99 %.3f ms, GPU p50 %.3f ms p99 %.3f ms, recording p50 %.3f ms\n",
+               sceneName.c_str(), percentile(cpuTimes, 50), percentile(cpuTimes, 99), percentile(gpuTimes, 50),
+               percentile(gpuTimes, 99), percentile(recordTimes, 50));
+    }
+    printf("Benchmark results written to \"%s\"\n", filepath.c_str());
+}
+
+void benchmarkForceField(uint32_t particleCount) {
+    // Vertical strands rooted on a square patch, roughly the size of a scalp
+    const uint32_t strandCount = std::max(particleCount / BENCHMARK_STRAND_POINTS, 1u);
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(strandCount))));
+    std::vector<glm::vec3> restPositions;
+    std::vector<uint32_t> strandOffsets{0};
+    restPositions.reserve(strandCount * BENCHMARK_STRAND_POINTS);
+    for (uint32_t s = 0; s < strandCount; s++) {
+        glm::vec3 root{0.3f * (s % side) / side, 0.f, 0.3f * (s / side) / side};
+        for (uint32_t i = 0; i < BENCHMARK_STRAND_POINTS; i++) {
+            restPositions.push_back(root - glm::vec3(0.f, 0.01f * i, 0.f));
+        }
+        strandOffsets.push_back(static_cast<uint32_t>(restPositions.size()));
+    }
+    printf("Force field benchmark: %zu points in %u strands, median of %u runs\n",
+           restPositions.size(), strandCount, BENCHMARK_RUNS);
+
+    SimulationInput input{};
+    input.timestep = 1.f / 60.f;
+    input.forces.wind = {1.f, 0.f, 0.f};
+    input.forces.turbulenceScale = 10.f;
+
+    HairSimulation simulation{restPositions, strandOffsets};
+    double calmStep = medianTime([&](uint32_t run) {
+        input.time = run * input.timestep;
+        simulation.step(input);
+    });
+
+    input.forces.turbulence = 1.f;
+    simulation.reset();
+    double turbulentStep = medianTime([&](uint32_t run) {
+        input.time = run * input.timestep;
+        simulation.step(input);
+    });
+
+    std::vector<glm::vec3> velocities(restPositions.size(), glm::vec3{0.f});
+    std::vector<glm::vec3> accelerations(restPositions.size());
+    const std::vector<glm::vec3> &positions = simulation.getPositions();
+    double noise = medianTime([&](uint32_t run) {
+        input.forces.evaluate(positions.data(), velocities.data(), accelerations.data(), positions.size(),
+                              run * input.timestep);
+    });
+    input.forces.turbulence = 0.f;
+    double calmForces = medianTime([&](uint32_t run) {
+        input.forces.evaluate(positions.data(), velocities.data(), accelerations.data(), positions.size(),
+                              run * input.timestep);
+    });
+    noise -= calmForces;
+
+    printf("Step without turbulence: %.3f ms\n", calmStep);
+    printf("Step with turbulence:    %.3f ms\n", turbulentStep);
+    printf("Curl noise evaluation:   %.3f ms (%.1f%% of a turbulent step, %.2f ns per point)\n",
+           noise, 100.0 * noise / turbulentStep, 1e6 * noise / restPositions.size());
+}
+
+}  // namespace vkr
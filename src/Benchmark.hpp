@@ -0,0 +1,30 @@
+#pragma once
+
+#include <FrameInfo.hpp>
+#include <Scene.hpp>
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vkr {
+
+// Rendering benchmarks: a named configuration of the scene, rendered headless for a fixed number
+// of frames along the scripted camera path, and the frame statistics summarized into a JSON file
+
+// Throws for unknown names, listing the known ones. Must be called before the render system is
+// created, as some scenes add entities.
+void configureBenchmarkScene(Scene &scene, const std::string &name);
+
+// Percentiles of every statistic followed by the per frame values
+void writeBenchmarkResults(const std::string &filepath, const std::string &sceneName,
+                           const std::vector<FrameStatistics> &frames);
+
+// CPU benchmarks, run from the command line before any window or device is created
+
+// Times solver steps on synthetic strands with and without turbulence, and the force field
+// evaluation alone, to check what the noise adds to a step
+void benchmarkForceField(uint32_t particleCount);
+
+}  // namespace vkr
@@ -23,6 +23,8 @@ void Camera::setOrthographicProjection(
     projectionMatrix[3][0] = -(right + left) / (right - left);
     projectionMatrix[3][1] = -(bottom + top) / (bottom - top);
     projectionMatrix[3][2] = -near / (far - near);
+    nearPlane = near;
+    farPlane = far;
 }
 
 void Camera::setPerspectiveProjection(float fovy, float aspect, float near, float far) {
@@ -34,6 +36,8 @@ void Camera::setPerspectiveProjection(float fovy, float aspect, float near, floa
     projectionMatrix[2][2] = far / (far - near);
     projectionMatrix[2][3] = 1.f;
     projectionMatrix[3][2] = -(far * near) / (far - near);
+    nearPlane = near;
+    farPlane = far;
 }
 
 void Camera::setViewDirection(glm::vec3 position, glm::vec3 direction, glm::vec3 up) {
@@ -86,11 +90,19 @@ void Camera::setViewYXZ(glm::vec3 position, glm::vec3 rotation) {
 }
 
 void Camera::update(TransformComponent viewerObjectTransform, float aspect) {
-    setViewYXZ(viewerObjectTransform.translation, viewerObjectTransform.rotation);
+    setViewYXZ(viewerObjectTransform.getTranslation(), viewerObjectTransform.getRotation());
     invViewMatrix = glm::inverse(viewMatrix);
 
     setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 100.f);
-    skybox.transform.translation = getPosition();
+    skybox.transform.setTranslation(getPosition());
+}
+
+void Camera::screenRay(const glm::vec2& ndc, glm::vec3& origin, glm::vec3& direction) const {
+    glm::mat4 invProjectionView = invViewMatrix * glm::inverse(projectionMatrix);
+    glm::vec4 nearPoint = invProjectionView * glm::vec4(ndc, 0.f, 1.f);
+    glm::vec4 farPoint = invProjectionView * glm::vec4(ndc, 1.f, 1.f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
 }
 
 void Camera::loadSkybox(Device& device) {
@@ -14,6 +14,13 @@
 
 namespace vkr {
 
+// Drawn around the camera, outside of the scene registry
+struct Skybox {
+    TransformComponent transform{};
+    std::shared_ptr<Mesh> mesh;
+    std::shared_ptr<Material> material;
+};
+
 class Camera {
    public:
     void setOrthographicProjection(
@@ -28,13 +35,19 @@ class Camera {
 
     const glm::mat4& getProjection() const { return projectionMatrix; }
     const glm::mat4& getView() const { return viewMatrix; }
+    float getNear() const { return nearPlane; }
+    float getFar() const { return farPlane; }
     glm::vec3 getPosition() { return glm::vec3{invViewMatrix[3][0], invViewMatrix[3][1], invViewMatrix[3][2]}; }
 
     void update(TransformComponent viewerObjectTransform, float aspect);
 
+    // World space ray through a point of the viewport, in normalized device coordinates (-1 at the
+    // top left corner). It starts on the near plane, direction is normalized.
+    void screenRay(const glm::vec2& ndc, glm::vec3& origin, glm::vec3& direction) const;
+
     void loadSkybox(Device& device);
     // void removeSkybox();
-    Entity& getSkybox() { return skybox; }
+    Skybox& getSkybox() { return skybox; }
 
     bool& hasSkybox() { return skyboxEnabled; };
 
@@ -42,8 +55,10 @@ class Camera {
     glm::mat4 projectionMatrix{1.f};
     glm::mat4 viewMatrix{1.f};
     glm::mat4 invViewMatrix{1.f};
+    float nearPlane = 0.1f;
+    float farPlane = 100.f;
 
-    Entity skybox{Entity::createEntity()};
+    Skybox skybox;
     bool skyboxEnabled = false;
 };
 
@@ -0,0 +1,76 @@
+#include <Collider.hpp>
+
+// std
+#include <algorithm>
+
+namespace vkr {
+
+Collider Collider::sphere(glm::vec3 center, float radius) {
+    Collider collider{};
+    collider.type = ColliderType::Sphere;
+    collider.center = center;
+    collider.radius = radius;
+    return collider;
+}
+
+Collider Collider::capsule(glm::vec3 center, float radius, float halfHeight) {
+    Collider collider{};
+    collider.type = ColliderType::Capsule;
+    collider.center = center;
+    collider.radius = radius;
+    collider.halfHeight = halfHeight;
+    return collider;
+}
+
+Collider Collider::box(glm::vec3 center, glm::vec3 halfExtents) {
+    Collider collider{};
+    collider.type = ColliderType::Box;
+    collider.center = center;
+    collider.halfExtents = halfExtents;
+    return collider;
+}
+
+ColliderShape Collider::toWorld(const glm::mat4 &transform) const {
+    ColliderShape shape{};
+    shape.type = type;
+    shape.center = glm::vec3(transform * glm::vec4(center, 1.f));
+
+    glm::vec3 scale;
+    for (int i = 0; i < 3; i++) {
+        glm::vec3 axis = glm::vec3(transform[i]);
+        scale[i] = glm::length(axis);
+        shape.axes[i] = scale[i] > 0.f ? axis / scale[i] : glm::vec3(0.f);
+    }
+    const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+
+    switch (type) {
+        case ColliderType::Sphere:
+            shape.end = shape.center;
+            shape.radius = radius * maxScale;
+            shape.boundsMin = shape.center - glm::vec3(shape.radius);
+            shape.boundsMax = shape.center + glm::vec3(shape.radius);
+            break;
+        case ColliderType::Capsule:
+            shape.end = glm::vec3(transform * glm::vec4(center + glm::vec3(0.f, halfHeight, 0.f), 1.f));
+            shape.center = glm::vec3(transform * glm::vec4(center - glm::vec3(0.f, halfHeight, 0.f), 1.f));
+            shape.radius = radius * maxScale;
+            shape.boundsMin = glm::min(shape.center, shape.end) - glm::vec3(shape.radius);
+            shape.boundsMax = glm::max(shape.center, shape.end) + glm::vec3(shape.radius);
+            break;
+        case ColliderType::Box: {
+            shape.end = shape.center;
+            shape.halfExtents = halfExtents * scale;
+            glm::vec3 extent{0.f};
+            for (int i = 0; i < 3; i++) {
+                extent += glm::abs(shape.axes[i]) * shape.halfExtents[i];
+            }
+            shape.boundsMin = shape.center - extent;
+            shape.boundsMax = shape.center + extent;
+            break;
+        }
+    }
+
+    return shape;
+}
+
+}  // namespace vkr
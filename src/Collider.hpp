@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+
+namespace vkr {
+
+enum class ColliderType : uint32_t { Sphere, Capsule, Box };
+
+// Collider in world space, as consumed by the hair solver. Plain data so it can be recorded as is.
+struct ColliderShape {
+    ColliderType type;
+    glm::vec3 center;       // sphere and box center, capsule segment start
+    glm::vec3 end;          // capsule segment end
+    float radius;           // sphere and capsule
+    glm::vec3 axes[3];      // box orientation, unit length
+    glm::vec3 halfExtents;  // box
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// Analytic collision proxy component, defined in the local space of its entity.
+// Capsules extend halfHeight along the local y axis, boxes are aligned with the local axes.
+struct Collider {
+    ColliderType type{ColliderType::Sphere};
+    glm::vec3 center{0.f};
+    float radius{1.f};
+    float halfHeight{0.f};
+    glm::vec3 halfExtents{1.f};
+
+    static Collider sphere(glm::vec3 center, float radius);
+    static Collider capsule(glm::vec3 center, float radius, float halfHeight);
+    static Collider box(glm::vec3 center, glm::vec3 halfExtents);
+
+    // Radii follow the largest scale axis of the transform, so spheres and capsules stay round
+    ColliderShape toWorld(const glm::mat4 &transform) const;
+};
+
+}  // namespace vkr
@@ -7,17 +7,29 @@
 #include <stb_image.h>
 
 #include <Entity.hpp>
-#include <FrameInfo.hpp>
+#include <Profiler.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 namespace vkr {
 
-glm::mat4 TransformComponent::mat4() {
-    const float c3 = glm::cos(rotation.z);
-    const float s3 = glm::sin(rotation.z);
-    const float c2 = glm::cos(rotation.x);
-    const float s2 = glm::sin(rotation.x);
-    const float c1 = glm::cos(rotation.y);
-    const float s1 = glm::sin(rotation.y);
+// Sines and cosines of the Y(1), X(2), Z(3) rotations of a transform
+struct RotationTrig {
+    float c1, s1, c2, s2, c3, s3;
+};
+
+static RotationTrig rotationTrig(const glm::vec3 &rotation) {
+    return {glm::cos(rotation.y), glm::sin(rotation.y), glm::cos(rotation.x),
+            glm::sin(rotation.x), glm::cos(rotation.z), glm::sin(rotation.z)};
+}
+
+static glm::mat4 composeModelMatrix(const TransformComponent &transform, const RotationTrig &trig) {
+    const auto [c1, s1, c2, s2, c3, s3] = trig;
+    const glm::vec3 &scale = transform.getScale();
+    const glm::vec3 &translation = transform.getTranslation();
     return glm::mat4{
         {
             scale.x * (c1 * c3 + s1 * s2 * s3),
@@ -40,14 +52,9 @@ glm::mat4 TransformComponent::mat4() {
         {translation.x, translation.y, translation.z, 1.0f}};
 }
 
-glm::mat3 TransformComponent::normalMatrix() {
-    const float c3 = glm::cos(rotation.z);
-    const float s3 = glm::sin(rotation.z);
-    const float c2 = glm::cos(rotation.x);
-    const float s2 = glm::sin(rotation.x);
-    const float c1 = glm::cos(rotation.y);
-    const float s1 = glm::sin(rotation.y);
-    const glm::vec3 invScale = 1.0f / scale;
+static glm::mat3 composeNormalMatrix(const TransformComponent &transform, const RotationTrig &trig) {
+    const auto [c1, s1, c2, s2, c3, s3] = trig;
+    const glm::vec3 invScale = 1.0f / transform.getScale();
 
     return glm::mat3{
         {
@@ -68,26 +75,207 @@ glm::mat3 TransformComponent::normalMatrix() {
     };
 }
 
-void Entity::render(glm::mat4 camProjectionView, FrameInfo& frameInfo, VkPipelineLayout pipelineLayout) {
-    auto modelMatrix = transform.mat4();
-    EntityUBO entityUBO = {camProjectionView, modelMatrix, transform.normalMatrix(), frameInfo.camera.getPosition()};
-
-    uboBuffers[frameInfo.frameIndex]->writeToBuffer(&entityUBO);
-    uboBuffers[frameInfo.frameIndex]->flush();
-
-    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
-    SimplePushConstantData push{0.0f};
-    vkCmdPushConstants(
-        commandBuffer,
-        pipelineLayout,
-        VK_SHADER_STAGE_FRAGMENT_BIT,
-        0,
-        sizeof(SimplePushConstantData),
-        &push);
-
-    mesh->bind(commandBuffer);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-    mesh->draw(commandBuffer);
+glm::mat4 TransformComponent::mat4() const {
+    return composeModelMatrix(*this, rotationTrig(rotation));
+}
+
+glm::mat3 TransformComponent::normalMatrix() const {
+    return composeNormalMatrix(*this, rotationTrig(rotation));
+}
+
+// Inverse of composeModelMatrix, the rows of its upper 3x3 being scaled rather than its columns
+static void decomposeModelMatrix(const glm::mat4 &matrix, TransformComponent &transform) {
+    glm::vec3 scale;
+    for (int row = 0; row < 3; row++) {
+        scale[row] = glm::length(glm::vec3(matrix[0][row], matrix[1][row], matrix[2][row]));
+    }
+
+    glm::mat3 rotation{matrix};
+    for (int column = 0; column < 3; column++) {
+        rotation[column] /= scale;
+    }
+    // Third column is (-c2 * s1, s2, -c1 * c2), the second row (c2 * s3, -c2 * c3, s2). Taking c2
+    // from the row keeps X accurate near +-90 degrees, where asin loses precision.
+    const float s2 = glm::clamp(rotation[2][1], -1.f, 1.f);
+    const float c2 = std::hypot(rotation[0][1], rotation[1][1]);
+    glm::vec3 angles{std::atan2(s2, c2), 0.f, 0.f};
+    if (c2 >= 1e-6f) {
+        angles.y = std::atan2(-rotation[2][0], -rotation[2][2]);
+        angles.z = std::atan2(rotation[0][1], -rotation[1][1]);
+    } else {
+        // Gimbal lock, the first column is (c1, 0, -s1) without rotation around Z
+        angles.y = std::atan2(-rotation[0][2], rotation[0][0]);
+    }
+
+    transform.setTranslation(glm::vec3(matrix[3]));
+    transform.setScale(scale);
+    transform.setRotation(angles);
+}
+
+void TransformSystem::setParent(Registry &registry, Entity child, Entity parent) {
+    glm::mat4 matrix = worldMatrix(registry, child);
+    if (parent == NULL_ENTITY) {
+        registry.remove<ParentComponent>(child);
+    } else {
+        for (Entity ancestor = parent; ancestor != NULL_ENTITY;) {
+            if (ancestor == child) {
+                throw std::runtime_error("cannot parent an entity to one of its descendants!");
+            }
+            ParentComponent *link = registry.tryGet<ParentComponent>(ancestor);
+            ancestor = link ? link->parent : NULL_ENTITY;
+        }
+
+        matrix = glm::inverse(worldMatrix(registry, parent)) * matrix;
+        if (ParentComponent *link = registry.tryGet<ParentComponent>(child)) {
+            link->parent = parent;
+        } else {
+            registry.emplace<ParentComponent>(child, parent);
+        }
+    }
+
+    decomposeModelMatrix(matrix, registry.get<TransformComponent>(child));
+    hierarchyChanged = true;
+}
+
+glm::mat4 TransformSystem::worldMatrix(Registry &registry, Entity entity) {
+    glm::mat4 matrix{1.f};
+    while (entity != NULL_ENTITY) {
+        if (TransformComponent *transform = registry.tryGet<TransformComponent>(entity)) {
+            matrix = transform->mat4() * matrix;
+        }
+        ParentComponent *link = registry.tryGet<ParentComponent>(entity);
+        entity = link ? link->parent : NULL_ENTITY;
+    }
+    return matrix;
+}
+
+void TransformSystem::update(Registry &registry) {
+    PROFILE_FUNCTION();
+    updateCount++;
+    // Destroyed children leave the parent pool on their own
+    if (hierarchyChanged || hierarchyOrder.size() != registry.count<ParentComponent>()) {
+        sortHierarchy(registry);
+    }
+
+    updateRoots(registry);
+    for (size_t level = 0; level + 1 < levelOffsets.size(); level++) {
+        const uint32_t first = levelOffsets[level];
+        const uint32_t count = levelOffsets[level + 1] - first;
+        if (count < PARALLEL_MIN_ENTITIES) {
+            updateLevel(registry, first, count);
+            continue;
+        }
+
+        if (!threadPool) threadPool = std::make_unique<ThreadPool>();
+        const uint32_t taskCount = 4 * threadPool->threadCount();
+        const uint32_t countPerTask = (count + taskCount - 1) / taskCount;
+        threadPool->run(taskCount, [&](uint32_t task, uint32_t) {
+            const uint32_t taskFirst = std::min(task * countPerTask, count);
+            updateLevel(registry, first + taskFirst, std::min(countPerTask, count - taskFirst));
+        });
+    }
+}
+
+void TransformSystem::sortHierarchy(Registry &registry) {
+    ComponentPool<ParentComponent> &parents = registry.pool<ParentComponent>();
+    ComponentPool<WorldTransform> &worldTransforms = registry.pool<WorldTransform>();
+    const std::vector<Entity> &children = parents.entities();
+    std::vector<ParentComponent> &links = parents.data();
+
+    // Depth of each child, in the order of the parent pool: 0 right under a root. Chains are walked
+    // up to a root or a known depth, then numbered back down.
+    constexpr uint32_t UNKNOWN = UINT32_MAX;
+    std::vector<uint32_t> depths(children.size(), UNKNOWN);
+    std::vector<uint32_t> chain;
+    uint32_t levelCount = 0;
+    for (uint32_t i = 0; i < children.size(); i++) {
+        uint32_t index = i;
+        while (depths[index] == UNKNOWN) {
+            chain.push_back(index);
+            if (!parents.contains(links[index].parent)) break;
+            index = static_cast<uint32_t>(parents.tryGet(links[index].parent) - links.data());
+        }
+        uint32_t depth = depths[index] == UNKNOWN ? 0 : depths[index] + 1;
+        for (auto link = chain.rbegin(); link != chain.rend(); link++) {
+            depths[*link] = depth++;
+        }
+        chain.clear();
+        levelCount = std::max(levelCount, depths[i] + 1);
+    }
+
+    // Counting sort by depth
+    levelOffsets.assign(levelCount + 1, 0);
+    for (uint32_t depth : depths) levelOffsets[depth + 1]++;
+    for (uint32_t level = 0; level < levelCount; level++) levelOffsets[level + 1] += levelOffsets[level];
+    hierarchyOrder.resize(children.size());
+    std::vector<uint32_t> next(levelOffsets.begin(), levelOffsets.end() - 1);
+    for (size_t i = 0; i < children.size(); i++) {
+        hierarchyOrder[next[depths[i]]++] = children[i];
+    }
+
+    // Components must exist before the levels are updated, possibly in parallel
+    for (size_t i = 0; i < children.size(); i++) {
+        for (Entity entity : {children[i], links[i].parent}) {
+            if (!worldTransforms.contains(entity)) worldTransforms.emplace(entity);
+            if (entity >= updatedAt.size()) updatedAt.resize(entity + 1, 0);
+        }
+        // Possibly moved in the hierarchy
+        if (TransformComponent *transform = registry.tryGet<TransformComponent>(children[i])) {
+            transform->dirty = true;
+        }
+    }
+    hierarchyChanged = false;
+}
+
+void TransformSystem::updateRoots(Registry &registry) {
+    ComponentPool<TransformComponent> &transforms = registry.pool<TransformComponent>();
+    ComponentPool<WorldTransform> &worldTransforms = registry.pool<WorldTransform>();
+    ComponentPool<ParentComponent> &parents = registry.pool<ParentComponent>();
+    const std::vector<Entity> &entities = transforms.entities();
+    std::vector<TransformComponent> &transformData = transforms.data();
+
+    for (uint32_t i = 0; i < transformData.size(); i++) {
+        TransformComponent &transform = transformData[i];
+        const Entity entity = entities[i];
+        if (!transform.dirty || parents.contains(entity)) continue;
+
+        WorldTransform *world = worldTransforms.tryGet(entity);
+        if (!world) world = &worldTransforms.emplace(entity);
+
+        // Both matrices share the sines and cosines of the rotation
+        const RotationTrig trig = rotationTrig(transform.rotation);
+        world->model = composeModelMatrix(transform, trig);
+        world->normalMatrix = composeNormalMatrix(transform, trig);
+        transform.dirty = false;
+        if (entity >= updatedAt.size()) updatedAt.resize(entity + 1, 0);
+        updatedAt[entity] = updateCount;
+    }
+}
+
+void TransformSystem::updateLevel(Registry &registry, uint32_t first, uint32_t count) {
+    // Only reads the pools and writes the components of the level, safe to split between threads
+    ComponentPool<TransformComponent> &transforms = registry.pool<TransformComponent>();
+    ComponentPool<WorldTransform> &worldTransforms = registry.pool<WorldTransform>();
+    ComponentPool<ParentComponent> &parents = registry.pool<ParentComponent>();
+    for (uint32_t i = first; i < first + count; i++) {
+        const Entity entity = hierarchyOrder[i];
+        const Entity parent = parents.get(entity).parent;
+        TransformComponent *transform = transforms.tryGet(entity);
+        const bool dirty = transform && transform->dirty;
+        if (!dirty && updatedAt[parent] != updateCount) continue;
+
+        const WorldTransform &parentWorld = worldTransforms.get(parent);
+        WorldTransform &world = worldTransforms.get(entity);
+        if (transform) {
+            world.model = parentWorld.model * transform->mat4();
+            // Both normal matrices are negated inverse transposes, the product has to be negated back
+            world.normalMatrix = glm::mat4(-(glm::mat3(parentWorld.normalMatrix) * transform->normalMatrix()));
+            transform->dirty = false;
+        } else {
+            world = parentWorld;
+        }
+        updatedAt[entity] = updateCount;
+    }
 }
 
 }  // namespace vkr
\ No newline at end of file
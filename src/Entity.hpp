@@ -6,11 +6,14 @@
 
 #pragma once
 
-#include <Buffer.hpp>
+#include <Collider.hpp>
+#include <ForceField.hpp>
 #include <Hair.hpp>
 #include <Light.hpp>
 #include <Material.hpp>
 #include <Mesh.hpp>
+#include <Registry.hpp>
+#include <ThreadPool.hpp>
 
 // libs
 #include <glm/gtc/matrix_transform.hpp>
@@ -19,67 +22,117 @@
 #include <memory>
 
 namespace vkr {
-struct FrameInfo;
 
-struct TransformComponent {
-    glm::vec3 translation{};
-    glm::vec3 scale{1.f, 1.f, 1.f};
-    glm::vec3 rotation{};
+// Components of the scene entities, see Registry. Lights, colliders and force fields are stored by
+// value, the assets are shared between the entities using them.
+class TransformComponent {
+   public:
+    TransformComponent() = default;
+    TransformComponent(const glm::vec3 &translation, const glm::vec3 &scale = glm::vec3{1.f},
+                       const glm::vec3 &rotation = glm::vec3{0.f})
+        : translation{translation}, scale{scale}, rotation{rotation} {}
+
+    const glm::vec3 &getTranslation() const { return translation; }
+    const glm::vec3 &getScale() const { return scale; }
+    const glm::vec3 &getRotation() const { return rotation; }
+    // Mark the transform dirty, so TransformSystem recomputes the WorldTransform of the entity
+    void setTranslation(const glm::vec3 &value) {
+        translation = value;
+        dirty = true;
+    }
+    void setScale(const glm::vec3 &value) {
+        scale = value;
+        dirty = true;
+    }
+    void setRotation(const glm::vec3 &value) {
+        rotation = value;
+        dirty = true;
+    }
 
     // Matrix corresponds to Translate * Ry * Rx * Rz * Scale
     // Rotations correspond to Tait-bryan angles of Y(1), X(2), Z(3)
     // https://en.wikipedia.org/wiki/Euler_angles#Rotation_matrix
-    glm::mat4 mat4();
+    glm::mat4 mat4() const;
 
-    glm::mat3 normalMatrix();
+    glm::mat3 normalMatrix() const;
+
+   private:
+    friend class TransformSystem;
+
+    glm::vec3 translation{};
+    glm::vec3 scale{1.f, 1.f, 1.f};
+    glm::vec3 rotation{};
+    bool dirty = true;  // cleared by TransformSystem once the WorldTransform is recomputed
 };
 
-struct EntityUBO {
-    glm::mat4 projectionView;
-    glm::mat4 model;
-    glm::mat4 normalMatrix;
-    glm::vec3 camPos;
+// Matrices of the TransformComponent of an entity, cached by TransformSystem. Laid out as the
+// entity data of the shaders, see RenderSystem.
+struct WorldTransform {
+    glm::mat4 model{1.f};
+    glm::mat4 normalMatrix{1.f};
 };
 
-struct SimplePushConstantData {
-    float brightness;
+// Makes the TransformComponent of an entity relative to the world transform of its parent, see
+// TransformSystem::setParent
+struct ParentComponent {
+    Entity parent;
 };
 
-class Entity {
+// Keeps the WorldTransform of the entities up to date, adding it to new ones. Only the entities
+// whose transform is dirty are recomputed, along with their descendants, so static entities only
+// cost a test of their flag. Children are kept sorted by depth in flat arrays: each level of the
+// hierarchy only reads the world transforms of the previous one, and large levels are split
+// between threads.
+class TransformSystem {
    public:
-    using id_t = unsigned int;
-
-    static Entity createEntity() {
-        static id_t currentId = 0;
-        return Entity{currentId++};
-    }
+    // Attaches child to parent, or detaches it with NULL_ENTITY. The child keeps its place in the
+    // world, its transform becoming relative to the parent. Shears from non-uniform scales cannot
+    // be represented and are lost. Children must be detached before their parent is destroyed.
+    void setParent(Registry &registry, Entity child, Entity parent);
 
-    Entity(const Entity &) = delete;
-    Entity &operator=(const Entity &) = delete;
-    Entity(Entity &&) = default;
-    Entity &operator=(Entity &&) = default;
+    // World matrix composed from the transforms up the hierarchy, for entities that might not have
+    // been updated yet
+    static glm::mat4 worldMatrix(Registry &registry, Entity entity);
 
-    id_t getId() { return id; }
+    void update(Registry &registry);
 
-    void render(glm::mat4 camProjectionView, FrameInfo& frameInfo, VkPipelineLayout pipelineLayout);
+    // Updates done so far, and the last of them that changed the world transform of entity, 0 if none
+    uint32_t getUpdateCount() const { return updateCount; }
+    uint32_t lastMoved(Entity entity) const { return entity < updatedAt.size() ? updatedAt[entity] : 0; }
 
-    TransformComponent transform{};
-
-    // COMPONENTS (Might be a vector?)
-    std::shared_ptr<Mesh> mesh{nullptr};
-    std::shared_ptr<Hair> hair{nullptr};
-    std::shared_ptr<Material> material{nullptr};
-    std::shared_ptr<Light> light{nullptr};
+   private:
+    // Below, waking the workers costs more than updating inline
+    static constexpr uint32_t PARALLEL_MIN_ENTITIES = 4096;
+
+    void sortHierarchy(Registry &registry);
+    void updateRoots(Registry &registry);
+    void updateLevel(Registry &registry, uint32_t first, uint32_t count);
+
+    bool hierarchyChanged = false;
+    std::vector<Entity> hierarchyOrder;  // entities with a parent, by depth
+    std::vector<uint32_t> levelOffsets;  // first entity of each level in hierarchyOrder, then its size
+    std::vector<uint32_t> updatedAt;     // per entity, last update changing its world transform
+    uint32_t updateCount = 0;
+    std::unique_ptr<ThreadPool> threadPool;  // created for the first large level
+};
 
-    VkDescriptorSet descriptorSet;
+struct MeshComponent {
+    std::shared_ptr<Mesh> mesh;
+};
 
-    // Transform specific uniform buffer
-    std::vector<std::unique_ptr<Buffer>> uboBuffers;
+struct HairComponent {
+    std::shared_ptr<Hair> hair;
+};
 
-   private:
-    Entity(id_t objId) : id{objId} {}
+struct MaterialComponent {
+    std::shared_ptr<Material> material;
+};
 
-    id_t id;
+// Matches entities.glsl
+struct SimplePushConstantData {
+    uint32_t entity;  // index of the entity data of the draw, see RenderSystem
+    float brightness;
+    float opacity;  // scales the strand opacity of transparent hair
 };
 
 }  // namespace vkr
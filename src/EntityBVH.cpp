@@ -0,0 +1,390 @@
+#include <EntityBVH.hpp>
+#include <Profiler.hpp>
+
+// std
+#include <algorithm>
+#include <limits>
+
+namespace vkr {
+
+static float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 extent = boundsMax - boundsMin;
+    return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// World bounds of the mesh and hair of entity. The model space box is transformed as in Arvo's
+// Graphics Gems method: its center by the matrix, its extent by the absolute values of the axes.
+static void worldBounds(Registry &registry, Entity entity, const glm::mat4 &model, glm::vec3 &worldMin,
+                        glm::vec3 &worldMax) {
+    glm::vec3 localMin{std::numeric_limits<float>::max()};
+    glm::vec3 localMax{-std::numeric_limits<float>::max()};
+    glm::vec3 partMin, partMax;
+    if (MeshComponent *mesh = registry.tryGet<MeshComponent>(entity)) {
+        mesh->mesh->getBounds(partMin, partMax);
+        localMin = glm::min(localMin, partMin);
+        localMax = glm::max(localMax, partMax);
+    }
+    if (HairComponent *hair = registry.tryGet<HairComponent>(entity)) {
+        hair->hair->getBounds(partMin, partMax);
+        localMin = glm::min(localMin, partMin);
+        localMax = glm::max(localMax, partMax);
+    }
+
+    glm::vec3 center = (localMin + localMax) * 0.5f;
+    glm::vec3 extent = (localMax - localMin) * 0.5f;
+    glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.f));
+    glm::vec3 worldExtent = glm::abs(glm::vec3(model[0])) * extent.x + glm::abs(glm::vec3(model[1])) * extent.y +
+                            glm::abs(glm::vec3(model[2])) * extent.z;
+    worldMin = worldCenter - worldExtent;
+    worldMax = worldCenter + worldExtent;
+}
+
+// Tests the bounds against the frustum planes of planeMask, removing the planes they are entirely
+// inside of
+static bool outsideFrustum(const glm::vec4 (&planes)[6], const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+                           uint32_t &planeMask) {
+    for (uint32_t p = 0; p < 6; p++) {
+        if (!(planeMask & (1u << p))) continue;
+
+        // Corners the farthest along and against the normal
+        const glm::vec3 normal{planes[p]};
+        glm::vec3 inner{normal.x >= 0.f ? boundsMax.x : boundsMin.x, normal.y >= 0.f ? boundsMax.y : boundsMin.y,
+                        normal.z >= 0.f ? boundsMax.z : boundsMin.z};
+        glm::vec3 outer{normal.x >= 0.f ? boundsMin.x : boundsMax.x, normal.y >= 0.f ? boundsMin.y : boundsMax.y,
+                        normal.z >= 0.f ? boundsMin.z : boundsMax.z};
+        if (glm::dot(normal, inner) + planes[p].w < 0.f) return true;
+        if (glm::dot(normal, outer) + planes[p].w >= 0.f) planeMask &= ~(1u << p);
+    }
+    return false;
+}
+
+// Slab test, distance is where the ray enters the bounds, 0 from inside them
+static bool intersectBounds(const glm::vec3 &origin, const glm::vec3 &invDirection, const glm::vec3 &boundsMin,
+                            const glm::vec3 &boundsMax, float maxDistance, float &distance) {
+    glm::vec3 t0 = (boundsMin - origin) * invDirection;
+    glm::vec3 t1 = (boundsMax - origin) * invDirection;
+    glm::vec3 tMin = glm::min(t0, t1);
+    glm::vec3 tMax = glm::max(t0, t1);
+    distance = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.f));
+    return distance <= std::min(std::min(tMax.x, tMax.y), tMax.z) && distance < maxDistance;
+}
+
+// Binned surface area heuristic: centroids are sorted into bins along each axis, and the split
+// between bins with the lowest summed area times entity count of both sides wins. Returns the
+// entities moved to the left side, 0 when the centroids cannot be told apart.
+static uint32_t partitionSurfaceArea(std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end,
+                                     const std::vector<glm::vec3> &centroids, const std::vector<glm::vec3> &boundsMin,
+                                     const std::vector<glm::vec3> &boundsMax, const glm::vec3 &centroidMin,
+                                     const glm::vec3 &centroidMax, uint32_t binCount) {
+    struct Bin {
+        glm::vec3 boundsMin{std::numeric_limits<float>::max()};
+        glm::vec3 boundsMax{-std::numeric_limits<float>::max()};
+        uint32_t count = 0;
+
+        void grow(const glm::vec3 &min, const glm::vec3 &max, uint32_t entities) {
+            boundsMin = glm::min(boundsMin, min);
+            boundsMax = glm::max(boundsMax, max);
+            count += entities;
+        }
+    };
+
+    const glm::vec3 extent = centroidMax - centroidMin;
+    auto binOf = [&](int axis, uint32_t entity) {
+        float offset = (centroids[entity][axis] - centroidMin[axis]) * binCount / extent[axis];
+        return std::min(binCount - 1, static_cast<uint32_t>(offset));
+    };
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    std::vector<Bin> bins(binCount);
+    std::vector<float> rightCosts(binCount);
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0.f) continue;
+
+        std::fill(bins.begin(), bins.end(), Bin{});
+        for (auto it = begin; it != end; ++it) {
+            bins[binOf(axis, *it)].grow(boundsMin[*it], boundsMax[*it], 1);
+        }
+
+        // Right sides sweep from the last bin, left sides then from the first one
+        Bin right;
+        for (uint32_t split = binCount - 1; split > 0; split--) {
+            right.grow(bins[split].boundsMin, bins[split].boundsMax, bins[split].count);
+            rightCosts[split] = right.count > 0 ? surfaceArea(right.boundsMin, right.boundsMax) * right.count : -1.f;
+        }
+        Bin left;
+        for (uint32_t split = 1; split < binCount; split++) {
+            left.grow(bins[split - 1].boundsMin, bins[split - 1].boundsMax, bins[split - 1].count);
+            if (left.count == 0 || rightCosts[split] < 0.f) continue;
+
+            float cost = surfaceArea(left.boundsMin, left.boundsMax) * left.count + rightCosts[split];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+    if (bestAxis < 0) return 0;
+
+    auto middle = std::partition(begin, end, [&](uint32_t entity) { return binOf(bestAxis, entity) < bestSplit; });
+    return static_cast<uint32_t>(middle - begin);
+}
+
+void EntityBVH::update(Registry &registry, const TransformSystem &transformSystem) {
+    PROFILE_FUNCTION();
+    if (rebuildPending || sourceCount != registry.count<MeshComponent>() + registry.count<HairComponent>()) {
+        rebuild(registry);
+        refitUpdate = transformSystem.getUpdateCount();
+        return;
+    }
+
+    ComponentPool<WorldTransform> &worlds = registry.pool<WorldTransform>();
+    for (uint32_t i = 0; i < entities.size(); i++) {
+        if (transformSystem.lastMoved(entities[i]) > refitUpdate) {
+            refit(registry, i, worlds.get(entities[i]).model);
+        }
+    }
+    for (Entity entity : registry.pool<HairComponent>().entities()) {
+        if (entity < indices.size() && indices[entity] != ABSENT) {
+            refit(registry, indices[entity], worlds.get(entity).model);
+        }
+    }
+    refitUpdate = transformSystem.getUpdateCount();
+
+    if (nodeArea > REBUILD_GROWTH * builtNodeArea) {
+        rebuild(registry);
+    }
+}
+
+void EntityBVH::rebuild(Registry &registry) {
+    PROFILE_FUNCTION();
+    entities.clear();
+    boundsMin.clear();
+    boundsMax.clear();
+    std::fill(indices.begin(), indices.end(), ABSENT);
+
+    auto addEntity = [&](Entity entity, WorldTransform &world) {
+        if (entity < indices.size() && indices[entity] != ABSENT) return;  // with both a mesh and hair
+        if (entity >= indices.size()) indices.resize(entity + 1, ABSENT);
+        indices[entity] = static_cast<uint32_t>(entities.size());
+        entities.push_back(entity);
+        boundsMin.emplace_back();
+        boundsMax.emplace_back();
+        worldBounds(registry, entity, world.model, boundsMin.back(), boundsMax.back());
+    };
+    registry.each<MeshComponent, WorldTransform>([&](Entity entity, MeshComponent &, WorldTransform &world) {
+        addEntity(entity, world);
+    });
+    registry.each<HairComponent, WorldTransform>([&](Entity entity, HairComponent &, WorldTransform &world) {
+        addEntity(entity, world);
+    });
+    sourceCount = registry.count<MeshComponent>() + registry.count<HairComponent>();
+    rebuildPending = false;
+
+    nodes.clear();
+    parents.clear();
+    nodeArea = builtNodeArea = 0.f;
+    const uint32_t count = static_cast<uint32_t>(entities.size());
+    if (count == 0) return;
+
+    std::vector<uint32_t> order(count);
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; i++) {
+        order[i] = i;
+        centroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+    }
+
+    nodes.reserve(2 * count);
+    parents.reserve(2 * count);
+    nodes.push_back({});
+    parents.push_back(ABSENT);
+    build(0, 0, count, 0, order, centroids);
+    builtNodeArea = nodeArea;
+
+    // Entities are laid out in the order of the leaves, each leaf references a range of them
+    std::vector<Entity> builtEntities(count);
+    std::vector<glm::vec3> builtMin(count);
+    std::vector<glm::vec3> builtMax(count);
+    for (uint32_t i = 0; i < count; i++) {
+        builtEntities[i] = entities[order[i]];
+        builtMin[i] = boundsMin[order[i]];
+        builtMax[i] = boundsMax[order[i]];
+        indices[builtEntities[i]] = i;
+    }
+    entities.swap(builtEntities);
+    boundsMin.swap(builtMin);
+    boundsMax.swap(builtMax);
+
+    leaves.resize(count);
+    for (uint32_t node = 0; node < nodes.size(); node++) {
+        if (nodes[node].count == 0) continue;
+        for (uint32_t i = nodes[node].first; i < nodes[node].first + nodes[node].count; i++) {
+            leaves[i] = node;
+        }
+    }
+}
+
+void EntityBVH::build(uint32_t node, uint32_t first, uint32_t count, uint32_t depth, std::vector<uint32_t> &order,
+                      const std::vector<glm::vec3> &centroids) {
+    glm::vec3 nodeMin{std::numeric_limits<float>::max()};
+    glm::vec3 nodeMax{-std::numeric_limits<float>::max()};
+    glm::vec3 centroidMin = nodeMin;
+    glm::vec3 centroidMax = nodeMax;
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t entity = order[i];
+        nodeMin = glm::min(nodeMin, boundsMin[entity]);
+        nodeMax = glm::max(nodeMax, boundsMax[entity]);
+        centroidMin = glm::min(centroidMin, centroids[entity]);
+        centroidMax = glm::max(centroidMax, centroids[entity]);
+    }
+    nodes[node].boundsMin = nodeMin;
+    nodes[node].boundsMax = nodeMax;
+    nodeArea += surfaceArea(nodeMin, nodeMax);
+
+    if (count <= MAX_LEAF_ENTITIES) {
+        nodes[node].first = first;
+        nodes[node].count = count;
+        return;
+    }
+
+    auto begin = order.begin() + first;
+    uint32_t half = 0;
+    if (depth < MAX_SAH_DEPTH) {
+        half = partitionSurfaceArea(begin, begin + count, centroids, boundsMin, boundsMax, centroidMin, centroidMax,
+                                    BIN_COUNT);
+    }
+    if (half == 0) {
+        // Median split along the widest axis of the centroids
+        glm::vec3 extent = centroidMax - centroidMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        half = count / 2;
+        std::nth_element(begin, begin + half, begin + count,
+                         [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+
+    uint32_t children = static_cast<uint32_t>(nodes.size());
+    nodes[node].first = children;
+    nodes[node].count = 0;
+    nodes.push_back({});
+    nodes.push_back({});
+    parents.push_back(node);
+    parents.push_back(node);
+    build(children, first, half, depth + 1, order, centroids);
+    build(children + 1, first + half, count - half, depth + 1, order, centroids);
+}
+
+void EntityBVH::refit(Registry &registry, uint32_t index, const glm::mat4 &model) {
+    worldBounds(registry, entities[index], model, boundsMin[index], boundsMax[index]);
+
+    // Stops at the first node the change leaves as it was
+    for (uint32_t node = leaves[index]; node != ABSENT; node = parents[node]) {
+        Node &current = nodes[node];
+        glm::vec3 nodeMin{std::numeric_limits<float>::max()};
+        glm::vec3 nodeMax{-std::numeric_limits<float>::max()};
+        if (current.count > 0) {
+            for (uint32_t i = current.first; i < current.first + current.count; i++) {
+                nodeMin = glm::min(nodeMin, boundsMin[i]);
+                nodeMax = glm::max(nodeMax, boundsMax[i]);
+            }
+        } else {
+            nodeMin = glm::min(nodes[current.first].boundsMin, nodes[current.first + 1].boundsMin);
+            nodeMax = glm::max(nodes[current.first].boundsMax, nodes[current.first + 1].boundsMax);
+        }
+        if (nodeMin == current.boundsMin && nodeMax == current.boundsMax) return;
+
+        nodeArea += surfaceArea(nodeMin, nodeMax) - surfaceArea(current.boundsMin, current.boundsMax);
+        current.boundsMin = nodeMin;
+        current.boundsMax = nodeMax;
+    }
+}
+
+void EntityBVH::cull(const glm::mat4 &projectionView, std::vector<Entity> &visible) const {
+    PROFILE_FUNCTION();
+    if (nodes.empty()) return;
+
+    // Planes of the clip space bounds -w <= x, y <= w and 0 <= z <= w, facing inside
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++) {
+        rows[row] = {projectionView[0][row], projectionView[1][row], projectionView[2][row], projectionView[3][row]};
+    }
+    const glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                 rows[3] - rows[1], rows[2],           rows[3] - rows[2]};
+
+    // Nodes carry the planes their parent was not entirely inside of, none below a node inside the
+    // frustum
+    uint32_t stack[64];
+    uint32_t planeMasks[64];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    planeMasks[stackSize++] = (1u << 6) - 1;
+    while (stackSize > 0) {
+        stackSize--;
+        const Node &node = nodes[stack[stackSize]];
+        uint32_t planeMask = planeMasks[stackSize];
+        if (planeMask != 0 && outsideFrustum(planes, node.boundsMin, node.boundsMax, planeMask)) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                uint32_t entityMask = planeMask;
+                if (entityMask == 0 || !outsideFrustum(planes, boundsMin[i], boundsMax[i], entityMask)) {
+                    visible.push_back(entities[i]);
+                }
+            }
+            continue;
+        }
+
+        for (uint32_t child = node.first; child < node.first + 2; child++) {
+            stack[stackSize] = child;
+            planeMasks[stackSize++] = planeMask;
+        }
+    }
+}
+
+Entity EntityBVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float *distance) const {
+    Entity closest = NULL_ENTITY;
+    float closestDistance = std::numeric_limits<float>::max();
+    const glm::vec3 invDirection = 1.f / direction;
+
+    uint32_t stack[64];
+    uint32_t stackSize = 0;
+    if (!nodes.empty()) stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node &node = nodes[stack[--stackSize]];
+        float nodeDistance;
+        if (!intersectBounds(origin, invDirection, node.boundsMin, node.boundsMax, closestDistance, nodeDistance)) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                float entityDistance;
+                if (intersectBounds(origin, invDirection, boundsMin[i], boundsMax[i], closestDistance, entityDistance)) {
+                    closest = entities[i];
+                    closestDistance = entityDistance;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearest child first, so the farthest one is more likely to be skipped
+        uint32_t nearChild = node.first;
+        uint32_t farChild = node.first + 1;
+        float nearDistance, farDistance;
+        bool hitsNear = intersectBounds(origin, invDirection, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax,
+                                        closestDistance, nearDistance);
+        bool hitsFar = intersectBounds(origin, invDirection, nodes[farChild].boundsMin, nodes[farChild].boundsMax,
+                                       closestDistance, farDistance);
+        if (hitsNear && hitsFar && farDistance < nearDistance) std::swap(nearChild, farChild);
+        if (hitsNear && hitsFar) {
+            stack[stackSize++] = farChild;
+            stack[stackSize++] = nearChild;
+        } else if (hitsNear || hitsFar) {
+            stack[stackSize++] = hitsNear ? nearChild : farChild;
+        }
+    }
+
+    if (distance) *distance = closestDistance;
+    return closest;
+}
+
+}  // namespace vkr
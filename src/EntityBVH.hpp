@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Entity.hpp>
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vkr {
+
+// Bounding volume hierarchy over the world bounds of the entities with a mesh or hair, for frustum
+// culling and picking. Built with the surface area heuristic, then refit as entities move: the
+// bounds of the moved ones are recomputed and their ancestors follow. Refitting loosens the tree, so
+// it is rebuilt once its nodes have grown too much, and whenever meshes or hair are added or removed.
+class EntityBVH {
+   public:
+    // Refits the entities moved by transformSystem since the last update, and hair every time since
+    // its strands move on their own. Goes after the world transforms and the hair are updated, only
+    // entities with a WorldTransform are included.
+    void update(Registry &registry, const TransformSystem &transformSystem);
+    // Rebuilds at the next update, for changes keeping the number of meshes and hair
+    void invalidate() { rebuildPending = true; }
+
+    // Appends the entities whose bounds intersect the frustum of projectionView. Subtrees entirely
+    // inside it are appended without testing their nodes. Safe to call from several threads at once.
+    void cull(const glm::mat4 &projectionView, std::vector<Entity> &visible) const;
+    // Entity with the nearest bounds along the ray, NULL_ENTITY if it hits none. distance is in
+    // units of direction, 0 when origin is inside the bounds.
+    Entity raycast(const glm::vec3 &origin, const glm::vec3 &direction, float *distance = nullptr) const;
+
+    uint32_t entityCount() const { return static_cast<uint32_t>(entities.size()); }
+
+   private:
+    // Leaves have count > 0 and reference entities[first..first + count], inner nodes have their
+    // children at first and first + 1
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t first;
+        glm::vec3 boundsMax;
+        uint32_t count;
+    };
+
+    static constexpr uint32_t MAX_LEAF_ENTITIES = 4;
+    static constexpr uint32_t BIN_COUNT = 12;
+    // Deeper nodes are split at the median, so the traversal stacks of 64 nodes are enough
+    static constexpr uint32_t MAX_SAH_DEPTH = 32;
+    // Growth of the summed node areas, the cost of traversing them, past which refits rebuild
+    static constexpr float REBUILD_GROWTH = 2.f;
+    static constexpr uint32_t ABSENT = UINT32_MAX;
+
+    void rebuild(Registry &registry);
+    void build(uint32_t node, uint32_t first, uint32_t count, uint32_t depth, std::vector<uint32_t> &order,
+               const std::vector<glm::vec3> &centroids);
+    // Recomputes the bounds of an entity and of the nodes above it that they change
+    void refit(Registry &registry, uint32_t index, const glm::mat4 &model);
+
+    // Per entity of the hierarchy, in the order of the leaves
+    std::vector<Entity> entities;
+    std::vector<glm::vec3> boundsMin;
+    std::vector<glm::vec3> boundsMax;
+    std::vector<uint32_t> leaves;
+
+    std::vector<uint32_t> indices;  // per entity id, its index in entities or ABSENT
+    std::vector<Node> nodes;
+    std::vector<uint32_t> parents;  // per node, the root has none
+    float nodeArea = 0.f;           // summed over the nodes
+    float builtNodeArea = 0.f;
+
+    size_t sourceCount = 0;  // meshes and hair at the last rebuild
+    uint32_t refitUpdate = 0;
+    bool rebuildPending = true;
+};
+
+}  // namespace vkr
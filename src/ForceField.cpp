@@ -0,0 +1,124 @@
+#include <ForceField.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace vkr {
+
+// Parabolic sine approximation (max error ~1e-3) of a value in turns within [-0.5, 0.5]
+static inline float sinTurns(float turns) {
+    float y = 8.f * turns - 16.f * turns * std::fabs(turns);
+    return y + 0.225f * (y * std::fabs(y) - y);
+}
+
+// Sine and cosine sharing one range reduction. Only arithmetic and truncations, so loops calling it
+// vectorise. The bias keeps the truncation a floor for angles within +-1024 turns: curlNoiseBlock
+// wraps its phases to one turn, which leaves room for coordinates within 1000 noise periods.
+static inline void fastSinCos(float x, float &sine, float &cosine) {
+    float turns = x * 0.15915494f + 1024.f;
+    turns -= static_cast<float>(static_cast<int32_t>(turns + 0.5f));
+    float quarter = turns + 0.25f;
+    quarter -= static_cast<float>(static_cast<int32_t>(quarter + 0.5f));
+    sine = sinTurns(turns);
+    cosine = sinTurns(quarter);
+}
+
+// Potential psi = (sin(y+a) cos(z+b), sin(z+b) cos(x+c), sin(x+c) cos(y+a)), writes curl(psi) / frequency
+// from the sines and cosines of the three phased coordinates
+static inline void curl(float sx, float cx, float sy, float cy, float sz, float cz, float &x, float &y, float &z) {
+    x = -sx * sy - cz * cx;
+    y = -sy * sz - cx * cy;
+    z = -sz * sx - cy * cz;
+}
+
+// Sine and cosine of 2 * angle + offset from those of angle, (sinOffset, cosOffset) being constants
+static inline void doubleAngle(float sine, float cosine, float sinOffset, float cosOffset, float &sine2, float &cosine2) {
+    float s = 2.f * sine * cosine;
+    float c = 1.f - 2.f * sine * sine;
+    sine2 = s * cosOffset + c * sinOffset;
+    cosine2 = c * cosOffset - s * sinOffset;
+}
+
+// Noise over a block of deinterleaved coordinates, written back into the same arrays. The second
+// octave doubles the frequency and the speed, with an offset so both do not line up. It is derived
+// from the first one with double angle identities, so only three sine/cosine pairs are evaluated.
+static void curlNoiseBlock(float *x, float *y, float *z, size_t count, float time) {
+    // Wrapped, or they would leave the range of fastSinCos as the simulation time grows
+    constexpr double TWO_PI = 6.283185307179586;
+    const float phaseX = static_cast<float>(std::fmod(1.7 - 0.6 * time, TWO_PI));
+    const float phaseY = static_cast<float>(std::fmod(1.3 * time, TWO_PI));
+    const float phaseZ = static_cast<float>(std::fmod(2.1 - 1.1 * time, TWO_PI));
+
+    for (size_t i = 0; i < count; i++) {
+        float sx, cx, sy, cy, sz, cz;
+        fastSinCos(x[i] + phaseX, sx, cx);
+        fastSinCos(y[i] + phaseY, sy, cy);
+        fastSinCos(z[i] + phaseZ, sz, cz);
+
+        float sx2, cx2, sy2, cy2, sz2, cz2;
+        doubleAngle(sx, cx, 0.8833678f, 0.4686804f, sx2, cx2);   // offset 1.083
+        doubleAngle(sy, cy, -0.6442177f, 0.7648422f, sy2, cy2);  // offset -0.700
+        doubleAngle(sz, cz, 0.2470093f, -0.9690131f, sz2, cz2);  // offset 2.892
+
+        float nx, ny, nz, nx2, ny2, nz2;
+        curl(sx, cx, sy, cy, sz, cz, nx, ny, nz);
+        curl(sx2, cx2, sy2, cy2, sz2, cz2, nx2, ny2, nz2);
+        x[i] = nx + 0.5f * nx2;
+        y[i] = ny + 0.5f * ny2;
+        z[i] = nz + 0.5f * nz2;
+    }
+}
+
+glm::vec3 curlNoise(glm::vec3 position, float time) {
+    float x = position.x, y = position.y, z = position.z;
+    curlNoiseBlock(&x, &y, &z, 1, time);
+    return glm::vec3(x, y, z);
+}
+
+void ForceField::evaluate(const glm::vec3 *positions, const glm::vec3 *velocities, glm::vec3 *accelerations,
+                          size_t count, float time) const {
+    for (size_t i = 0; i < count; i++) {
+        accelerations[i] = drag * (wind - velocities[i]);
+    }
+
+    if (turbulence > 0.f) {
+        // Points are deinterleaved in small blocks, so the noise runs on plain float arrays
+        constexpr size_t BLOCK_SIZE = 256;
+        float x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+
+        const float noiseTime = time * turbulenceSpeed;
+        const float noiseDrag = drag * turbulence;
+        for (size_t first = 0; first < count; first += BLOCK_SIZE) {
+            const size_t blockCount = std::min(BLOCK_SIZE, count - first);
+            for (size_t i = 0; i < blockCount; i++) {
+                x[i] = positions[first + i].x * turbulenceScale;
+                y[i] = positions[first + i].y * turbulenceScale;
+                z[i] = positions[first + i].z * turbulenceScale;
+            }
+
+            curlNoiseBlock(x, y, z, blockCount, noiseTime);
+
+            for (size_t i = 0; i < blockCount; i++) {
+                accelerations[first + i] += noiseDrag * glm::vec3(x[i], y[i], z[i]);
+            }
+        }
+    }
+
+    for (const auto &attractor : attractors) {
+        if (attractor.radius <= 0.f) continue;
+
+        const float radius2 = attractor.radius * attractor.radius;
+        const float invRadius = 1.f / attractor.radius;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 offset = attractor.position - positions[i];
+            float distance2 = glm::dot(offset, offset);
+            if (distance2 >= radius2 || distance2 <= 0.f) continue;
+
+            float distance = std::sqrt(distance2);
+            accelerations[i] += offset * (attractor.strength * (1.f - distance * invRadius) / distance);
+        }
+    }
+}
+
+}  // namespace vkr
@@ -0,0 +1,37 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vkr {
+
+struct Attractor {
+    glm::vec3 position{0.f};  // world space
+    float strength{1.f};      // acceleration at the center, negative to repel
+    float radius{1.f};        // no effect beyond, linear falloff inside
+};
+
+// External forces applied to a hair entity. Air moves with the wind velocity plus a curl noise
+// turbulence, and drag pulls the particle velocities towards it. Attractors add on top.
+struct ForceField {
+    glm::vec3 wind{0.f};
+    float drag{1.f};
+    float turbulence{0.f};       // noise velocity amplitude
+    float turbulenceScale{1.f};  // noise spatial frequency
+    float turbulenceSpeed{1.f};  // noise change rate
+    std::vector<Attractor> attractors;
+
+    // Writes the acceleration of each particle into accelerations
+    void evaluate(const glm::vec3 *positions, const glm::vec3 *velocities, glm::vec3 *accelerations,
+                  size_t count, float time) const;
+};
+
+// Divergence free (up to the sine approximation) noise velocity: analytic curl of a trigonometric
+// vector potential, two octaves
+glm::vec3 curlNoise(glm::vec3 position, float time);
+
+}  // namespace vkr
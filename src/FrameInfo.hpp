@@ -3,6 +3,7 @@
 #include <vulkan/vulkan.h>
 
 #include <Camera.hpp>
+#include <GpuProfiler.hpp>
 
 namespace vkr {
 struct FrameInfo {
@@ -10,5 +11,20 @@ struct FrameInfo {
     float frameTime;
     VkCommandBuffer commandBuffer;
     Camera& camera;
+    GpuProfiler* gpuProfiler = nullptr;  // optional, passes are profiled when set
+
+    // Render pass the draws go to, needed when they are recorded into secondary command buffers
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkExtent2D extent{};
+};
+
+// Measurements of one frame of a headless run
+struct FrameStatistics {
+    double cpuTime;             // milliseconds of the whole frame loop iteration, waits on frames in flight included
+    double gpuTime;             // milliseconds between the start and end of the frame command buffer
+    double recordTime;          // milliseconds recording the draws, on every recording thread
+    uint32_t drawCount;
+    VkDeviceSize deviceMemory;  // bytes allocated by the renderer, lazily allocated memory as committed
 };
 }  // namespace vkr
\ No newline at end of file
@@ -1,27 +1,49 @@
 #include <Hair.hpp>
+#include <Profiler.hpp>
+#include <SwapChain.hpp>
 #include <Utils.hpp>
 
+// libs
+#include <cyHairFile.h>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
 namespace vkr {
 
-Hair::Hair(Device &device, const char *filename) : device{device} {
-    Builder builder;
-    builder.loadHairModel(filename, this->hair, dirs);
-    createVertexBuffers(builder.vertices);
-    createIndexBuffers(builder.indices);
+static Hair::Builder loadBuilder(const char *filename) {
+    Hair::Builder builder;
+    builder.loadHairModel(filename);
+    return builder;
+}
+
+Hair::Hair(Device &device, const char *filename) : Hair{device, loadBuilder(filename), filename} {}
+
+Hair::Hair(Device &device, Builder &&builder, const std::string &filepath, UploadBatch *uploads)
+    : device{device}, filepath{filepath} {
+    createVertexBuffers(builder.vertices, uploads);
+    createIndexBuffers(builder.indices, uploads);
+
+    simulation = builder.createSimulation();
+    vertices = std::move(builder.vertices);
+    updateBounds();
 }
 
 Hair::~Hair() {
-    delete[] dirs;
     vkDestroyBuffer(device.device(), vertexBuffer, nullptr);
-    vkFreeMemory(device.device(), vertexBufferMemory, nullptr);
+    device.freeMemory(vertexBufferMemory);
 
     if (hasIndexBuffer) {
         vkDestroyBuffer(device.device(), indexBuffer, nullptr);
-        vkFreeMemory(device.device(), indexBufferMemory, nullptr);
+        device.freeMemory(indexBufferMemory);
     }
 }
 
-void Hair::Builder::loadHairModel(const char *filename, cyHairFile &hairfile, float *&dirs) {
+void Hair::Builder::loadHairModel(const char *filename) {
+    PROFILE_FUNCTION();
+    cyHairFile hairfile;
     // Load the hair model
     int result = hairfile.LoadFromFile(filename);
     // Check for errors
@@ -58,10 +80,9 @@ void Hair::Builder::loadHairModel(const char *filename, cyHairFile &hairfile, fl
     printf("Number of hair strands = %d\n", hairCount);
     printf("Number of hair points = %d\n", vertexCount);
 
-    // Allocate space for directions
-    dirs = (float *)malloc(sizeof(float) * vertexCount * 3);
     // Compute directions
-    if (hairfile.FillDirectionArray(dirs) == 0) {
+    std::vector<float> dirs(static_cast<size_t>(vertexCount) * 3);
+    if (hairfile.FillDirectionArray(dirs.data()) == 0) {
         printf("Error: Cannot compute hair directions!\n");
     }
 
@@ -71,10 +92,13 @@ void Hair::Builder::loadHairModel(const char *filename, cyHairFile &hairfile, fl
     unsigned short defaultSegments = hairfile.GetHeader().d_segments;
     float *colorArray = hairfile.GetColorsArray();
     glm::vec3 defaultColor(hairfile.GetHeader().d_color[0], hairfile.GetHeader().d_color[1], hairfile.GetHeader().d_color[2]);
+    float *transparencyArray = hairfile.GetTransparencyArray();
+    float defaultTransparency = hairfile.GetHeader().d_transparency;
 
     int pointIdx = 0;
     int p1 = 0, p2 = 0, p3 = 0;
     for (int i = 0; i < hairCount; i++) {
+        strandOffsets.push_back(static_cast<uint32_t>(vertices.size()));
         short numSegments = segmentsArray ? segmentsArray[i] : defaultSegments;
         for (short j = 0; j < numSegments+1; j++) {  // using lines, nPoints = nSegments + 1
             indices.push_back(pointIdx / 3);
@@ -82,21 +106,39 @@ void Hair::Builder::loadHairModel(const char *filename, cyHairFile &hairfile, fl
             glm::vec3 point(pointsArray[p1], pointsArray[p2], pointsArray[p3]);
             glm::vec3 direction(dirs[p1], dirs[p2], dirs[p3]);
             glm::vec3 color = colorArray ? glm::vec3(colorArray[p1], colorArray[p2], colorArray[p3]) : defaultColor;
+            float opacity = 1.f - (transparencyArray ? transparencyArray[p1 / 3] : defaultTransparency);
 
-            vertices.push_back(Vertex{point, color, direction});
+            vertices.push_back(Vertex{point, color, direction, opacity});
         }
         // Set primitive restart
         indices.push_back(0xFFFFFFFF);
     }
+    strandOffsets.push_back(static_cast<uint32_t>(vertices.size()));
 
     printf("Number of stored hair points = %zd\n", vertices.size());
     printf("Number of indices = %zd\n", indices.size());
 }
 
-void Hair::createVertexBuffers(const std::vector<Vertex> &vertices) {
+std::unique_ptr<HairSimulation> Hair::Builder::createSimulation() const {
+    std::vector<glm::vec3> restPositions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        restPositions[i] = vertices[i].position;
+    }
+
+    return std::make_unique<HairSimulation>(restPositions, strandOffsets);
+}
+
+void Hair::createVertexBuffers(const std::vector<Vertex> &vertices, UploadBatch *uploads) {
     vertexCount = static_cast<uint32_t>(vertices.size());
     VkDeviceSize bufferSize = sizeof(Vertex) * static_cast<uint32_t>(vertexCount);
 
+    if (uploads) {
+        device.createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+        uploads->copyToBuffer(vertices.data(), bufferSize, vertexBuffer);
+        return;
+    }
+
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
     device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -117,10 +159,10 @@ void Hair::createVertexBuffers(const std::vector<Vertex> &vertices) {
     device.copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
     vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-    vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+    device.freeMemory(stagingBufferMemory);
 }
 
-void Hair::createIndexBuffers(const std::vector<uint32_t> &indices) {
+void Hair::createIndexBuffers(const std::vector<uint32_t> &indices, UploadBatch *uploads) {
     indexCount = static_cast<uint32_t>(indices.size());
     hasIndexBuffer = indexCount > 0;
 
@@ -130,6 +172,13 @@ void Hair::createIndexBuffers(const std::vector<uint32_t> &indices) {
 
     VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
 
+    if (uploads) {
+        device.createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+        uploads->copyToBuffer(indices.data(), bufferSize, indexBuffer);
+        return;
+    }
+
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
     device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -150,7 +199,7 @@ void Hair::createIndexBuffers(const std::vector<uint32_t> &indices) {
     device.copyBuffer(stagingBuffer, indexBuffer, bufferSize);
 
     vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-    vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+    device.freeMemory(stagingBufferMemory);
 }
 
 void Hair::draw(VkCommandBuffer commandBuffer) {
@@ -161,6 +210,120 @@ void Hair::draw(VkCommandBuffer commandBuffer) {
     }
 }
 
+void Hair::simulate(const SimulationInput &input) {
+    simulation->step(input);
+
+    // The pipeline applies the model matrix, so vertices are uploaded back in model space
+    setStrandPositions(simulation->getPositions(), glm::inverse(input.rootTransform));
+}
+
+void Hair::setStrandPositions(const std::vector<glm::vec3> &positions, const glm::mat4 &toModel) {
+    assert(positions.size() == vertices.size() && "Strand positions must cover every hair vertex");
+
+    // The bounds are gathered while writing the positions back, rather than scanning them again
+    glm::vec3 newMin{std::numeric_limits<float>::max()};
+    glm::vec3 newMax{-std::numeric_limits<float>::max()};
+    const std::vector<uint32_t> &strandOffsets = simulation->getStrandOffsets();
+    for (size_t s = 0; s + 1 < strandOffsets.size(); s++) {
+        uint32_t first = strandOffsets[s];
+        uint32_t last = strandOffsets[s + 1];
+
+        for (uint32_t i = first; i < last; i++) {
+            glm::vec3 position = glm::vec3(toModel * glm::vec4(positions[i], 1.f));
+            vertices[i].position = position;
+            newMin = glm::min(newMin, position);
+            newMax = glm::max(newMax, position);
+        }
+
+        if (last - first < 2) continue;
+        for (uint32_t i = first; i < last; i++) {
+            uint32_t segment = std::min(i, last - 2);
+            glm::vec3 tangent = vertices[segment + 1].position - vertices[segment].position;
+            float length = glm::length(tangent);
+            if (length > 0.f) {
+                vertices[i].direction = tangent / length;
+            }
+        }
+    }
+
+    if (vertices.empty()) {
+        newMin = newMax = glm::vec3{0.f};
+    }
+    boundsMin = newMin;
+    boundsMax = newMax;
+    hasPendingUpload = true;
+}
+
+void Hair::copyStrandPositions(std::vector<glm::vec3> &positions) const {
+    positions.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].position;
+    }
+}
+
+void Hair::getBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax) const {
+    boundsMin = this->boundsMin;
+    boundsMax = this->boundsMax;
+}
+
+void Hair::updateBounds() {
+    if (vertices.empty()) {
+        boundsMin = boundsMax = glm::vec3{0.f};
+        return;
+    }
+
+    boundsMin = glm::vec3{std::numeric_limits<float>::max()};
+    boundsMax = glm::vec3{-std::numeric_limits<float>::max()};
+    for (const Vertex &vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+}
+
+void Hair::updateVertexBuffer(VkCommandBuffer commandBuffer, int frameIndex) {
+    if (!hasPendingUpload || vertexCount == 0) {
+        return;
+    }
+
+    // Only animated hair pays for the staging buffers. One per frame in flight, so the one written
+    // here is never read by a copy still executing on the GPU.
+    if (stagingBuffers.empty()) {
+        stagingBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto &stagingBuffer : stagingBuffers) {
+            stagingBuffer = std::make_unique<Buffer>(device, sizeof(Vertex), vertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            stagingBuffer->map();
+        }
+    }
+
+    stagingBuffers[frameIndex]->writeToBuffer(vertices.data());
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = vertexBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    // Previous frames in flight may still be reading the vertices about to be overwritten
+    barrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = sizeof(Vertex) * vertexCount;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameIndex]->getBuffer(), vertexBuffer, 1, &copyRegion);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    hasPendingUpload = false;
+}
+
 void Hair::bind(VkCommandBuffer commandBuffer) {
     VkBuffer buffers[] = {vertexBuffer};
     VkDeviceSize offsets[] = {0};
@@ -188,6 +351,8 @@ std::vector<VkVertexInputAttributeDescription> Hair::Vertex::getAttributeDescrip
         {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)});
     attributeDescriptions.push_back(
         {2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, direction)});
+    attributeDescriptions.push_back(
+        {3, 0, VK_FORMAT_R32_SFLOAT, offsetof(Vertex, opacity)});
 
     return attributeDescriptions;
 }
@@ -1,10 +1,14 @@
 #pragma once
 
-#include <cyHairFile.h>
 #include <vulkan/vulkan.h>
 
+#include <Buffer.hpp>
 #include <Device.hpp>
+#include <HairSimulation.hpp>
+#include <UploadBatch.hpp>
 #include <glm/glm.hpp>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace vkr {
@@ -15,39 +19,64 @@ class Hair {
         glm::vec3 position{};
         glm::vec3 color{};
         glm::vec3 direction{};
+        float opacity{1.f};
 
         static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
         static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
 
         bool operator==(const Vertex &other) const {
-            return position == other.position && color == other.color && direction == other.direction;
+            return position == other.position && color == other.color && direction == other.direction &&
+                   opacity == other.opacity;
         }
     };
 
     struct Builder {
         std::vector<Vertex> vertices{};
         std::vector<uint32_t> indices{};
+        std::vector<uint32_t> strandOffsets{};
 
-        void loadHairModel(const char *filename, cyHairFile &hairfile, float *&dirs);
+        void loadHairModel(const char *filename);
+        std::unique_ptr<HairSimulation> createSimulation() const;
     };
 
     Hair(Device &device, const char *filename);
+    // Without uploads the buffers are filled before returning, otherwise once the batch has executed
+    Hair(Device &device, Builder &&builder, const std::string &filepath, UploadBatch *uploads = nullptr);
     ~Hair();
 
     void draw(VkCommandBuffer commandBuffer);
     void bind(VkCommandBuffer commandBuffer);
 
-   private:
-    void createVertexBuffers(const std::vector<Vertex> &vertices);
-    void createIndexBuffers(const std::vector<uint32_t> &indices);
+    void simulate(const SimulationInput &input);
+    // Replaces the strand points, e.g. with a cached frame. Positions are transformed by toModel.
+    void setStrandPositions(const std::vector<glm::vec3> &positions, const glm::mat4 &toModel = glm::mat4{1.f});
+    // Model space positions of the last simulated or set state
+    void copyStrandPositions(std::vector<glm::vec3> &positions) const;
+    // Model space bounds of the strands, following the simulated or set state
+    void getBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax) const;
+    // Records the copy of the last simulated state into the vertex buffer. Must be called outside a render pass.
+    void updateVertexBuffer(VkCommandBuffer commandBuffer, int frameIndex);
+
+    HairSimulation &getSimulation() { return *simulation; }
+    const std::string &getFilepath() const { return filepath; }
 
    private:
-    cyHairFile hair;
-    float *dirs;
+    void createVertexBuffers(const std::vector<Vertex> &vertices, UploadBatch *uploads);
+    void createIndexBuffers(const std::vector<uint32_t> &indices, UploadBatch *uploads);
+    void updateBounds();
 
+   private:
     // std::vector<std::vector<Vertex>> strandsVertices;
     // std::vector<Vertex> strandsVertices;
     Device &device;
+    std::string filepath;
+
+    std::unique_ptr<HairSimulation> simulation;
+    std::vector<Vertex> vertices;
+    glm::vec3 boundsMin{0.f};
+    glm::vec3 boundsMax{0.f};
+    bool hasPendingUpload = false;
+    std::vector<std::unique_ptr<Buffer>> stagingBuffers;
 
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
@@ -0,0 +1,615 @@
+#include <Hair.hpp>
+#include <HairShadows.hpp>
+#include <Profiler.hpp>
+#include <SwapChain.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace vkr {
+
+static constexpr VkFormat OPACITY_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// Orthographic projection of the sphere seen along direction, with the same conventions as
+// Camera::setViewDirection and Camera::setOrthographicProjection. Depth goes from 0 on the side
+// facing the light to 1 on the far side.
+static glm::mat4 lightViewProjection(const glm::vec3 &direction, const glm::vec3 &center, float radius) {
+    const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3{0.f, 0.f, 1.f} : glm::vec3{0.f, -1.f, 0.f};
+    const glm::vec3 w{direction};
+    const glm::vec3 u{glm::normalize(glm::cross(w, up))};
+    const glm::vec3 v{glm::cross(w, u)};
+    const glm::vec3 position = center - w * radius;
+
+    glm::mat4 view{1.f};
+    view[0][0] = u.x;
+    view[1][0] = u.y;
+    view[2][0] = u.z;
+    view[0][1] = v.x;
+    view[1][1] = v.y;
+    view[2][1] = v.z;
+    view[0][2] = w.x;
+    view[1][2] = w.y;
+    view[2][2] = w.z;
+    view[3][0] = -glm::dot(u, position);
+    view[3][1] = -glm::dot(v, position);
+    view[3][2] = -glm::dot(w, position);
+
+    glm::mat4 projection{1.f};
+    projection[0][0] = 1.f / radius;
+    projection[1][1] = 1.f / radius;
+    projection[2][2] = 1.f / (2.f * radius);
+    return projection * view;
+}
+
+HairShadows::HairShadows(Device &device, PipelineCache &pipelineCache, uint32_t lightCount,
+                         const VkDescriptorImageInfo &marschnerLUT, const HairShadowSettings &settings)
+    : device{device},
+      pipelineCache{pipelineCache},
+      settings{settings},
+      lightCapacity{std::max(1u, std::min(lightCount, MAX_LIGHTS))},
+      marschnerLUT{marschnerLUT} {
+    depthFormat = device.findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM}, VK_IMAGE_TILING_OPTIMAL,
+                                             VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+
+    createDescriptorSetLayouts();
+    createPipelineLayout();
+    createSamplers();
+    createUniformBuffers();
+    createDescriptorSets();
+
+    createMaps();
+    createRenderPasses();
+    createFramebuffers();
+    createPipelines();
+    writeDescriptorSets();
+}
+
+HairShadows::~HairShadows() {
+    destroyMaps();
+
+    vkDestroySampler(device.device(), depthSampler, nullptr);
+    vkDestroySampler(device.device(), opacitySampler, nullptr);
+    vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device(), shadowSetLayout, nullptr);
+    vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+}
+
+void HairShadows::setSettings(const HairShadowSettings &settings) {
+    bool mapsChanged = settings.resolution != this->settings.resolution || settings.layerCount != this->settings.layerCount;
+    this->settings = settings;
+    if (!mapsChanged) return;
+
+    vkDeviceWaitIdle(device.device());
+    destroyMaps();
+    createMaps();
+    createRenderPasses();
+    createFramebuffers();
+    createPipelines();
+    writeDescriptorSets();
+}
+
+void HairShadows::createDescriptorSetLayouts() {
+    // Binding 0: shadow lights, binding 1: depth maps, binding 2: opacity maps, binding 3: Marschner tables
+    std::array<VkDescriptorSetLayoutBinding, 4> setLayoutBindings{};
+    for (uint32_t i = 0; i < setLayoutBindings.size(); i++) {
+        setLayoutBindings[i].binding = i;
+        setLayoutBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        setLayoutBindings[i].descriptorCount = 1;
+        setLayoutBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    layoutInfo.pBindings = setLayoutBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow descriptor set layout!");
+    }
+
+    // The opacity pass only reads the depth maps
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &setLayoutBindings[1];
+    setLayoutBindings[1].binding = 0;
+    if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &shadowSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow pass descriptor set layout!");
+    }
+}
+
+void HairShadows::createPipelineLayout() {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ShadowPushConstantData);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &shadowSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow pipeline layout!");
+    }
+}
+
+void HairShadows::createSamplers() {
+    // Outside the maps there is no hair: depth is the farthest and opacity is zero
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerInfo.maxLod = 0.f;
+
+    if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &depthSampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow depth sampler!");
+    }
+
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+    if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &opacitySampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow opacity sampler!");
+    }
+}
+
+void HairShadows::createUniformBuffers() {
+    uniformBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto &uniformBuffer : uniformBuffers) {
+        uniformBuffer = std::make_unique<Buffer>(device, sizeof(ShadowsUBO), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                 device.properties.limits.minUniformBufferOffsetAlignment);
+        uniformBuffer->map();
+    }
+}
+
+void HairShadows::createDescriptorSets() {
+    const uint32_t frameCount = SwapChain::MAX_FRAMES_IN_FLIGHT;
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * frameCount + 1};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount + 1;
+
+    if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+    setLayouts.push_back(shadowSetLayout);
+    std::vector<VkDescriptorSet> sets(setLayouts.size());
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+    allocInfo.pSetLayouts = setLayouts.data();
+
+    if (vkAllocateDescriptorSets(device.device(), &allocInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate hair shadow descriptor sets!");
+    }
+    shadowSet = sets.back();
+    sets.pop_back();
+    descriptorSets = std::move(sets);
+}
+
+VkImageView HairShadows::createLayerView(VkImage image, VkFormat format, VkImageAspectFlags aspectMask,
+                                         VkImageViewType viewType, uint32_t baseLayer, uint32_t layerCount) {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = viewType;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = aspectMask;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = baseLayer;
+    viewInfo.subresourceRange.layerCount = layerCount;
+
+    VkImageView imageView;
+    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow image view!");
+    }
+    return imageView;
+}
+
+void HairShadows::createMaps() {
+    // Without shadows the maps are only kept for the descriptors, one texel is enough
+    const uint32_t resolution = settings.layerCount > 0 ? settings.resolution : 1;
+    const uint32_t opacityLayers = lightCapacity * targetCount();
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {resolution, resolution, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = lightCapacity;
+    imageInfo.format = depthFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+
+    imageInfo.arrayLayers = opacityLayers;
+    imageInfo.format = OPACITY_FORMAT;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, opacityImage, opacityImageMemory);
+
+    depthArrayView = createLayerView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0,
+                                     lightCapacity);
+    opacityArrayView = createLayerView(opacityImage, OPACITY_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                                       0, opacityLayers);
+    for (uint32_t layer = 0; layer < lightCapacity; layer++) {
+        depthLayerViews.push_back(
+            createLayerView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D, layer, 1));
+    }
+    for (uint32_t layer = 0; layer < opacityLayers; layer++) {
+        opacityLayerViews.push_back(
+            createLayerView(opacityImage, OPACITY_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D, layer, 1));
+    }
+
+    // Hair shading samples the maps even when the passes are skipped, so they start in the
+    // layouts the passes leave them in
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (auto &barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.subresourceRange.levelCount = 1;
+    }
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barriers[0].image = depthImage;
+    barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    barriers[0].subresourceRange.layerCount = lightCapacity;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].image = opacityImage;
+    barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barriers[1].subresourceRange.layerCount = opacityLayers;
+
+    VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                         nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+    device.endSingleTimeCommands(commandBuffer);
+
+    memoryUsage = device.allocationSize(depthImageMemory) + device.allocationSize(opacityImageMemory);
+}
+
+void HairShadows::createRenderPasses() {
+    // Depth of the hair nearest to the light, then sampled by the opacity pass and hair shading
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = depthFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+    VkSubpassDescription depthSubpass{};
+    depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    depthSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    // The maps are shared by the frames in flight, the previous one may still be shading with them
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &depthAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &depthSubpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &depthRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow depth render pass!");
+    }
+
+    // Opacity layers, accumulated additively
+    VkAttachmentDescription opacityAttachment{};
+    opacityAttachment.format = OPACITY_FORMAT;
+    opacityAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    opacityAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    opacityAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    opacityAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    opacityAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    opacityAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    opacityAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    std::vector<VkAttachmentDescription> opacityAttachments(targetCount(), opacityAttachment);
+
+    std::vector<VkAttachmentReference> opacityAttachmentRefs(targetCount());
+    for (uint32_t i = 0; i < targetCount(); i++) {
+        opacityAttachmentRefs[i] = {i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    }
+
+    VkSubpassDescription opacitySubpass{};
+    opacitySubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    opacitySubpass.colorAttachmentCount = static_cast<uint32_t>(opacityAttachmentRefs.size());
+    opacitySubpass.pColorAttachments = opacityAttachmentRefs.data();
+
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(opacityAttachments.size());
+    renderPassInfo.pAttachments = opacityAttachments.data();
+    renderPassInfo.pSubpasses = &opacitySubpass;
+
+    if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &opacityRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create hair shadow opacity render pass!");
+    }
+}
+
+void HairShadows::createFramebuffers() {
+    const uint32_t resolution = settings.layerCount > 0 ? settings.resolution : 1;
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.width = resolution;
+    framebufferInfo.height = resolution;
+    framebufferInfo.layers = 1;
+
+    depthFramebuffers.resize(lightCapacity);
+    opacityFramebuffers.resize(lightCapacity);
+    for (uint32_t light = 0; light < lightCapacity; light++) {
+        framebufferInfo.renderPass = depthRenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &depthLayerViews[light];
+        if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &depthFramebuffers[light]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hair shadow depth framebuffer!");
+        }
+
+        framebufferInfo.renderPass = opacityRenderPass;
+        framebufferInfo.attachmentCount = targetCount();
+        framebufferInfo.pAttachments = &opacityLayerViews[light * targetCount()];
+        if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &opacityFramebuffers[light]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hair shadow opacity framebuffer!");
+        }
+    }
+}
+
+void HairShadows::createPipelines() {
+    PipelineConfigInfo depthPipelineConfig{};
+    Pipeline::defaultPipelineConfigInfo(depthPipelineConfig, device, false);
+    depthPipelineConfig.renderPass = depthRenderPass;
+    depthPipelineConfig.pipelineLayout = pipelineLayout;
+    depthPipelineConfig.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
+    depthPipelineConfig.inputAssemblyInfo.primitiveRestartEnable = VK_TRUE;
+    depthPipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+    depthPipelineConfig.colorBlendInfo.attachmentCount = 0;
+    depthPipelineConfig.colorBlendInfo.pAttachments = nullptr;
+
+    // Every strand adds up, whatever its order
+    PipelineConfigInfo opacityPipelineConfig = depthPipelineConfig;
+    opacityPipelineConfig.renderPass = opacityRenderPass;
+    opacityPipelineConfig.depthStencilInfo.depthTestEnable = VK_FALSE;
+    opacityPipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+    VkPipelineColorBlendAttachmentState opacityBlendAttachment = depthPipelineConfig.colorBlendAttachment;
+    opacityBlendAttachment.blendEnable = VK_TRUE;
+    opacityBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    opacityBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    std::vector<VkPipelineColorBlendAttachmentState> opacityBlendAttachments(targetCount(), opacityBlendAttachment);
+    opacityPipelineConfig.colorBlendInfo.attachmentCount = static_cast<uint32_t>(opacityBlendAttachments.size());
+    opacityPipelineConfig.colorBlendInfo.pAttachments = opacityBlendAttachments.data();
+
+    ShaderPaths depthShaderPaths;
+    depthShaderPaths.vertFilepath = "../shaders/hair_shadow.vert.spv";
+    depthShaderPaths.fragFilepath = "../shaders/hair_shadow.frag.spv";
+
+    ShaderPaths opacityShaderPaths;
+    opacityShaderPaths.vertFilepath = "../shaders/hair_shadow.vert.spv";
+    opacityShaderPaths.fragFilepath = "../shaders/hair_opacity.frag.spv";
+
+    VertexInputDescriptions hairInputDescriptions;
+    hairInputDescriptions.attributeDescription = Hair::Vertex::getAttributeDescriptions();
+    hairInputDescriptions.bindingDescription = Hair::Vertex::getBindingDescriptions();
+    std::vector<VertexInputDescriptions> inputDescriptions = {hairInputDescriptions, hairInputDescriptions};
+
+    std::vector<std::shared_ptr<Pipeline>> pipelines = Pipeline::createGraphicsPipelines(
+        device, pipelineCache, {depthShaderPaths, opacityShaderPaths}, {depthPipelineConfig, opacityPipelineConfig},
+        inputDescriptions);
+    depthPipeline = pipelines[0];
+    opacityPipeline = pipelines[1];
+}
+
+void HairShadows::writeDescriptorSets() {
+    VkDescriptorImageInfo depthInfo{depthSampler, depthArrayView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo opacityInfo{opacitySampler, opacityArrayView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites;
+    std::vector<VkDescriptorBufferInfo> bufferInfos(descriptorSets.size());
+    for (size_t i = 0; i < descriptorSets.size(); i++) {
+        bufferInfos[i] = uniformBuffers[i]->descriptorInfo(sizeof(ShadowsUBO));
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSets[i];
+        descriptorWrite.descriptorCount = 1;
+
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.pBufferInfo = &bufferInfos[i];
+        descriptorWrites.push_back(descriptorWrite);
+
+        descriptorWrite.pBufferInfo = nullptr;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.dstBinding = 1;
+        descriptorWrite.pImageInfo = &depthInfo;
+        descriptorWrites.push_back(descriptorWrite);
+
+        descriptorWrite.dstBinding = 2;
+        descriptorWrite.pImageInfo = &opacityInfo;
+        descriptorWrites.push_back(descriptorWrite);
+
+        descriptorWrite.dstBinding = 3;
+        descriptorWrite.pImageInfo = &marschnerLUT;
+        descriptorWrites.push_back(descriptorWrite);
+    }
+
+    VkWriteDescriptorSet shadowWrite{};
+    shadowWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    shadowWrite.dstSet = shadowSet;
+    shadowWrite.dstBinding = 0;
+    shadowWrite.descriptorCount = 1;
+    shadowWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    shadowWrite.pImageInfo = &depthInfo;
+    descriptorWrites.push_back(shadowWrite);
+
+    vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void HairShadows::destroyMaps() {
+    depthPipeline.reset();
+    opacityPipeline.reset();
+
+    for (VkFramebuffer framebuffer : depthFramebuffers) vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
+    for (VkFramebuffer framebuffer : opacityFramebuffers) vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
+    depthFramebuffers.clear();
+    opacityFramebuffers.clear();
+    vkDestroyRenderPass(device.device(), depthRenderPass, nullptr);
+    vkDestroyRenderPass(device.device(), opacityRenderPass, nullptr);
+
+    for (VkImageView view : depthLayerViews) vkDestroyImageView(device.device(), view, nullptr);
+    for (VkImageView view : opacityLayerViews) vkDestroyImageView(device.device(), view, nullptr);
+    depthLayerViews.clear();
+    opacityLayerViews.clear();
+    vkDestroyImageView(device.device(), depthArrayView, nullptr);
+    vkDestroyImageView(device.device(), opacityArrayView, nullptr);
+
+    vkDestroyImage(device.device(), depthImage, nullptr);
+    device.freeMemory(depthImageMemory);
+    vkDestroyImage(device.device(), opacityImage, nullptr);
+    device.freeMemory(opacityImageMemory);
+}
+
+void HairShadows::beginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer,
+                                  const std::vector<VkClearValue> &clearValues) {
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = framebuffer;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = {settings.resolution, settings.resolution};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void HairShadows::render(FrameInfo &frameInfo, Registry &registry) {
+    PROFILE_FUNCTION();
+
+    // World bounds of every hair entity, which the maps are fitted to
+    const bool hasHair = registry.count<HairComponent>() > 0;
+    glm::vec3 worldMin{std::numeric_limits<float>::max()};
+    glm::vec3 worldMax{-std::numeric_limits<float>::max()};
+    registry.each<HairComponent, WorldTransform>([&](Entity, HairComponent &hair, WorldTransform &world) {
+        glm::vec3 boundsMin, boundsMax;
+        hair.hair->getBounds(boundsMin, boundsMax);
+        const glm::mat4 &modelMatrix = world.model;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point{corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y,
+                            corner & 4 ? boundsMax.z : boundsMin.z};
+            point = glm::vec3(modelMatrix * glm::vec4(point, 1.f));
+            worldMin = glm::min(worldMin, point);
+            worldMax = glm::max(worldMax, point);
+        }
+    });
+    const glm::vec3 center = hasHair ? 0.5f * (worldMin + worldMax) : glm::vec3{0.f};
+    const float radius = hasHair ? std::max(0.5f * glm::length(worldMax - worldMin), 1e-3f) : 1.f;
+
+    ShadowsUBO shadowsUBO{};
+    registry.each<Light, WorldTransform>([&](Entity, Light &light, WorldTransform &world) {
+        if (light.type != Light::Type::Directional || shadowsUBO.lightCount == lightCapacity) return;
+
+        // Directional lights shine along their forward axis
+        const glm::vec3 direction = glm::normalize(glm::vec3(world.model[2]));
+        shadowsUBO.viewProjection[shadowsUBO.lightCount++] = lightViewProjection(direction, center, radius);
+    });
+    const bool hasShadows = settings.layerCount > 0 && hasHair && shadowsUBO.lightCount > 0;
+    shadowsUBO.layerCount = hasShadows ? settings.layerCount : 0;
+    shadowsUBO.layerSpacing = settings.layerSpacing / (2.f * radius);
+    shadowsUBO.density = settings.density;
+
+    uniformBuffers[frameInfo.frameIndex]->writeToBuffer(&shadowsUBO);
+    uniformBuffers[frameInfo.frameIndex]->flush();
+    if (!hasShadows) return;
+
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    GpuZone zone{frameInfo.gpuProfiler, commandBuffer, "Hair Shadows"};
+
+    VkViewport viewport{0.f, 0.f, static_cast<float>(settings.resolution), static_cast<float>(settings.resolution), 0.f, 1.f};
+    VkRect2D scissor{{0, 0}, {settings.resolution, settings.resolution}};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    auto drawHair = [&](uint32_t light) {
+        registry.each<HairComponent, WorldTransform>([&](Entity, HairComponent &hair, WorldTransform &world) {
+            ShadowPushConstantData push{shadowsUBO.viewProjection[light] * world.model, light, settings.layerCount,
+                                        shadowsUBO.layerSpacing};
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                               sizeof(ShadowPushConstantData), &push);
+            hair.hair->bind(commandBuffer);
+            hair.hair->draw(commandBuffer);
+        });
+    };
+
+    // Every depth map first, the opacity passes sample them all
+    for (uint32_t light = 0; light < shadowsUBO.lightCount; light++) {
+        VkClearValue clearValue{};
+        clearValue.depthStencil = {1.f, 0};
+        beginRenderPass(commandBuffer, depthRenderPass, depthFramebuffers[light], {clearValue});
+        depthPipeline->bind(commandBuffer);
+        drawHair(light);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    for (uint32_t light = 0; light < shadowsUBO.lightCount; light++) {
+        beginRenderPass(commandBuffer, opacityRenderPass, opacityFramebuffers[light],
+                        std::vector<VkClearValue>(targetCount(), VkClearValue{}));
+        opacityPipeline->bind(commandBuffer);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &shadowSet, 0, nullptr);
+        drawHair(light);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+}
+
+void HairShadows::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, int frameIndex) {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &descriptorSets[frameIndex],
+                            0, nullptr);
+}
+
+}  // namespace vkr
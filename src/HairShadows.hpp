@@ -0,0 +1,142 @@
+#pragma once
+
+#include <Buffer.hpp>
+#include <Device.hpp>
+#include <Entity.hpp>
+#include <FrameInfo.hpp>
+#include <Pipeline.hpp>
+#include <PipelineCache.hpp>
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vkr {
+
+struct HairShadowSettings {
+    uint32_t resolution = 512;  // texels on each side of the maps
+    uint32_t layerCount = 8;    // opacity layers per light, 0 disables the shadows and their passes
+    float layerSpacing = 0.04f; // world units covered by each layer, from the hair nearest to the light
+    float density = 0.5f;       // extinction per unit of opacity in front of a strand
+};
+
+// Deep opacity maps (Yuksel and Keyser 2008) for the self-shadowing of hair. Each light renders the
+// hair twice before the main pass: once for the depth of the nearest strands, then accumulating
+// strand opacity into layers starting at that depth. Hair shading reads the opacity in front of
+// each fragment, interpolated between layers. The first MAX_LIGHTS directional lights cast shadows,
+// in the order of the scene light list.
+class HairShadows {
+   public:
+    static constexpr uint32_t MAX_LIGHTS = 4;
+    // Layers are packed in the channels of RGBA targets, drawn together
+    static constexpr uint32_t LAYERS_PER_TARGET = 4;
+    static constexpr uint32_t MAX_TARGETS = 4;
+    static constexpr uint32_t MAX_LAYERS = LAYERS_PER_TARGET * MAX_TARGETS;
+
+    // lightCount directional lights cast shadows, at most MAX_LIGHTS. The Marschner tables are
+    // bound along the maps, see MarschnerLUT.
+    HairShadows(Device &device, PipelineCache &pipelineCache, uint32_t lightCount,
+                const VkDescriptorImageInfo &marschnerLUT, const HairShadowSettings &settings = HairShadowSettings{});
+    ~HairShadows();
+
+    HairShadows(const HairShadows &) = delete;
+    HairShadows &operator=(const HairShadows &) = delete;
+
+    // Set 2 of the hair pipelines: shadow lights, depth and opacity maps, Marschner tables
+    VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
+
+    // Resolution and layer count changes recreate the maps, waiting for the device to be idle
+    void setSettings(const HairShadowSettings &settings);
+    const HairShadowSettings &getSettings() const { return settings; }
+
+    // Updates the shadow lights of the frame and records the shadow passes of the hair entities of
+    // registry. Must be called outside a render pass, before the hair is drawn.
+    void render(FrameInfo &frameInfo, Registry &registry);
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, int frameIndex);
+
+    // Bytes of the depth and opacity maps
+    VkDeviceSize getMemoryUsage() const { return memoryUsage; }
+
+   private:
+    // Matches hair_shading.glsl
+    struct ShadowsUBO {
+        glm::mat4 viewProjection[MAX_LIGHTS];
+        uint32_t lightCount;
+        uint32_t layerCount;   // 0 without shadows
+        float layerSpacing;    // in light depth
+        float density;
+    };
+
+    // Matches hair_shadow.vert and hair_opacity.frag
+    struct ShadowPushConstantData {
+        glm::mat4 transform;  // model to light clip space
+        uint32_t light;
+        uint32_t layerCount;
+        float layerSpacing;
+    };
+
+    // Opacity targets per light, one is kept without shadows
+    uint32_t targetCount() const {
+        return std::max(1u, (settings.layerCount + LAYERS_PER_TARGET - 1) / LAYERS_PER_TARGET);
+    }
+
+    void createDescriptorSetLayouts();
+    void createPipelineLayout();
+    void createSamplers();
+    void createUniformBuffers();
+    void createDescriptorSets();
+    void createMaps();
+    void createRenderPasses();
+    void createFramebuffers();
+    void createPipelines();
+    void writeDescriptorSets();
+    void destroyMaps();
+
+    VkImageView createLayerView(VkImage image, VkFormat format, VkImageAspectFlags aspectMask, VkImageViewType viewType,
+                                uint32_t baseLayer, uint32_t layerCount);
+    void beginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer,
+                         const std::vector<VkClearValue> &clearValues);
+
+    Device &device;
+    PipelineCache &pipelineCache;
+    HairShadowSettings settings;
+    uint32_t lightCapacity;
+    VkDescriptorImageInfo marschnerLUT;
+    VkDeviceSize memoryUsage = 0;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorSetLayout shadowSetLayout;  // depth maps, read by the opacity pass
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;  // per frame in flight
+    VkDescriptorSet shadowSet;
+    std::vector<std::unique_ptr<Buffer>> uniformBuffers;
+    VkSampler depthSampler;
+    VkSampler opacitySampler;
+
+    // Array images with one depth layer per light, and its opacity targets
+    VkFormat depthFormat;
+    VkImage depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory depthImageMemory = VK_NULL_HANDLE;
+    VkImageView depthArrayView = VK_NULL_HANDLE;
+    std::vector<VkImageView> depthLayerViews;
+    VkImage opacityImage = VK_NULL_HANDLE;
+    VkDeviceMemory opacityImageMemory = VK_NULL_HANDLE;
+    VkImageView opacityArrayView = VK_NULL_HANDLE;
+    std::vector<VkImageView> opacityLayerViews;
+
+    VkRenderPass depthRenderPass = VK_NULL_HANDLE;
+    VkRenderPass opacityRenderPass = VK_NULL_HANDLE;
+    std::vector<VkFramebuffer> depthFramebuffers;    // per light
+    std::vector<VkFramebuffer> opacityFramebuffers;  // per light
+
+    std::shared_ptr<Pipeline> depthPipeline;
+    std::shared_ptr<Pipeline> opacityPipeline;
+};
+
+}  // namespace vkr
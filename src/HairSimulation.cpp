@@ -0,0 +1,230 @@
+#include <HairSimulation.hpp>
+#include <Profiler.hpp>
+#include <Utils.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace vkr {
+
+HairSimulation::HairSimulation(const std::vector<glm::vec3> &restPositions,
+                               const std::vector<uint32_t> &strandOffsets,
+                               SimulationParameters parameters)
+    : parameters{parameters}, restPositions{restPositions}, strandOffsets{strandOffsets} {
+    if (this->strandOffsets.empty()) {
+        this->strandOffsets.push_back(0);
+    }
+    assert(this->strandOffsets.back() == restPositions.size() && "Strand offsets must cover every particle");
+
+    positions = restPositions;
+    previousPositions = restPositions;
+    restLengths.resize(restPositions.size(), 0.f);
+    velocities.resize(restPositions.size());
+    accelerations.resize(restPositions.size());
+}
+
+void HairSimulation::initialize(const glm::mat4 &rootTransform) {
+    for (size_t i = 0; i < restPositions.size(); i++) {
+        positions[i] = glm::vec3(rootTransform * glm::vec4(restPositions[i], 1.f));
+    }
+    previousPositions = positions;
+
+    // Rest lengths are measured in world space so the entity scale is taken into account
+    for (size_t s = 0; s < strandCount(); s++) {
+        for (uint32_t i = strandOffsets[s]; i + 1 < strandOffsets[s + 1]; i++) {
+            restLengths[i] = glm::length(positions[i + 1] - positions[i]);
+        }
+    }
+
+    initialized = true;
+}
+
+void HairSimulation::step(const SimulationInput &input) {
+    PROFILE_FUNCTION();
+    if (!initialized) {
+        initialize(input.rootTransform);
+    }
+
+    const float dt = std::min(input.timestep, parameters.maxTimestep);
+    if (dt <= 0.f) {
+        return;
+    }
+
+    pinRoots(input);
+    {
+        PROFILE_SCOPE("Integrate");
+        integrate(input.forces, input.time, dt);
+    }
+    {
+        PROFILE_SCOPE("Broadphase");
+        broadphase(input.colliders);
+    }
+    PROFILE_SCOPE("Solve");
+    for (uint32_t i = 0; i < parameters.constraintIterations; i++) {
+        solveConstraints();
+        solveCollisions(input.colliders);
+    }
+}
+
+void HairSimulation::pinRoots(const SimulationInput &input) {
+    const bool boundRoots = input.roots.size() == strandCount();
+    for (size_t s = 0; s < strandCount(); s++) {
+        uint32_t root = strandOffsets[s];
+        if (root == strandOffsets[s + 1]) continue;
+
+        previousPositions[root] = positions[root];
+        positions[root] = boundRoots ? input.roots[s] : glm::vec3(input.rootTransform * glm::vec4(restPositions[root], 1.f));
+    }
+}
+
+void HairSimulation::integrate(const ForceField &forces, float time, float dt) {
+    const float keptVelocity = 1.f - parameters.damping;
+    const float dt2 = dt * dt;
+
+    // Roots are evaluated too but never integrated, it keeps the loops contiguous
+    const float velocityScale = keptVelocity / dt;
+    for (size_t i = 0; i < positions.size(); i++) {
+        velocities[i] = (positions[i] - previousPositions[i]) * velocityScale;
+    }
+    forces.evaluate(positions.data(), velocities.data(), accelerations.data(), positions.size(), time);
+
+    for (size_t s = 0; s < strandCount(); s++) {
+        for (uint32_t i = strandOffsets[s] + 1; i < strandOffsets[s + 1]; i++) {
+            glm::vec3 displacement = (positions[i] - previousPositions[i]) * keptVelocity;
+            glm::vec3 acceleration = parameters.gravity + accelerations[i];
+
+            previousPositions[i] = positions[i];
+            positions[i] += displacement + acceleration * dt2;
+        }
+    }
+}
+
+void HairSimulation::solveConstraints() {
+    for (size_t s = 0; s < strandCount(); s++) {
+        uint32_t root = strandOffsets[s];
+        for (uint32_t i = root; i + 1 < strandOffsets[s + 1]; i++) {
+            glm::vec3 delta = positions[i + 1] - positions[i];
+            float length = glm::length(delta);
+            if (length <= 0.f) continue;
+
+            glm::vec3 correction = delta * ((length - restLengths[i]) / length);
+            if (i == root) {
+                // Roots are pinned, the whole correction goes to the child
+                positions[i + 1] -= correction;
+            } else {
+                positions[i] += 0.5f * correction;
+                positions[i + 1] -= 0.5f * correction;
+            }
+        }
+    }
+}
+
+void HairSimulation::broadphase(const std::vector<ColliderShape> &colliders) {
+    candidateOffsets.assign(strandCount() + 1, 0);
+    candidates.clear();
+    if (colliders.empty()) return;
+
+    for (size_t s = 0; s < strandCount(); s++) {
+        uint32_t first = strandOffsets[s];
+        uint32_t last = strandOffsets[s + 1];
+        if (first != last) {
+            glm::vec3 strandMin = positions[first];
+            glm::vec3 strandMax = positions[first];
+            for (uint32_t i = first + 1; i < last; i++) {
+                strandMin = glm::min(strandMin, positions[i]);
+                strandMax = glm::max(strandMax, positions[i]);
+            }
+
+            for (uint32_t c = 0; c < colliders.size(); c++) {
+                const ColliderShape &collider = colliders[c];
+                if (glm::all(glm::lessThanEqual(collider.boundsMin, strandMax)) &&
+                    glm::all(glm::lessThanEqual(strandMin, collider.boundsMax))) {
+                    candidates.push_back(c);
+                }
+            }
+        }
+        candidateOffsets[s + 1] = static_cast<uint32_t>(candidates.size());
+    }
+}
+
+// Narrowphase: one tight loop per shape over the particles of a strand, so the compiler can vectorise
+// it instead of branching on the collider type for every particle
+
+static void pushOutOfSphere(glm::vec3 *points, uint32_t count, glm::vec3 center, float radius) {
+    const float radius2 = radius * radius;
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 offset = points[i] - center;
+        float distance2 = glm::dot(offset, offset);
+        if (distance2 < radius2 && distance2 > 0.f) {
+            points[i] = center + offset * (radius / std::sqrt(distance2));
+        }
+    }
+}
+
+static void pushOutOfCapsule(glm::vec3 *points, uint32_t count, const ColliderShape &collider) {
+    const glm::vec3 axis = collider.end - collider.center;
+    const float axisLength2 = glm::dot(axis, axis);
+    const float invAxisLength2 = axisLength2 > 0.f ? 1.f / axisLength2 : 0.f;
+    const float radius2 = collider.radius * collider.radius;
+    for (uint32_t i = 0; i < count; i++) {
+        float t = glm::clamp(glm::dot(points[i] - collider.center, axis) * invAxisLength2, 0.f, 1.f);
+        glm::vec3 closest = collider.center + axis * t;
+        glm::vec3 offset = points[i] - closest;
+        float distance2 = glm::dot(offset, offset);
+        if (distance2 < radius2 && distance2 > 0.f) {
+            points[i] = closest + offset * (collider.radius / std::sqrt(distance2));
+        }
+    }
+}
+
+static void pushOutOfBox(glm::vec3 *points, uint32_t count, const ColliderShape &collider) {
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 offset = points[i] - collider.center;
+        glm::vec3 local{glm::dot(offset, collider.axes[0]), glm::dot(offset, collider.axes[1]),
+                        glm::dot(offset, collider.axes[2])};
+        glm::vec3 penetration = collider.halfExtents - glm::abs(local);
+        if (penetration.x <= 0.f || penetration.y <= 0.f || penetration.z <= 0.f) continue;
+
+        // Leave through the closest face
+        int axis = penetration.x < penetration.y ? (penetration.x < penetration.z ? 0 : 2)
+                                                 : (penetration.y < penetration.z ? 1 : 2);
+        points[i] += collider.axes[axis] * (local[axis] < 0.f ? -penetration[axis] : penetration[axis]);
+    }
+}
+
+void HairSimulation::solveCollisions(const std::vector<ColliderShape> &colliders) {
+    if (candidates.empty()) return;
+
+    for (size_t s = 0; s < strandCount(); s++) {
+        // Roots stay pinned
+        uint32_t first = strandOffsets[s] + 1;
+        uint32_t last = strandOffsets[s + 1];
+        if (first >= last) continue;
+
+        glm::vec3 *points = positions.data() + first;
+        uint32_t count = last - first;
+        for (uint32_t c = candidateOffsets[s]; c < candidateOffsets[s + 1]; c++) {
+            const ColliderShape &collider = colliders[candidates[c]];
+            switch (collider.type) {
+                case ColliderType::Sphere:
+                    pushOutOfSphere(points, count, collider.center, collider.radius);
+                    break;
+                case ColliderType::Capsule:
+                    pushOutOfCapsule(points, count, collider);
+                    break;
+                case ColliderType::Box:
+                    pushOutOfBox(points, count, collider);
+                    break;
+            }
+        }
+    }
+}
+
+uint64_t HairSimulation::hashState() const {
+    uint64_t hash = hashBytes(positions.data(), positions.size() * sizeof(glm::vec3));
+    return hashBytes(previousPositions.data(), previousPositions.size() * sizeof(glm::vec3), hash);
+}
+
+}  // namespace vkr
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Collider.hpp>
+#include <ForceField.hpp>
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vkr {
+
+// Everything a solver step depends on. Anything that influences the particle state has to go
+// through here so that a recorded sequence of inputs reproduces the same states bit by bit.
+struct SimulationInput {
+    glm::mat4 rootTransform{1.f};
+    ForceField forces{};
+    float time{0.f};  // animates the force field turbulence
+    float timestep{0.f};
+    std::vector<ColliderShape> colliders;
+    // World space root of each strand, e.g. bound to a scalp. When empty, roots follow rootTransform.
+    std::vector<glm::vec3> roots;
+};
+
+struct SimulationParameters {
+    glm::vec3 gravity{0.f, -9.81f, 0.f};
+    float damping{0.02f};
+    uint32_t constraintIterations{4};
+    float maxTimestep{1.f / 30.f};
+};
+
+// Verlet integration with position based length constraints. Particles are stored per strand in
+// contiguous ranges given by strandOffsets, the first particle of each strand being its root.
+class HairSimulation {
+   public:
+    HairSimulation(const std::vector<glm::vec3> &restPositions,
+                   const std::vector<uint32_t> &strandOffsets,
+                   SimulationParameters parameters = SimulationParameters{});
+
+    // Next step re-initializes the strands in their rest pose
+    void reset() { initialized = false; }
+    void step(const SimulationInput &input);
+
+    // FNV-1a over the raw particle state, any bit difference changes the hash
+    uint64_t hashState() const;
+
+    SimulationParameters &getParameters() { return parameters; }
+    const std::vector<glm::vec3> &getPositions() const { return positions; }
+    const std::vector<glm::vec3> &getRestPositions() const { return restPositions; }
+    const std::vector<uint32_t> &getStrandOffsets() const { return strandOffsets; }
+    size_t particleCount() const { return positions.size(); }
+    size_t strandCount() const { return strandOffsets.size() - 1; }
+
+   private:
+    void initialize(const glm::mat4 &rootTransform);
+    void pinRoots(const SimulationInput &input);
+    void integrate(const ForceField &forces, float time, float dt);
+    void solveConstraints();
+    // Per strand AABB against collider bounds, so each particle only tests the colliders near its strand
+    void broadphase(const std::vector<ColliderShape> &colliders);
+    void solveCollisions(const std::vector<ColliderShape> &colliders);
+
+    SimulationParameters parameters;
+
+    // Model space rest pose
+    std::vector<glm::vec3> restPositions;
+    std::vector<uint32_t> strandOffsets;
+
+    // World space state
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> previousPositions;
+    std::vector<float> restLengths;  // segment i -> i+1
+
+    // Scratch for the force field evaluation
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::vec3> accelerations;
+
+    // Colliders overlapping strand s are candidates[candidateOffsets[s]..candidateOffsets[s + 1]]
+    std::vector<uint32_t> candidateOffsets;
+    std::vector<uint32_t> candidates;
+
+    bool initialized = false;
+};
+
+}  // namespace vkr
@@ -0,0 +1,179 @@
+#include <HairTransparency.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+namespace vkr {
+
+HairTransparency::HairTransparency(Device &device, VkDeviceSize linkedListBudget)
+    : device{device}, linkedListBudget{linkedListBudget} {
+    createDescriptorSetLayout();
+    createCompositePipelineLayout();
+    createDescriptorSet();
+}
+
+HairTransparency::~HairTransparency() {
+    vkDestroyPipelineLayout(device.device(), compositePipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+}
+
+void HairTransparency::createDescriptorSetLayout() {
+    // Bindings 0 and 1: weighted blended accum and revealage, as input attachments
+    // Bindings 2 and 3: linked list heads and nodes
+    std::array<VkDescriptorSetLayoutBinding, 4> setLayoutBindings{};
+    for (uint32_t i = 0; i < setLayoutBindings.size(); i++) {
+        setLayoutBindings[i].binding = i;
+        setLayoutBindings[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        setLayoutBindings[i].descriptorCount = 1;
+        setLayoutBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    layoutInfo.pBindings = setLayoutBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transparency descriptor set layout!");
+    }
+}
+
+void HairTransparency::createCompositePipelineLayout() {
+    // Sample count of the weighted blended targets, averaged per pixel
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &compositePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create composite pipeline layout!");
+    }
+}
+
+void HairTransparency::createDescriptorSet() {
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 2};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transparency descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    if (vkAllocateDescriptorSets(device.device(), &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate transparency descriptor set!");
+    }
+}
+
+void HairTransparency::recreate(SwapChain &swapChain) {
+    mode = swapChain.getTransparencyMode();
+    sampleCount = swapChain.usesMSAA() ? static_cast<uint32_t>(device.msaaSamples()) : 1;
+    width = swapChain.width();
+    headBuffer.reset();
+    nodeBuffer.reset();
+    memoryUsage = 0;
+    nodeCapacity = 0;
+
+    // Only the bindings of the mode are written, the others are never accessed
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    std::array<VkDescriptorImageInfo, 2> imageInfos{};
+    std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+    for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = descriptorSet;
+        descriptorWrites[i].descriptorCount = 1;
+    }
+
+    if (mode == TransparencyMode::WeightedBlended) {
+        imageInfos[0] = {VK_NULL_HANDLE, swapChain.getAccumImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        imageInfos[1] = {VK_NULL_HANDLE, swapChain.getRevealageImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            descriptorWrites[i].pImageInfo = &imageInfos[i];
+        }
+        vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        memoryUsage = swapChain.getTransparencyMemory();
+    } else if (mode == TransparencyMode::LinkedList) {
+        const uint32_t pixelCount = swapChain.width() * swapChain.height();
+        // The nodes are indexed with 32 bits and bound as a single storage buffer
+        VkDeviceSize maxNodes = std::min<VkDeviceSize>(device.properties.limits.maxStorageBufferRange / sizeof(Node),
+                                                       UINT32_MAX);
+        nodeCapacity = static_cast<uint32_t>(std::clamp<VkDeviceSize>(linkedListBudget / sizeof(Node), 1, maxNodes));
+        headBuffer = std::make_unique<Buffer>(device, sizeof(uint32_t), pixelCount + 2,
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        nodeBuffer = std::make_unique<Buffer>(device, sizeof(Node), nodeCapacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        bufferInfos[0] = headBuffer->descriptorInfo();
+        bufferInfos[1] = nodeBuffer->descriptorInfo();
+        for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+            descriptorWrites[i].dstBinding = 2 + i;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        memoryUsage = headBuffer->getBufferSize() + nodeBuffer->getBufferSize();
+    }
+}
+
+void HairTransparency::clear(VkCommandBuffer commandBuffer) {
+    if (mode != TransparencyMode::LinkedList) return;
+
+    // The lists are shared by the frames in flight, the previous one may still be building or
+    // compositing them
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // Nodes are only reached through the heads, so they are left as they are
+    VkBuffer buffer = headBuffer->getBuffer();
+    vkCmdFillBuffer(commandBuffer, buffer, 0, sizeof(uint32_t), 0);
+    vkCmdFillBuffer(commandBuffer, buffer, sizeof(uint32_t), sizeof(uint32_t), width);
+    vkCmdFillBuffer(commandBuffer, buffer, HEADS_OFFSET, VK_WHOLE_SIZE, 0xFFFFFFFF);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void HairTransparency::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set) {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &descriptorSet, 0, nullptr);
+}
+
+void HairTransparency::drawComposite(VkCommandBuffer commandBuffer) {
+    bind(commandBuffer, compositePipelineLayout, 0);
+    vkCmdPushConstants(commandBuffer, compositePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &sampleCount);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+}  // namespace vkr
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Buffer.hpp>
+#include <Device.hpp>
+#include <SwapChain.hpp>
+
+// std
+#include <cstdint>
+#include <memory>
+
+namespace vkr {
+
+// Order independent transparency of the hair, following the transparency mode of the swap chain.
+// Weighted blended transparency accumulates into the swap chain targets, read back by the
+// composite. Linked lists keep every hair fragment in a node pool of fixed budget, and the
+// composite sorts the nearest ones of each pixel before blending them.
+class HairTransparency {
+   public:
+    static constexpr VkDeviceSize DEFAULT_LINKED_LIST_BUDGET = 128ull << 20;
+
+    // linkedListBudget bytes of nodes, fragments past them are dropped
+    HairTransparency(Device &device, VkDeviceSize linkedListBudget = DEFAULT_LINKED_LIST_BUDGET);
+    ~HairTransparency();
+
+    HairTransparency(const HairTransparency &) = delete;
+    HairTransparency &operator=(const HairTransparency &) = delete;
+
+    // Set 1 of the hair pipelines, set 0 of the composite
+    VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
+    VkPipelineLayout getCompositePipelineLayout() const { return compositePipelineLayout; }
+
+    // Resources depend on the extent and targets of the swap chain, call it whenever it is recreated
+    void recreate(SwapChain &swapChain);
+    // Empties the linked lists. Records transfers, so it goes before the render pass begins.
+    void clear(VkCommandBuffer commandBuffer);
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set);
+    // Fullscreen triangle blending the hair over the scene, with the composite pipeline bound
+    void drawComposite(VkCommandBuffer commandBuffer);
+
+    TransparencyMode getMode() const { return mode; }
+    // Bytes of the weighted blended targets or of the linked lists
+    VkDeviceSize getMemoryUsage() const { return memoryUsage; }
+    uint32_t getNodeCapacity() const { return nodeCapacity; }
+
+   private:
+    // Matches hair_list.frag
+    struct Node {
+        uint32_t color;  // RGBA8, alpha the opacity
+        float depth;
+        uint32_t next;
+    };
+    // The heads follow the allocated node count and the width they are indexed with
+    static constexpr VkDeviceSize HEADS_OFFSET = 2 * sizeof(uint32_t);
+
+    void createDescriptorSetLayout();
+    void createCompositePipelineLayout();
+    void createDescriptorSet();
+
+    Device &device;
+    VkDeviceSize linkedListBudget;
+
+    TransparencyMode mode = TransparencyMode::Opaque;
+    uint32_t sampleCount = 1;
+    uint32_t width = 0;
+    VkDeviceSize memoryUsage = 0;
+    uint32_t nodeCapacity = 0;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout compositePipelineLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+
+    std::unique_ptr<Buffer> headBuffer;
+    std::unique_ptr<Buffer> nodeBuffer;
+};
+
+}  // namespace vkr
@@ -16,37 +16,12 @@ ImGuiHelper::~ImGuiHelper() {
     destroy();
 }
 
-VkCommandBuffer ImGuiHelper::renderImGui() {
-    Renderer& renderer = application.getRenderer();
-
-    int frameIdx = renderer.getFrameIndex();
-    int imageIdx = renderer.getImageIndex();
-
-    renderer.beginCommandBuffer(imGuiCommandBuffers[frameIdx]);
-    renderer.beginSwapChainRenderPass(imGuiCommandBuffers[frameIdx],
-                                      imGuiRenderPass,
-                                      imGuiFramebuffers[imageIdx],
-                                      std::vector<VkClearValue>({{0.f, 0.f, 0.f, 1.f}}),
-                                      false);
+void ImGuiHelper::renderImGui(VkCommandBuffer commandBuffer, GpuProfiler* gpuProfiler) {
+    vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 
+    GpuZone zone{gpuProfiler, commandBuffer, "ImGui"};
     // Record Imgui Draw Data and draw funcs into command buffer
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), imGuiCommandBuffers[frameIdx]);
-
-    renderer.endSwapChainRenderPass(imGuiCommandBuffers[frameIdx], false);
-    renderer.endCommandBuffer(imGuiCommandBuffers[frameIdx]);
-
-    return imGuiCommandBuffers[frameIdx];
-}
-
-void ImGuiHelper::updateImGuiFramebuffers() {
-    for (auto framebuffer : imGuiFramebuffers) {
-        vkDestroyFramebuffer(application.getDevice().device(), framebuffer, nullptr);
-    }
-
-    Renderer& renderer = application.getRenderer();
-    renderer.getSwapChain()->createFramebuffers(std::vector({renderer.getSwapChain()->getImageViews()}),
-                                                imGuiFramebuffers,
-                                                imGuiRenderPass);
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
 }
 
 void ImGuiHelper::recreate() {
@@ -81,7 +56,7 @@ void ImGuiHelper::setupImGuiContext() {
     initInfo.Device = device.device();
     initInfo.QueueFamily = device.queueFamilyIndices().graphicsFamily;
     initInfo.Queue = device.graphicsQueue();
-    initInfo.PipelineCache = VK_NULL_HANDLE;
+    initInfo.PipelineCache = application.getPipelineCache().getPipelineCache();
 
     createImGuiDescriptorPool();
     initInfo.DescriptorPool = imGuiDescriptorPool;
@@ -91,15 +66,10 @@ void ImGuiHelper::setupImGuiContext() {
     initInfo.ImageCount = renderer.getSwapChainImageCount();
     initInfo.CheckVkResultFn = checkImGuiVkResult;
 
-    createImGuiRenderPass();
-    ImGui_ImplVulkan_Init(&initInfo, imGuiRenderPass);
-
-    device.createCommandPool(imGuiCommandPool, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-    renderer.createCommandBuffers(imGuiCommandBuffers, imGuiCommandPool);
-
-    renderer.getSwapChain()->createFramebuffers(std::vector({renderer.getSwapChain()->getImageViews()}),
-                                                imGuiFramebuffers,
-                                                imGuiRenderPass);
+    // The UI subpass only has the single sampled image the frame is presented from
+    initInfo.Subpass = renderer.getSwapChain()->getUISubpass();
+    initInfo.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+    ImGui_ImplVulkan_Init(&initInfo, renderer.getSwapChainRenderPass());
 
     VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
     ImGui_ImplVulkan_CreateFontsTexture(commandBuffer);
@@ -132,59 +102,9 @@ void ImGuiHelper::createImGuiDescriptorPool() {
     }
 }
 
-void ImGuiHelper::createImGuiRenderPass() {
-    VkAttachmentDescription attachment = {};
-    attachment.format = application.getRenderer().getSwapChain()->getSwapChainImageFormat();
-    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference colorAttachment = {};
-    colorAttachment.attachment = 0;
-    colorAttachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachment;
-
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkRenderPassCreateInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    info.attachmentCount = 1;
-    info.pAttachments = &attachment;
-    info.subpassCount = 1;
-    info.pSubpasses = &subpass;
-    info.dependencyCount = 1;
-    info.pDependencies = &dependency;
-    if (vkCreateRenderPass(application.getDevice().device(), &info, nullptr, &imGuiRenderPass) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create ImGui's separate render pass");
-    }
-}
-
 void ImGuiHelper::destroy() {
     Device& device = application.getDevice();
 
-    for (auto framebuffer : imGuiFramebuffers) {
-        vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
-    }
-
-    vkDestroyRenderPass(device.device(), imGuiRenderPass, nullptr);
-
-    vkFreeCommandBuffers(device.device(), imGuiCommandPool, static_cast<uint32_t>(imGuiCommandBuffers.size()), imGuiCommandBuffers.data());
-    vkDestroyCommandPool(device.device(), imGuiCommandPool, nullptr);
-
     vkDestroyDescriptorPool(device.device(), imGuiDescriptorPool, nullptr);
 
     ImGui_ImplVulkan_Shutdown();
@@ -9,25 +9,19 @@ class ImGuiHelper {
     ImGuiHelper(Application &application);
     ~ImGuiHelper();
     
-    VkCommandBuffer renderImGui();
-    void updateImGuiFramebuffers();
+    // Moves the swap chain render pass on to its UI subpass and draws the UI in it
+    void renderImGui(VkCommandBuffer commandBuffer, GpuProfiler* gpuProfiler = nullptr);
+    // The UI pipeline is only compatible with render passes of the same attachments, call it when MSAA is toggled
     void recreate();
 
    private:
     void setupImGuiContext();
     void createImGuiDescriptorPool();
-    void createImGuiRenderPass();
     void destroy();
 
     Application &application;
 
     VkDescriptorPool imGuiDescriptorPool;
-
-    VkRenderPass imGuiRenderPass;
-
-    VkCommandPool imGuiCommandPool;
-    std::vector<VkCommandBuffer> imGuiCommandBuffers;
-    std::vector<VkFramebuffer> imGuiFramebuffers;
 };
 
 }  // namespace vkr
@@ -0,0 +1,111 @@
+#include <ImageWriter.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace vkr {
+
+static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<uint8_t> &bytes, uint32_t value) {
+    bytes.push_back(static_cast<uint8_t>(value >> 24));
+    bytes.push_back(static_cast<uint8_t>(value >> 16));
+    bytes.push_back(static_cast<uint8_t>(value >> 8));
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+static void writeChunk(std::ofstream &file, const char type[4], const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendBigEndian(chunk, crc32(chunk.data() + 4, data.size() + 4));
+    file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+void writePNG(const std::string &filepath, uint32_t width, uint32_t height, const uint8_t *pixels) {
+    std::ofstream file{filepath, std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open image for writing: " + filepath);
+    }
+
+    static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), {8, 6, 0, 0, 0});  // 8 bits, RGBA, deflate, adaptive filters, no interlace
+    writeChunk(file, "IHDR", header);
+
+    // Every row starts with its filter type, none here
+    const size_t rowSize = 4 * static_cast<size_t>(width);
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; y++) {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), pixels + y * rowSize, pixels + (y + 1) * rowSize);
+    }
+
+    // zlib stream made of stored deflate blocks, followed by the Adler-32 of the scanlines
+    constexpr size_t MAX_BLOCK_SIZE = 65535;
+    std::vector<uint8_t> data{0x78, 0x01};
+    data.reserve(scanlines.size() + scanlines.size() / MAX_BLOCK_SIZE * 5 + 16);
+    uint32_t adlerA = 1, adlerB = 0;
+    size_t offset = 0;
+    do {
+        const size_t blockSize = std::min(MAX_BLOCK_SIZE, scanlines.size() - offset);
+        const bool last = offset + blockSize == scanlines.size();
+        data.push_back(last ? 1 : 0);
+        data.push_back(static_cast<uint8_t>(blockSize));
+        data.push_back(static_cast<uint8_t>(blockSize >> 8));
+        data.push_back(static_cast<uint8_t>(~blockSize));
+        data.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        data.insert(data.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+
+        // Reduced often enough that the sums never overflow
+        for (size_t i = offset; i < offset + blockSize; i++) {
+            adlerA += scanlines[i];
+            adlerB += adlerA;
+            if ((i & 4095) == 4095) {
+                adlerA %= 65521;
+                adlerB %= 65521;
+            }
+        }
+        adlerA %= 65521;
+        adlerB %= 65521;
+        offset += blockSize;
+    } while (offset < scanlines.size());
+    appendBigEndian(data, (adlerB << 16) | adlerA);
+    writeChunk(file, "IDAT", data);
+
+    writeChunk(file, "IEND", {});
+    if (!file) {
+        throw std::runtime_error("failed to write image: " + filepath);
+    }
+}
+
+}  // namespace vkr
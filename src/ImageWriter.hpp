@@ -0,0 +1,13 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+
+namespace vkr {
+
+// Writes 8 bit RGBA pixels, rows top to bottom, as an uncompressed PNG. No image library is
+// vendored, and stored deflate blocks keep the writer trivial and fast enough for frame dumps.
+void writePNG(const std::string &filepath, uint32_t width, uint32_t height, const uint8_t *pixels);
+
+}  // namespace vkr
@@ -12,7 +12,8 @@
 namespace vkr {
 
 void InputController::moveInPlaneXZ(
-    GLFWwindow* window, float dt, Entity& entity) {
+    GLFWwindow* window, float dt, TransformComponent& transform) {
+    glm::vec3 rotation = transform.getRotation();
     glm::vec3 rotate{0};
     if (glfwGetKey(window, keys.lookRight) == GLFW_PRESS) rotate.y -= 1.f;
     if (glfwGetKey(window, keys.lookLeft) == GLFW_PRESS) rotate.y += 1.f;
@@ -20,14 +21,15 @@ void InputController::moveInPlaneXZ(
     if (glfwGetKey(window, keys.lookDown) == GLFW_PRESS) rotate.x += 1.f;
 
     if (glm::dot(rotate, rotate) > std::numeric_limits<float>::epsilon()) {
-        entity.transform.rotation += lookSpeed * dt * glm::normalize(rotate);
+        rotation += lookSpeed * dt * glm::normalize(rotate);
     }
 
     // limit pitch values between about +/- 85ish degrees
-    entity.transform.rotation.x = glm::clamp(entity.transform.rotation.x, -1.5f, 1.5f);
-    entity.transform.rotation.y = glm::mod(entity.transform.rotation.y, glm::two_pi<float>());
+    rotation.x = glm::clamp(rotation.x, -1.5f, 1.5f);
+    rotation.y = glm::mod(rotation.y, glm::two_pi<float>());
+    transform.setRotation(rotation);
 
-    float yaw = entity.transform.rotation.y;
+    float yaw = rotation.y;
     const glm::vec3 forwardDir{sin(yaw), 0.f, cos(yaw)};
     const glm::vec3 rightDir{forwardDir.z, 0.f, -forwardDir.x};
     const glm::vec3 upDir{0.f, -1.f, 0.f};
@@ -41,7 +43,7 @@ void InputController::moveInPlaneXZ(
     if (glfwGetKey(window, keys.moveDown) == GLFW_PRESS) moveDir += upDir;
 
     if (glm::dot(moveDir, moveDir) > std::numeric_limits<float>::epsilon()) {
-        entity.transform.translation += moveSpeed * dt * glm::normalize(moveDir);
+        transform.setTranslation(transform.getTranslation() + moveSpeed * dt * glm::normalize(moveDir));
     }
 }
 }  // namespace vkr
\ No newline at end of file
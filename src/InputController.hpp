@@ -25,7 +25,7 @@ class InputController {
         int lookDown = GLFW_KEY_DOWN;
     };
 
-    void moveInPlaneXZ(GLFWwindow* window, float dt, Entity& entity);
+    void moveInPlaneXZ(GLFWwindow* window, float dt, TransformComponent& transform);
 
     KeyMappings keys{};
     float moveSpeed{3.f};
@@ -1,19 +1,19 @@
 #pragma once
 
-#include <Buffer.hpp>
-
 #include <glm/glm.hpp>
 
-//std
-#include <memory>
-
 namespace vkr {
 struct Light {
-    Light(float intensity, glm::vec3 color) : intensity{intensity}, color{color} {}
+    // Directional lights shine along the forward axis of their entity, point lights from its
+    // translation up to their range
+    enum class Type { Directional, Point };
+
+    Light(float intensity, glm::vec3 color, Type type = Type::Directional, float range = 0.f)
+        : intensity{intensity}, color{color}, type{type}, range{range} {}
     float intensity{1.0};
     glm::vec3 color{1.f, 1.f, 1.f};
-
-    std::unique_ptr<Buffer> uniformBuffer = nullptr;
+    Type type{Type::Directional};
+    float range{0.f};
 };
 
-}  // namespace vkr
\ No newline at end of file
+}  // namespace vkr
@@ -0,0 +1,205 @@
+#include <LightClusters.hpp>
+#include <Profiler.hpp>
+#include <SwapChain.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace vkr {
+
+static constexpr uint32_t WORKGROUP_SIZE = 64;  // local_size_x of light_clusters.comp
+
+LightClusters::LightClusters(Device &device, PipelineCache &pipelineCache) : device{device}, pipelineCache{pipelineCache} {
+    createDescriptorSetLayout();
+    createPipeline();
+    createBuffers();
+    createDescriptorSets();
+}
+
+LightClusters::~LightClusters() {
+    vkDestroyPipeline(device.device(), pipeline, nullptr);
+    vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+}
+
+void LightClusters::createDescriptorSetLayout() {
+    // Binding 0: lights, binding 1: light count of each froxel, binding 2: light indices of each froxel
+    std::array<VkDescriptorSetLayoutBinding, 3> setLayoutBindings{};
+    for (uint32_t i = 0; i < setLayoutBindings.size(); i++) {
+        setLayoutBindings[i].binding = i;
+        setLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        setLayoutBindings[i].descriptorCount = 1;
+        setLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    layoutInfo.pBindings = setLayoutBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cluster descriptor set layout!");
+    }
+}
+
+void LightClusters::createPipeline() {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+
+    if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cluster pipeline layout!");
+    }
+
+    VkPipelineShaderStageCreateInfo stageInfo{};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageInfo.module = pipelineCache.getShaderModule("../shaders/light_clusters.comp.spv");
+    stageInfo.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = stageInfo;
+    pipelineInfo.layout = pipelineLayout;
+
+    if (vkCreateComputePipelines(device.device(), pipelineCache.getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cluster pipeline!");
+    }
+}
+
+void LightClusters::createBuffers() {
+    lightBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto &lightBuffer : lightBuffers) {
+        lightBuffer = std::make_unique<Buffer>(device, sizeof(LightsHeader) + MAX_LIGHTS * sizeof(GpuLight), 1,
+                                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                               device.properties.limits.minStorageBufferOffsetAlignment);
+        lightBuffer->map();
+    }
+
+    clusterCountBuffer = std::make_unique<Buffer>(device, sizeof(uint32_t), CLUSTER_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    clusterLightBuffer = std::make_unique<Buffer>(device, sizeof(uint32_t), CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER,
+                                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void LightClusters::createDescriptorSets() {
+    const uint32_t frameCount = SwapChain::MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = frameCount;
+
+    if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cluster descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+    descriptorSets.resize(frameCount);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = setLayouts.data();
+
+    if (vkAllocateDescriptorSets(device.device(), &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate light cluster descriptor sets!");
+    }
+
+    VkDescriptorBufferInfo countInfo = clusterCountBuffer->descriptorInfo();
+    VkDescriptorBufferInfo clusterLightInfo = clusterLightBuffer->descriptorInfo();
+    for (uint32_t i = 0; i < frameCount; i++) {
+        VkDescriptorBufferInfo lightInfo = lightBuffers[i]->descriptorInfo();
+        std::array<VkDescriptorBufferInfo *, 3> bufferInfos{&lightInfo, &countInfo, &clusterLightInfo};
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = descriptorSets[i];
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[binding].pBufferInfo = bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                               nullptr);
+    }
+}
+
+void LightClusters::update(FrameInfo &frameInfo, Registry &registry) {
+    PROFILE_FUNCTION();
+
+    // Directional lights first, the assignment pass skips them
+    std::vector<GpuLight> lights;
+    uint32_t directionalCount = 0;
+    lights.reserve(std::min<size_t>(registry.count<Light>(), MAX_LIGHTS));
+    for (Light::Type type : {Light::Type::Directional, Light::Type::Point}) {
+        registry.each<Light, WorldTransform>([&](Entity, Light &light, WorldTransform &world) {
+            if (light.type != type || lights.size() == MAX_LIGHTS) return;
+
+            GpuLight gpuLight{};
+            if (type == Light::Type::Directional) {
+                gpuLight.direction = glm::vec4(-glm::normalize(glm::vec3(world.model[2])), 0.f);
+            } else {
+                gpuLight.position = glm::vec4(glm::vec3(world.model[3]), light.range);
+            }
+            gpuLight.color = glm::vec4(light.color * light.intensity, 1.f);
+            lights.push_back(gpuLight);
+        });
+        if (type == Light::Type::Directional) {
+            directionalCount = static_cast<uint32_t>(lights.size());
+        }
+    }
+    lightCount = static_cast<uint32_t>(lights.size());
+
+    const glm::mat4 &projection = frameInfo.camera.getProjection();
+    LightsHeader header{};
+    header.view = frameInfo.camera.getView();
+    header.projection = {projection[0][0], projection[1][1], frameInfo.camera.getNear(), frameInfo.camera.getFar()};
+    header.extent = {static_cast<float>(frameInfo.extent.width), static_cast<float>(frameInfo.extent.height)};
+    header.directionalCount = directionalCount;
+    header.lightCount = lightCount;
+
+    Buffer &lightBuffer = *lightBuffers[frameInfo.frameIndex];
+    lightBuffer.writeToBuffer(&header, sizeof(LightsHeader));
+    if (lightCount > 0) {
+        lightBuffer.writeToBuffer(lights.data(), lightCount * sizeof(GpuLight), sizeof(LightsHeader));
+    }
+    lightBuffer.flush();
+
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    GpuZone zone{frameInfo.gpuProfiler, commandBuffer, "Light Clusters"};
+
+    // The froxels are shared by the frames in flight: wait for the previous frame to be done shading
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &descriptorSets[frameInfo.frameIndex], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+}
+
+void LightClusters::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, int frameIndex) {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &descriptorSets[frameIndex],
+                            0, nullptr);
+}
+
+}  // namespace vkr
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Buffer.hpp>
+#include <Device.hpp>
+#include <Entity.hpp>
+#include <FrameInfo.hpp>
+#include <PipelineCache.hpp>
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vkr {
+
+// Clustered shading (Olsson et al. 2012). The scene lights are uploaded every frame into a storage
+// buffer, then a compute pass assigns the point lights to the froxels of the camera frustum: a
+// screen space grid of tiles, sliced exponentially in depth. Fragments only loop over the lights
+// of their froxel, plus the directional lights which reach everything.
+class LightClusters {
+   public:
+    static constexpr uint32_t MAX_LIGHTS = 1024;
+    static constexpr uint32_t TILES_X = 16;
+    static constexpr uint32_t TILES_Y = 9;
+    static constexpr uint32_t SLICES = 24;
+    static constexpr uint32_t CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // Lights past it are dropped from the froxel
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 64;
+
+    LightClusters(Device &device, PipelineCache &pipelineCache);
+    ~LightClusters();
+
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    // Set 3 of the mesh and hair pipelines
+    VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
+
+    // Uploads the light entities of registry and records the assignment pass. Must be called outside a
+    // render pass, frameInfo needs its extent.
+    void update(FrameInfo &frameInfo, Registry &registry);
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, int frameIndex);
+
+    // Lights uploaded by the last update, directional ones included
+    uint32_t getLightCount() const { return lightCount; }
+
+   private:
+    // Matches lights.glsl
+    struct GpuLight {
+        glm::vec4 position;   // world space, w the range of point lights
+        glm::vec4 direction;  // towards the light, for directional lights
+        glm::vec4 color;      // intensity included
+    };
+
+    struct LightsHeader {
+        glm::mat4 view;
+        glm::vec4 projection;  // x and y scales of the projection, near and far planes
+        glm::vec2 extent;
+        uint32_t directionalCount;  // directional lights come first
+        uint32_t lightCount;
+    };
+
+    void createDescriptorSetLayout();
+    void createPipeline();
+    void createBuffers();
+    void createDescriptorSets();
+
+    Device &device;
+    PipelineCache &pipelineCache;
+    uint32_t lightCount = 0;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;  // per frame in flight
+
+    std::vector<std::unique_ptr<Buffer>> lightBuffers;  // per frame in flight, written by the host
+    // Shared by the frames in flight, the assignment waits for the previous frame to read them
+    std::unique_ptr<Buffer> clusterCountBuffer;
+    std::unique_ptr<Buffer> clusterLightBuffer;
+};
+
+}  // namespace vkr
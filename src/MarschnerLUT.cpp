@@ -0,0 +1,259 @@
+#include <MarschnerLUT.hpp>
+#include <Profiler.hpp>
+#include <ThreadPool.hpp>
+#include <Utils.hpp>
+
+// libs
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// std
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace vkr {
+
+static constexpr VkFormat LUT_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+// Offsets across the fiber integrated by each azimuthal lobe
+static constexpr uint32_t AZIMUTHAL_SAMPLES = 256;
+
+static float gaussian(float width, float x) {
+    return std::exp(-x * x / (2.f * width * width)) / (width * std::sqrt(2.f * static_cast<float>(PI)));
+}
+
+// Unpolarized Fresnel reflectance of a dielectric of relative index eta
+static float fresnel(float eta, float cosTheta) {
+    float sin2Transmitted = (1.f - cosTheta * cosTheta) / (eta * eta);
+    if (sin2Transmitted >= 1.f) return 1.f;
+    float cosTransmitted = std::sqrt(1.f - sin2Transmitted);
+    float perpendicular = (cosTheta - eta * cosTransmitted) / (cosTheta + eta * cosTransmitted);
+    float parallel = (eta * cosTheta - cosTransmitted) / (eta * cosTheta + cosTransmitted);
+    return 0.5f * (perpendicular * perpendicular + parallel * parallel);
+}
+
+MarschnerLUT::MarschnerLUT(Device &device, const MarschnerParameters &parameters, const std::string &cachePath)
+    : device{device}, parameters{parameters}, cachePath{cachePath} {
+    std::vector<uint16_t> texels;
+    if (!loadTables(texels)) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        texels = computeTables();
+        double computeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        printf("Marschner tables computed in %.1f ms\n", computeTime);
+
+        try {
+            saveTables(texels);
+        } catch (const std::exception &e) {
+            printf("Warning: %s\n", e.what());
+        }
+    }
+
+    createImage(texels);
+    createSampler();
+}
+
+MarschnerLUT::~MarschnerLUT() {
+    vkDestroySampler(device.device(), sampler, nullptr);
+    vkDestroyImageView(device.device(), imageView, nullptr);
+    vkDestroyImage(device.device(), image, nullptr);
+    device.freeMemory(imageMemory);
+}
+
+std::vector<uint16_t> MarschnerLUT::computeTables() const {
+    PROFILE_FUNCTION();
+    std::vector<uint16_t> texels(2 * LAYER_TEXELS);
+    auto store = [&](uint32_t layer, uint32_t x, uint32_t y, const glm::vec4 &value) {
+        uint16_t *texel = &texels[layer * LAYER_TEXELS + 4 * (y * SIZE + x)];
+        for (int c = 0; c < 4; c++) texel[c] = glm::packHalf1x16(value[c]);
+    };
+
+    const float shift = parameters.shift;
+    const float width = parameters.width;
+
+    // One row of either table per task
+    ThreadPool threadPool;
+    threadPool.run(2 * SIZE, [&](uint32_t task, uint32_t) {
+        const uint32_t y = task % SIZE;
+
+        if (task < SIZE) {
+            // Longitudinal lobes, from the half angle (the TT and TRT lobes shift against R)
+            const float thetaO = std::asin((y + 0.5f) / SIZE * 2.f - 1.f);
+            for (uint32_t x = 0; x < SIZE; x++) {
+                const float thetaI = std::asin((x + 0.5f) / SIZE * 2.f - 1.f);
+                const float thetaH = 0.5f * (thetaI + thetaO);
+                const float thetaD = 0.5f * (thetaO - thetaI);
+                store(0, x, y,
+                      {gaussian(width, thetaH - shift), gaussian(0.5f * width, thetaH + 0.5f * shift),
+                       gaussian(2.f * width, thetaH + 1.5f * shift), std::cos(thetaD)});
+            }
+            return;
+        }
+
+        // Azimuthal lobes, integrating the paths through the fiber cross section for every offset
+        // h. Refraction in the normal plane follows the index of Bravais for theta_d.
+        const float cosThetaD = (y + 0.5f) / SIZE;
+        const float sin2ThetaD = 1.f - cosThetaD * cosThetaD;
+        const float eta = std::sqrt(parameters.eta * parameters.eta - sin2ThetaD) / cosThetaD;
+
+        float exitAngles[3][AZIMUTHAL_SAMPLES];
+        float attenuations[3][AZIMUTHAL_SAMPLES];
+        for (uint32_t sample = 0; sample < AZIMUTHAL_SAMPLES; sample++) {
+            const float h = (sample + 0.5f) / AZIMUTHAL_SAMPLES * 2.f - 1.f;
+            const float gammaI = std::asin(h);
+            const float gammaT = std::asin(h / eta);
+            const float entering = 1.f - fresnel(eta, std::cos(gammaI));
+            const float internal = fresnel(1.f / eta, std::cos(gammaT));
+            for (int p = 0; p < 3; p++) {
+                exitAngles[p][sample] = 2.f * p * gammaT - 2.f * gammaI + p * static_cast<float>(PI);
+            }
+            attenuations[0][sample] = fresnel(eta, std::cos(gammaI));
+            attenuations[1][sample] = entering * entering;
+            attenuations[2][sample] = entering * entering * internal;
+        }
+
+        for (uint32_t x = 0; x < SIZE; x++) {
+            const float phi = std::acos((x + 0.5f) / SIZE * 2.f - 1.f);
+            glm::vec4 lobes{0.f, 0.f, 0.f, 1.f};
+            for (int p = 0; p < 3; p++) {
+                for (uint32_t sample = 0; sample < AZIMUTHAL_SAMPLES; sample++) {
+                    float offset = std::remainder(phi - exitAngles[p][sample], 2.f * static_cast<float>(PI));
+                    lobes[p] += attenuations[p][sample] * gaussian(parameters.azimuthalWidth, offset);
+                }
+                // Half the integral over h in [-1, 1]
+                lobes[p] /= AZIMUTHAL_SAMPLES;
+            }
+            store(1, x, y, lobes);
+        }
+    });
+    return texels;
+}
+
+MarschnerLUT::FileHeader MarschnerLUT::fileHeader() const {
+    FileHeader header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.size = SIZE;
+    header.parametersHash = hashBytes(&parameters, sizeof(parameters));
+    return header;
+}
+
+bool MarschnerLUT::loadTables(std::vector<uint16_t> &texels) const {
+    std::ifstream file{cachePath, std::ios::binary};
+    if (!file.is_open()) {
+        return false;
+    }
+
+    FileHeader header{};
+    FileHeader expected = fileHeader();
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != expected.magic ||
+        header.version != expected.version || header.size != expected.size ||
+        header.parametersHash != expected.parametersHash) {
+        printf("Marschner tables \"%s\" are out of date, computing them again\n", cachePath.c_str());
+        return false;
+    }
+
+    texels.resize(2 * LAYER_TEXELS);
+    const size_t dataSize = texels.size() * sizeof(uint16_t);
+    if (!file.read(reinterpret_cast<char *>(texels.data()), dataSize) || hashBytes(texels.data(), dataSize) != header.dataHash) {
+        printf("Marschner tables \"%s\" are corrupted, computing them again\n", cachePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void MarschnerLUT::saveTables(const std::vector<uint16_t> &texels) const {
+    const size_t dataSize = texels.size() * sizeof(uint16_t);
+    FileHeader header = fileHeader();
+    header.dataHash = hashBytes(texels.data(), dataSize);
+
+    writeFileAtomically(cachePath, {{&header, sizeof(header)}, {texels.data(), dataSize}});
+}
+
+void MarschnerLUT::createImage(const std::vector<uint16_t> &texels) {
+    const VkDeviceSize dataSize = texels.size() * sizeof(uint16_t);
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    device.createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                        stagingBufferMemory);
+
+    void *data;
+    vkMapMemory(device.device(), stagingBufferMemory, 0, dataSize, 0, &data);
+    memcpy(data, texels.data(), static_cast<size_t>(dataSize));
+    vkUnmapMemory(device.device(), stagingBufferMemory);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {SIZE, SIZE, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 2;
+    imageInfo.format = LUT_FORMAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 2};
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 2};
+    region.imageExtent = {SIZE, SIZE, 1};
+
+    VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+    device.endSingleTimeCommands(commandBuffer);
+
+    vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
+    device.freeMemory(stagingBufferMemory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewInfo.format = LUT_FORMAT;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 2};
+    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create Marschner table view!");
+    }
+}
+
+void MarschnerLUT::createSampler() {
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.f;
+
+    if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create Marschner table sampler!");
+    }
+}
+
+}  // namespace vkr
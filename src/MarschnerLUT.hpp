@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Device.hpp>
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vkr {
+
+// Fiber parameters of the Marschner model, angles in radians
+struct MarschnerParameters {
+    float eta = 1.55f;             // index of refraction of the fiber
+    float shift = -0.13f;          // longitudinal shift of the R lobe (alpha_R), about -7.5 degrees
+    float width = 0.13f;           // longitudinal width of the R lobe (beta_R), about 7.5 degrees
+    float azimuthalWidth = 0.17f;  // smoothing of the azimuthal lobes, about 10 degrees
+};
+
+// Lookup tables of the Marschner hair model (Marschner et al. 2003), following the two textures of
+// GPU Gems 2 chapter 23. Layer 0 holds the longitudinal terms M_R, M_TT, M_TRT and cos(theta_d),
+// indexed by (sin theta_i, sin theta_o). Layer 1 holds the azimuthal terms N_R, N_TT, N_TRT,
+// indexed by (cos phi, cos theta_d). Absorption is left out of the tables, hair shading tints the
+// transmitted lobes with the strand color instead.
+//
+// The tables are computed on every hardware thread at startup and cached to disk, keyed on the
+// parameters they were computed with.
+class MarschnerLUT {
+   public:
+    static constexpr uint32_t SIZE = 128;
+    static constexpr const char *DEFAULT_CACHE_PATH = "marschner_lut.bin";
+
+    MarschnerLUT(Device &device, const MarschnerParameters &parameters = MarschnerParameters{},
+                 const std::string &cachePath = DEFAULT_CACHE_PATH);
+    ~MarschnerLUT();
+
+    MarschnerLUT(const MarschnerLUT &) = delete;
+    MarschnerLUT &operator=(const MarschnerLUT &) = delete;
+
+    // Bound by HairShadows, along the shadow maps of the hair pipelines
+    VkDescriptorImageInfo getDescriptorInfo() const {
+        return VkDescriptorImageInfo{sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    }
+
+   private:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        uint32_t padding;
+        uint64_t parametersHash;
+        uint64_t dataHash;
+    };
+
+    static constexpr uint32_t MAGIC = 0x4c4d4b56;  // "VKML"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t LAYER_TEXELS = SIZE * SIZE * 4;
+
+    // Half floats of both layers, RGBA
+    std::vector<uint16_t> computeTables() const;
+    bool loadTables(std::vector<uint16_t> &texels) const;
+    void saveTables(const std::vector<uint16_t> &texels) const;
+    FileHeader fileHeader() const;
+
+    void createImage(const std::vector<uint16_t> &texels);
+    void createSampler();
+
+    Device &device;
+    MarschnerParameters parameters;
+    std::string cachePath;
+
+    VkImage image;
+    VkDeviceMemory imageMemory;
+    VkImageView imageView;
+    VkSampler sampler;
+};
+
+}  // namespace vkr
@@ -14,6 +14,8 @@ class Material {
     ~Material();
 
     std::shared_ptr<Texture> getAlbedo() { return (_albedo); }
+    // Picked up by the next frame drawn, see RenderSystem
+    void setAlbedo(std::shared_ptr<Texture> albedo) { _albedo = std::move(albedo); }
     bool hasAlbedo() { return _albedo != nullptr; }
 
    private:
@@ -5,6 +5,7 @@
 */
 
 #include <Mesh.hpp>
+#include <Profiler.hpp>
 #include <Utils.hpp>
 
 // libs
@@ -32,13 +33,35 @@ struct hash<vkr::Mesh::Vertex> {
 
 namespace vkr {
 
-Mesh::Mesh(Device& device, const Mesh::Builder& builder) : device{device} {
-    createVertexBuffers(builder.vertices);
-    createIndexBuffers(builder.indices);
+Mesh::Mesh(Device& device, const Mesh::Builder& builder, UploadBatch* uploads) : device{device} {
+    createVertexBuffers(builder.vertices, uploads);
+    createIndexBuffers(builder.indices, uploads);
+
+    positions.reserve(builder.vertices.size());
+    if (!builder.vertices.empty()) {
+        boundsMin = boundsMax = builder.vertices[0].position;
+    }
+    for (const auto& vertex : builder.vertices) {
+        positions.push_back(vertex.position);
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    indices = builder.indices;
+    if (indices.empty()) {
+        indices.resize(positions.size());
+        for (uint32_t i = 0; i < indices.size(); i++) {
+            indices[i] = i;
+        }
+    }
 }
 
 Mesh::~Mesh() {}
 
+void Mesh::getBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const {
+    boundsMin = this->boundsMin;
+    boundsMax = this->boundsMax;
+}
+
 std::unique_ptr<Mesh> Mesh::createModelFromFile(Device& device,
                                                 const std::string& filepath) {
     Builder builder{};
@@ -46,12 +69,20 @@ std::unique_ptr<Mesh> Mesh::createModelFromFile(Device& device,
     return std::make_unique<Mesh>(device, builder);
 }
 
-void Mesh::createVertexBuffers(const std::vector<Vertex>& vertices) {
+void Mesh::createVertexBuffers(const std::vector<Vertex>& vertices, UploadBatch* uploads) {
     vertexCount = static_cast<uint32_t>(vertices.size());
     assert(vertexCount >= 3 && "Vertex count must be at least 3");
     uint32_t vertexSize = sizeof(vertices[0]);
     VkDeviceSize bufferSize = vertexSize * vertexCount;
 
+    if (uploads) {
+        vertexBuffer = std::make_unique<Buffer>(device, vertexSize, vertexCount,
+                                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        uploads->copyToBuffer(vertices.data(), bufferSize, vertexBuffer->getBuffer());
+        return;
+    }
+
     Buffer stagingBuffer{device, vertexSize, vertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
 
@@ -65,7 +96,7 @@ void Mesh::createVertexBuffers(const std::vector<Vertex>& vertices) {
     device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
 }
 
-void Mesh::createIndexBuffers(const std::vector<uint32_t>& indices) {
+void Mesh::createIndexBuffers(const std::vector<uint32_t>& indices, UploadBatch* uploads) {
     indexCount = static_cast<uint32_t>(indices.size());
     hasIndexBuffer = indexCount > 0;
 
@@ -76,6 +107,14 @@ void Mesh::createIndexBuffers(const std::vector<uint32_t>& indices) {
     uint32_t indexSize = sizeof(indices[0]);
     VkDeviceSize bufferSize = indexSize * indexCount;
 
+    if (uploads) {
+        indexBuffer = std::make_unique<Buffer>(device, indexSize, indexCount,
+                                               VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        uploads->copyToBuffer(indices.data(), bufferSize, indexBuffer->getBuffer());
+        return;
+    }
+
     Buffer stagingBuffer{device, indexSize, indexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
 
@@ -134,6 +173,7 @@ Mesh::Vertex::getAttributeDescriptions() {
 }
 
 void Mesh::Builder::loadModel(const std::string& filepath) {
+    PROFILE_FUNCTION();
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -8,6 +8,7 @@
 
 #include <Device.hpp>
 #include <Buffer.hpp>
+#include <UploadBatch.hpp>
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -43,7 +44,8 @@ class Mesh {
         void loadModel(const std::string &filepath);
     };
 
-    Mesh(Device &device, const Mesh::Builder &builder);
+    // Without uploads the buffers are filled before returning, otherwise once the batch has executed
+    Mesh(Device &device, const Mesh::Builder &builder, UploadBatch *uploads = nullptr);
     ~Mesh();
 
     Mesh(const Mesh &) = delete;
@@ -55,9 +57,15 @@ class Mesh {
     void bind(VkCommandBuffer commandBuffer);
     void draw(VkCommandBuffer commandBuffer);
 
+    // CPU copies of the geometry, triangle list indices even for non indexed meshes
+    const std::vector<glm::vec3> &getPositions() const { return positions; }
+    const std::vector<uint32_t> &getIndices() const { return indices; }
+    // Model space bounds of the positions
+    void getBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax) const;
+
    private:
-    void createVertexBuffers(const std::vector<Vertex> &vertices);
-    void createIndexBuffers(const std::vector<uint32_t> &indices);
+    void createVertexBuffers(const std::vector<Vertex> &vertices, UploadBatch *uploads);
+    void createIndexBuffers(const std::vector<uint32_t> &indices, UploadBatch *uploads);
 
     Device &device;
 
@@ -67,5 +75,10 @@ class Mesh {
     bool hasIndexBuffer = false;
     std::unique_ptr<Buffer> indexBuffer;
     uint32_t indexCount;
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    glm::vec3 boundsMin{0.f};
+    glm::vec3 boundsMax{0.f};
 };
 }  // namespace vkr
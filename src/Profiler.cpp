@@ -0,0 +1,110 @@
+#include <Profiler.hpp>
+
+#ifdef VKR_PROFILE
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace vkr {
+
+struct ZoneEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Written by its thread only. The count is published after the event, so a concurrent reader
+// sees complete events up to it.
+struct ThreadBuffer {
+    static constexpr size_t CAPACITY = 1 << 18;
+
+    uint32_t threadId;
+    std::unique_ptr<ZoneEvent[]> events{new ZoneEvent[CAPACITY]};
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+};
+
+// Buffers are kept after their thread exits, so its zones still end up in the trace
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+static ThreadBuffer &threadBuffer() {
+    thread_local ThreadBuffer *buffer = [] {
+        std::lock_guard<std::mutex> lock{buffersMutex};
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffers.back()->threadId = static_cast<uint32_t>(buffers.size());
+        return buffers.back().get();
+    }();
+    return *buffer;
+}
+
+uint64_t Profiler::now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::recordZone(const char *name, uint64_t start, uint64_t end) {
+    ThreadBuffer &buffer = threadBuffer();
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    if (index == ThreadBuffer::CAPACITY) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer.events[index] = {name, start, end};
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+static void writeEscaped(std::ofstream &file, const char *text) {
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') file << '\\';
+        file << *text;
+    }
+}
+
+void Profiler::writeChromeTrace(const std::string &filepath) {
+    std::ofstream file{filepath};
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open trace for writing: " + filepath);
+    }
+
+    std::lock_guard<std::mutex> lock{buffersMutex};
+    file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    bool first = true;
+    size_t zoneCount = 0;
+    size_t droppedCount = 0;
+    char timing[64];
+    for (const auto &buffer : buffers) {
+        const size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            const ZoneEvent &event = buffer->events[i];
+            file << (first ? "" : ",\n") << "{\"name\": \"";
+            writeEscaped(file, event.name);
+
+            // Microseconds with nanosecond decimals, as trace_event expects
+            snprintf(timing, sizeof(timing), "\"ts\": %.3f, \"dur\": %.3f", event.start * 1e-3,
+                     (event.end - event.start) * 1e-3);
+            file << "\", \"ph\": \"X\", " << timing << ", \"pid\": 1, \"tid\": " << buffer->threadId << "}";
+            first = false;
+        }
+        zoneCount += count;
+        droppedCount += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    file << "\n]}\n";
+
+    if (!file) {
+        throw std::runtime_error("failed to write trace: " + filepath);
+    }
+    printf("CPU trace written to \"%s\" (%zu zones, %zu dropped)\n", filepath.c_str(), zoneCount, droppedCount);
+}
+
+}  // namespace vkr
+
+#endif
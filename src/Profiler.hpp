@@ -0,0 +1,53 @@
+#pragma once
+
+// CPU instrumentation. Scoped zones are recorded into per thread buffers and written out as a
+// Chrome trace_event file, which Perfetto and chrome://tracing open. Everything compiles out
+// unless VKR_PROFILE is defined (CMake option VKR_PROFILE).
+
+#ifdef VKR_PROFILE
+
+// std
+#include <cstdint>
+#include <string>
+
+namespace vkr {
+
+class Profiler {
+   public:
+    // Nanoseconds since the first call
+    static uint64_t now();
+
+    // Zone names must outlive the profiler, string literals in practice. Lock free: every thread
+    // only appends to its own buffer, zones beyond its capacity are dropped and counted.
+    static void recordZone(const char *name, uint64_t start, uint64_t end);
+
+    // Safe while other threads keep recording, their zones completed so far are written
+    static void writeChromeTrace(const std::string &filepath);
+};
+
+class ProfileZone {
+   public:
+    explicit ProfileZone(const char *name) : name{name}, start{Profiler::now()} {}
+    ~ProfileZone() { Profiler::recordZone(name, start, Profiler::now()); }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+   private:
+    const char *name;
+    uint64_t start;
+};
+
+}  // namespace vkr
+
+#define VKR_PROFILE_CONCAT_INNER(a, b) a##b
+#define VKR_PROFILE_CONCAT(a, b) VKR_PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ::vkr::ProfileZone VKR_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+
+#endif
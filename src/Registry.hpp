@@ -0,0 +1,203 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace vkr {
+
+// Entities are plain ids, their components live in the pools of a Registry
+using Entity = uint32_t;
+static constexpr Entity NULL_ENTITY = UINT32_MAX;
+
+namespace detail {
+
+inline uint32_t nextComponentType() {
+    static uint32_t nextType = 0;
+    return nextType++;
+}
+
+template <typename T>
+uint32_t componentType() {
+    static const uint32_t type = nextComponentType();
+    return type;
+}
+
+}  // namespace detail
+
+class ComponentPoolBase {
+   public:
+    virtual ~ComponentPoolBase() = default;
+    virtual void remove(Entity entity) = 0;
+
+    bool contains(Entity entity) const { return entity < sparse.size() && sparse[entity] != ABSENT; }
+    size_t size() const { return dense.size(); }
+    // Entities holding the component, in the order of the components
+    const std::vector<Entity> &entities() const { return dense; }
+
+   protected:
+    static constexpr uint32_t ABSENT = UINT32_MAX;
+
+    std::vector<uint32_t> sparse;  // entity to index in dense, ABSENT without the component
+    std::vector<Entity> dense;
+};
+
+// Sparse set of the components of one type: they are packed in a contiguous array, in the order
+// they were added, and a removal moves the last one into the hole.
+template <typename T>
+class ComponentPool : public ComponentPoolBase {
+   public:
+    template <typename... Args>
+    T &emplace(Entity entity, Args &&...args) {
+        assert(!contains(entity) && "entity already has the component");
+        if (entity >= sparse.size()) sparse.resize(entity + 1, ABSENT);
+        sparse[entity] = static_cast<uint32_t>(dense.size());
+        dense.push_back(entity);
+        components.push_back(T{std::forward<Args>(args)...});
+        return components.back();
+    }
+
+    void remove(Entity entity) override {
+        if (!contains(entity)) return;
+        const uint32_t index = sparse[entity];
+        sparse[dense.back()] = index;
+        dense[index] = dense.back();
+        components[index] = std::move(components.back());
+        dense.pop_back();
+        components.pop_back();
+        sparse[entity] = ABSENT;
+    }
+
+    T &get(Entity entity) {
+        assert(contains(entity) && "entity does not have the component");
+        return components[sparse[entity]];
+    }
+    T *tryGet(Entity entity) { return contains(entity) ? &components[sparse[entity]] : nullptr; }
+
+    std::vector<T> &data() { return components; }
+
+   private:
+    std::vector<T> components;
+};
+
+// Data-oriented entity component system. Each component type is stored in its own ComponentPool,
+// so systems walk the contiguous arrays of the components they need rather than every entity.
+// Pools are not synchronized: entities and components must not be added or removed while another
+// thread reads them, nor while iterating over the pools they belong to.
+class Registry {
+   public:
+    Entity create() {
+        if (!freeEntities.empty()) {
+            Entity entity = freeEntities.back();
+            freeEntities.pop_back();
+            alive[entity] = true;
+            return entity;
+        }
+        alive.push_back(true);
+        return entityCount++;
+    }
+
+    // Removes every component of entity, its id is given to the next created entity. Destroying it
+    // again before then is a no-op, which asserts in debug builds.
+    void destroy(Entity entity) {
+        assert(valid(entity) && "entity destroyed twice or never created");
+        if (!valid(entity)) return;
+        for (auto &pool : pools) {
+            if (pool) pool->remove(entity);
+        }
+        alive[entity] = false;
+        freeEntities.push_back(entity);
+    }
+
+    // Whether entity was created and not destroyed since
+    bool valid(Entity entity) const { return entity < alive.size() && alive[entity]; }
+
+    // Number of entities alive
+    size_t size() const { return entityCount - freeEntities.size(); }
+
+    template <typename T, typename... Args>
+    T &emplace(Entity entity, Args &&...args) {
+        return pool<T>().emplace(entity, std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void remove(Entity entity) {
+        if (auto components = findPool<T>()) components->remove(entity);
+    }
+
+    template <typename T>
+    bool has(Entity entity) const {
+        auto components = findPool<T>();
+        return components && components->contains(entity);
+    }
+
+    template <typename T>
+    T &get(Entity entity) {
+        return pool<T>().get(entity);
+    }
+
+    template <typename T>
+    T *tryGet(Entity entity) {
+        auto components = findPool<T>();
+        return components ? components->tryGet(entity) : nullptr;
+    }
+
+    // Entities with a component of type T
+    template <typename T>
+    size_t count() const {
+        auto components = findPool<T>();
+        return components ? components->size() : 0;
+    }
+
+    template <typename T>
+    ComponentPool<T> &pool() {
+        const uint32_t type = detail::componentType<T>();
+        if (type >= pools.size()) pools.resize(type + 1);
+        if (!pools[type]) pools[type] = std::make_unique<ComponentPool<T>>();
+        return static_cast<ComponentPool<T> &>(*pools[type]);
+    }
+
+    // Calls function(entity, components...) for the entities holding all the Components. Walks the
+    // smallest of their pools in order, skipping the entities missing one of the others.
+    template <typename... Components, typename Function>
+    void each(Function &&function) {
+        std::tuple<ComponentPool<Components> *...> componentPools{findPool<Components>()...};
+        if (!std::apply([](auto *...pools) { return (pools && ...); }, componentPools)) return;
+
+        const std::vector<Entity> *driving = nullptr;
+        std::apply(
+            [&](auto *...pools) {
+                ((driving = !driving || pools->size() < driving->size() ? &pools->entities() : driving), ...);
+            },
+            componentPools);
+
+        for (size_t i = 0; i < driving->size(); i++) {
+            const Entity entity = (*driving)[i];
+            std::apply(
+                [&](auto *...pools) {
+                    if ((pools->contains(entity) && ...)) function(entity, pools->get(entity)...);
+                },
+                componentPools);
+        }
+    }
+
+   private:
+    template <typename T>
+    ComponentPool<T> *findPool() const {
+        const uint32_t type = detail::componentType<T>();
+        if (type >= pools.size() || !pools[type]) return nullptr;
+        return static_cast<ComponentPool<T> *>(pools[type].get());
+    }
+
+    std::vector<std::unique_ptr<ComponentPoolBase>> pools;  // indexed by component type
+    std::vector<Entity> freeEntities;
+    std::vector<bool> alive;  // per entity id
+    Entity entityCount = 0;
+};
+
+}  // namespace vkr
@@ -5,6 +5,7 @@
 */
 
 #include <Hair.hpp>
+#include <Profiler.hpp>
 #include <RenderSystem.hpp>
 #include <SwapChain.hpp>
 
@@ -15,28 +16,68 @@
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <stdexcept>
 
 namespace vkr {
 
-RenderSystem::RenderSystem(Device& device, VkRenderPass renderPass, Scene& scene, bool useMSAA)
-    : device{device}, scene{scene} {
-    createUniformBuffers();
+// Moves the render pass on up to subpass
+static void advanceSubpass(VkCommandBuffer commandBuffer, uint32_t& currentSubpass, uint32_t subpass, VkSubpassContents contents) {
+    for (; currentSubpass < subpass; currentSubpass++) {
+        vkCmdNextSubpass(commandBuffer, contents);
+    }
+}
+
+static uint32_t directionalLightCount(Scene& scene) {
+    uint32_t count = 0;
+    for (const Light& light : scene.getRegistry().pool<Light>().data()) {
+        if (light.type == Light::Type::Directional) count++;
+    }
+    return count;
+}
+
+RenderSystem::RenderSystem(Device& device, PipelineCache& pipelineCache, SwapChain& swapChain, Scene& scene,
+                           uint32_t recordingThreads, VkDeviceSize linkedListBudget,
+                           const HairShadowSettings& hairShadowSettings)
+    : device{device},
+      pipelineCache{pipelineCache},
+      hairTransparency{device, linkedListBudget},
+      marschnerLUT{device},
+      hairShadows{device, pipelineCache, directionalLightCount(scene), marschnerLUT.getDescriptorInfo(), hairShadowSettings},
+      lightClusters{device, pipelineCache},
+      scene{scene} {
     setupDescriptors();
 
     createPipelineLayout();
-    createPipeline(renderPass, useMSAA);
+    recreateSwapChainResources(swapChain);
+
+    if (recordingThreads != 1) {
+        threadPool = std::make_unique<ThreadPool>(recordingThreads);
+        createRecordingPools();
+    }
+}
+
+void RenderSystem::createRecordingPools() {
+    recordingPools.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto& framePools : recordingPools) {
+        framePools.resize(threadPool->threadCount());
+        for (auto& recordingPool : framePools) {
+            device.createCommandPool(recordingPool.commandPool, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        }
+    }
 }
 
 void RenderSystem::setupDescriptors() {
     createDescriptorSetLayout();
 
-    uint32_t entitiesCount = static_cast<uint32_t>(scene.getEntities().size() + 1);  // +1 from skybox
-    std::vector<PoolSize> poolSizes = {PoolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, entitiesCount},
-                                       PoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, entitiesCount}};
-    createDescriptorPool(poolSizes, entitiesCount);
+    // One set per frame in flight, whatever the number of entities
+    const uint32_t frameCount = SwapChain::MAX_FRAMES_IN_FLIGHT;
+    std::vector<PoolSize> poolSizes = {PoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount},
+                                       PoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (MAX_TEXTURES + 1) * frameCount}};
+    createDescriptorPool(poolSizes, frameCount);
 
     createDescriptorSets();
 }
@@ -44,12 +85,18 @@ void RenderSystem::setupDescriptors() {
 RenderSystem::~RenderSystem() {
     // Pipeline is deleted implicitly because of unique_ptr out of scope after instance destruction.
 
+    for (auto& framePools : recordingPools) {
+        for (auto& recordingPool : framePools) {
+            vkDestroyCommandPool(device.device(), recordingPool.commandPool, nullptr);
+        }
+    }
+
     vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
     vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
 
-    for (auto& entity : scene.getEntities()) {
-        entity.material->getAlbedo()->destroy();
+    for (auto& material : scene.getRegistry().pool<MaterialComponent>().data()) {
+        material.material->getAlbedo()->destroy();
     }
 
     if (scene.getMainCamera().hasSkybox())
@@ -58,14 +105,19 @@ RenderSystem::~RenderSystem() {
 
 void RenderSystem::createPipelineLayout() {
     VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     pushConstantRange.offset = 0;
     pushConstantRange.size = sizeof(SimplePushConstantData);
 
+    // Set 1 is only bound by the linked list hair pipeline, sets 2 and 3 by every hair pipeline
+    std::array<VkDescriptorSetLayout, 4> setLayouts = {descriptorSetLayout, hairTransparency.getDescriptorSetLayout(),
+                                                       hairShadows.getDescriptorSetLayout(),
+                                                       lightClusters.getDescriptorSetLayout()};
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
     pipelineLayoutInfo.pushConstantRangeCount = 1;
     pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
@@ -75,16 +127,18 @@ void RenderSystem::createPipelineLayout() {
     }
 }
 
-void RenderSystem::createPipeline(VkRenderPass renderPass, bool useMSAA) {
-    // 3 pipelines at the moment:
+void RenderSystem::createPipeline(SwapChain& swapChain) {
+    // 3 pipelines at the moment, plus 2 with hair transparency:
     //     1. Triangular mesh
     //     2. Hair (Line strip)
     //     3. Skybox
+    //     4. Transparent hair, in its own subpass
+    //     5. Transparent hair composite (Fullscreen triangle)
 
     assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
     PipelineConfigInfo pipelineConfig{};
-    Pipeline::defaultPipelineConfigInfo(pipelineConfig, device, useMSAA);
-    pipelineConfig.renderPass = renderPass;
+    Pipeline::defaultPipelineConfigInfo(pipelineConfig, device, swapChain.usesMSAA());
+    pipelineConfig.renderPass = swapChain.getRenderPass();
     pipelineConfig.pipelineLayout = pipelineLayout;
 
     PipelineConfigInfo hairPipelineConfig = pipelineConfig;
@@ -118,31 +172,116 @@ void RenderSystem::createPipeline(VkRenderPass renderPass, bool useMSAA) {
 
     // Skybox pipeline uses same description as triangle mesh pipeline.
 
-    pipelines = Pipeline::createGraphicsPipelines(
-        device,
-        pipelinesShaderPaths,
-        std::vector<PipelineConfigInfo>({pipelineConfig, hairPipelineConfig, skyboxPipelineConfig}),
-        std::vector<VertexInputDescriptions>({meshPipelineInputDescriptions, hairPipelineInputDescriptions, meshPipelineInputDescriptions}));
+    std::vector<PipelineConfigInfo> pipelineConfigs = {pipelineConfig, hairPipelineConfig, skyboxPipelineConfig};
+    std::vector<VertexInputDescriptions> pipelinesInputDescriptions = {
+        meshPipelineInputDescriptions, hairPipelineInputDescriptions, meshPipelineInputDescriptions};
+
+    // Transparent hair is tested against the opaque depth, without writing it
+    PipelineConfigInfo hairTransparentPipelineConfig = hairPipelineConfig;
+    hairTransparentPipelineConfig.subpass = SwapChain::TRANSPARENT_SUBPASS;
+    hairTransparentPipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+
+    // Weighted blended accum adds up, revealage is multiplied by 1 - alpha
+    std::array<VkPipelineColorBlendAttachmentState, 2> weightedBlendAttachments = {pipelineConfig.colorBlendAttachment,
+                                                                                   pipelineConfig.colorBlendAttachment};
+    weightedBlendAttachments[0].blendEnable = VK_TRUE;
+    weightedBlendAttachments[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    weightedBlendAttachments[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    weightedBlendAttachments[1].blendEnable = VK_TRUE;
+    weightedBlendAttachments[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+    weightedBlendAttachments[1].srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    weightedBlendAttachments[1].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+
+    ShaderPaths hairTransparentShaderPaths;
+    hairTransparentShaderPaths.vertFilepath = "../shaders/hair.vert.spv";
+
+    // Blends the premultiplied transparent hair over the scene
+    PipelineConfigInfo compositePipelineConfig = pipelineConfig;
+    compositePipelineConfig.subpass = SwapChain::COMPOSITE_SUBPASS;
+    compositePipelineConfig.pipelineLayout = hairTransparency.getCompositePipelineLayout();
+    compositePipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+    compositePipelineConfig.depthStencilInfo.depthTestEnable = VK_FALSE;
+    compositePipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+    VkPipelineColorBlendAttachmentState compositeBlendAttachment = pipelineConfig.colorBlendAttachment;
+    compositeBlendAttachment.blendEnable = VK_TRUE;
+    compositeBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    compositeBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    compositePipelineConfig.colorBlendInfo.pAttachments = &compositeBlendAttachment;
+
+    ShaderPaths compositeShaderPaths;
+    compositeShaderPaths.vertFilepath = "../shaders/fullscreen.vert.spv";
+
+    if (swapChain.getTransparencyMode() == TransparencyMode::WeightedBlended) {
+        hairTransparentPipelineConfig.colorBlendInfo.attachmentCount = static_cast<uint32_t>(weightedBlendAttachments.size());
+        hairTransparentPipelineConfig.colorBlendInfo.pAttachments = weightedBlendAttachments.data();
+        hairTransparentShaderPaths.fragFilepath = "../shaders/hair_weighted.frag.spv";
+        compositeShaderPaths.fragFilepath = swapChain.usesMSAA() ? "../shaders/hair_composite_weighted_ms.frag.spv"
+                                                                 : "../shaders/hair_composite_weighted.frag.spv";
+    } else {
+        // Linked lists are built with shader stores only
+        hairTransparentPipelineConfig.colorBlendInfo.attachmentCount = 0;
+        hairTransparentPipelineConfig.colorBlendInfo.pAttachments = nullptr;
+        hairTransparentShaderPaths.fragFilepath = "../shaders/hair_list.frag.spv";
+        compositeShaderPaths.fragFilepath = "../shaders/hair_composite_list.frag.spv";
+    }
+
+    if (swapChain.hasTransparency()) {
+        pipelinesShaderPaths.push_back(hairTransparentShaderPaths);
+        pipelinesShaderPaths.push_back(compositeShaderPaths);
+        pipelineConfigs.push_back(hairTransparentPipelineConfig);
+        pipelineConfigs.push_back(compositePipelineConfig);
+        pipelinesInputDescriptions.push_back(hairPipelineInputDescriptions);
+        pipelinesInputDescriptions.push_back(VertexInputDescriptions{});
+    }
+
+    std::vector<std::shared_ptr<Pipeline>> createdPipelines = Pipeline::createGraphicsPipelines(
+        device, pipelineCache, pipelinesShaderPaths, pipelineConfigs, pipelinesInputDescriptions);
+    if (swapChain.hasTransparency()) {
+        pipelines = std::make_unique<PipelineSet>(createdPipelines[0], createdPipelines[1], createdPipelines[2],
+                                                  createdPipelines[3], createdPipelines[4]);
+    } else {
+        pipelines = std::make_unique<PipelineSet>(createdPipelines[0], createdPipelines[1], createdPipelines[2]);
+    }
 }
 
 void RenderSystem::createDescriptorSetLayout() {
-    std::array<VkDescriptorSetLayoutBinding, 2> setLayoutBindings{};
+    std::array<VkDescriptorSetLayoutBinding, 3> setLayoutBindings{};
 
-    // Binding 0: Uniform buffers (used to pass transforms)
+    // Binding 0: Storage buffer with the data of the entities drawn in the frame
     setLayoutBindings[0].binding = 0;
-    setLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    setLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     setLayoutBindings[0].descriptorCount = 1;
     setLayoutBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    // Binding 1: Combined image sampler (used to pass per object texture information)
+    // Binding 1: Combined image samplers of every material texture, indexed by the entity data
     setLayoutBindings[1].binding = 1;
-    setLayoutBindings[1].descriptorCount = 1;
+    setLayoutBindings[1].descriptorCount = MAX_TEXTURES;
     setLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     setLayoutBindings[1].pImmutableSamplers = nullptr;
     setLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+    // Binding 2: Skybox cubemap
+    setLayoutBindings[2].binding = 2;
+    setLayoutBindings[2].descriptorCount = 1;
+    setLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    setLayoutBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // Slots past the registered textures stay empty, and new ones are written while the frames in
+    // flight use the others
+    std::array<VkDescriptorBindingFlagsEXT, 3> bindingFlags = {
+        0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+               VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT};
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
     layoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
     layoutInfo.pBindings = setLayoutBindings.data();
 
@@ -150,46 +289,6 @@ void RenderSystem::createDescriptorSetLayout() {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
 }
-
-void RenderSystem::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(EntityUBO);
-    VkDeviceSize lightBufferSize = sizeof(EntityUBO);
-
-    // Triangle meshes
-    for (auto& entity : scene.getEntities()) {
-        entity.uboBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (auto& uboBuffer : entity.uboBuffers) {
-            uboBuffer = std::make_unique<Buffer>(device, bufferSize, 1,
-                                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                                 device.properties.limits.minUniformBufferOffsetAlignment);
-            uboBuffer->map();
-        }
-    }
-
-    // Lights
-    for (auto& lightEntity : scene.getLightEntities()) {
-        // Create light specific UBO
-        lightEntity.uboBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (auto& uboBuffer : lightEntity.uboBuffers) {
-            uboBuffer = std::make_unique<Buffer>(device, lightBufferSize, 1,
-                                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                                 device.properties.limits.minUniformBufferOffsetAlignment);
-            uboBuffer->map();
-        }
-    }
-
-    // Skybox
-    if (scene.getMainCamera().hasSkybox()) {
-        scene.getMainCamera().getSkybox().uboBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (auto& uboBuffer : scene.getMainCamera().getSkybox().uboBuffers) {
-            uboBuffer = std::make_unique<Buffer>(device, bufferSize, 1,
-                                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                                 device.properties.limits.minUniformBufferOffsetAlignment);
-            uboBuffer->map();
-        }
-    }
-}
-
 void RenderSystem::createDescriptorPool(const std::vector<PoolSize>& poolSizes, int maxSets) {
     std::vector<VkDescriptorPoolSize> descriptorPoolSizes(poolSizes.size());
 
@@ -203,6 +302,7 @@ void RenderSystem::createDescriptorPool(const std::vector<PoolSize>& poolSizes,
     poolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
     poolInfo.pPoolSizes = descriptorPoolSizes.data();
     poolInfo.maxSets = maxSets;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
 
     if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
@@ -210,101 +310,380 @@ void RenderSystem::createDescriptorPool(const std::vector<PoolSize>& poolSizes,
 }
 
 void RenderSystem::createDescriptorSets() {
-    for (auto& entity : scene.getEntities()) {
-        updateDescriptorSet(entity);
-    }
-    if (scene.getMainCamera().hasSkybox())
-        updateDescriptorSet(scene.getMainCamera().getSkybox());
-}
+    const uint32_t frameCount = SwapChain::MAX_FRAMES_IN_FLIGHT;
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+    descriptorSets.resize(frameCount);
 
-void RenderSystem::updateDescriptorSet(Entity& entity) {
-    // Allocates an empty descriptor set without actual descriptors from the pool using the set layout
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    // This is for each entity. Even if there are two bindings per object, these are contained in a single descriptor.
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &descriptorSetLayout;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = setLayouts.data();
 
-    if (vkAllocateDescriptorSets(device.device(), &allocInfo, &entity.descriptorSet) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(device.device(), &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    // Update the descriptor set with the actual descriptors matching shader bindings set in the layout
+    // Room for the current entities and the skybox, entities added later grow the buffers
+    entityBuffers.resize(frameCount);
+    for (uint32_t i = 0; i < frameCount; i++) {
+        createEntityBuffer(i, static_cast<uint32_t>(scene.getRegistry().size() + 1));
+    }
 
-    // Binding 0: Object matrices uniform buffer
-    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = entity.descriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
+    Skybox& skybox = scene.getMainCamera().getSkybox();
+    if (!skybox.material || !skybox.material->hasAlbedo()) return;
+    for (auto descriptorSet : descriptorSets) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSet;
+        descriptorWrite.dstBinding = 2;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &skybox.material->getAlbedo()->getDescriptorInfo();
+        vkUpdateDescriptorSets(device.device(), 1, &descriptorWrite, 0, nullptr);
+    }
+}
 
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
+void RenderSystem::createEntityBuffer(int frameIndex, uint32_t capacity) {
+    // Only the frame's own descriptor set points to it, and its previous use has completed
+    entityBuffers[frameIndex] = std::make_unique<Buffer>(device, sizeof(EntitiesHeader) + capacity * sizeof(EntityData), 1,
+                                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                         device.properties.limits.minStorageBufferOffsetAlignment);
+    entityBuffers[frameIndex]->map();
+
+    VkDescriptorBufferInfo bufferInfo = entityBuffers[frameIndex]->descriptorInfo();
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSets[frameIndex];
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(device.device(), 1, &descriptorWrite, 0, nullptr);
+}
 
-    descriptorWrites[0].pBufferInfo = &entity.uboBuffers[0]->descriptorInfo(sizeof(EntityUBO));
+uint32_t RenderSystem::textureIndex(const std::shared_ptr<Texture>& texture) {
+    auto slot = textureSlots.find(texture.get());
+    if (slot != textureSlots.end() && !slot->second.texture.expired()) {
+        return slot->second.index;
+    }
 
-    // Binding 1: Object texture
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = entity.descriptorSet;
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
+    // A texture allocated where a destroyed one was takes over its slot
+    uint32_t index;
+    if (slot != textureSlots.end()) {
+        index = slot->second.index;
+    } else {
+        if (textureCount == MAX_TEXTURES) {
+            throw std::runtime_error("too many textures for the bindless texture array!");
+        }
+        index = textureCount++;
+    }
+    textureSlots[texture.get()] = TextureSlot{texture, index};
+
+    // Frames in flight never sample the slot, the update after bind flags let it be written
+    for (auto descriptorSet : descriptorSets) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSet;
+        descriptorWrite.dstBinding = 1;
+        descriptorWrite.dstArrayElement = index;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &texture->getDescriptorInfo();
+        vkUpdateDescriptorSets(device.device(), 1, &descriptorWrite, 0, nullptr);
+    }
+    return index;
+}
 
-    descriptorWrites[1].pImageInfo = &entity.material->getAlbedo()->getDescriptorInfo();
+void RenderSystem::gatherDraws(FrameInfo& frameInfo, const glm::mat4& projectionView) {
+    PROFILE_FUNCTION();
+    Registry& registry = scene.getRegistry();
+    meshDraws.clear();
+    hairDraws.clear();
+    entityData.clear();
+
+    // Entities without a texture read slot 0
+    auto addEntityData = [&](Entity entity, WorldTransform& world) {
+        EntityData data{world.model, world.normalMatrix, 0};
+        MaterialComponent* material = registry.tryGet<MaterialComponent>(entity);
+        if (material && material->material->hasAlbedo()) {
+            data.albedo = textureIndex(material->material->getAlbedo());
+        }
+        entityData.push_back(data);
+    };
+    visibleEntities.clear();
+    scene.getEntityBVH().cull(projectionView, visibleEntities);
+    for (Entity entity : visibleEntities) {
+        if (MeshComponent* mesh = registry.tryGet<MeshComponent>(entity)) {
+            meshDraws.push_back(mesh->mesh.get());
+            addEntityData(entity, registry.get<WorldTransform>(entity));
+        }
+    }
+    for (Entity entity : visibleEntities) {
+        if (HairComponent* hair = registry.tryGet<HairComponent>(entity)) {
+            hairDraws.push_back(hair->hair.get());
+            addEntityData(entity, registry.get<WorldTransform>(entity));
+        }
+    }
+    // The skybox samples its own binding
+    if (scene.getMainCamera().hasSkybox()) {
+        TransformComponent& transform = scene.getMainCamera().getSkybox().transform;
+        entityData.push_back(EntityData{transform.mat4(), transform.normalMatrix(), 0});
+    }
 
-    // Binding 2: Lights
+    Buffer* entityBuffer = entityBuffers[frameInfo.frameIndex].get();
+    if (sizeof(EntitiesHeader) + entityData.size() * sizeof(EntityData) > entityBuffer->getBufferSize()) {
+        createEntityBuffer(frameInfo.frameIndex, static_cast<uint32_t>(2 * entityData.size()));
+        entityBuffer = entityBuffers[frameInfo.frameIndex].get();
+    }
 
-    vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    EntitiesHeader header{projectionView, glm::vec4(frameInfo.camera.getPosition(), 1.f)};
+    entityBuffer->writeToBuffer(&header, sizeof(EntitiesHeader));
+    if (!entityData.empty()) {
+        entityBuffer->writeToBuffer(entityData.data(), entityData.size() * sizeof(EntityData), sizeof(EntitiesHeader));
+    }
+    entityBuffer->flush();
+}
+
+void RenderSystem::updateHairBuffers(FrameInfo frameInfo) {
+    PROFILE_FUNCTION();
+    GpuZone zone{frameInfo.gpuProfiler, frameInfo.commandBuffer, "Hair Upload"};
+    for (auto& hair : scene.getRegistry().pool<HairComponent>().data()) {
+        hair.hair->updateVertexBuffer(frameInfo.commandBuffer, frameInfo.frameIndex);
+    }
+    hairTransparency.clear(frameInfo.commandBuffer);
+}
+
+void RenderSystem::updateLights(FrameInfo frameInfo) {
+    lightClusters.update(frameInfo, scene.getRegistry());
+}
+
+void RenderSystem::renderHairShadows(FrameInfo frameInfo) {
+    PROFILE_FUNCTION();
+    hairShadows.render(frameInfo, scene.getRegistry());
 }
 
 void RenderSystem::renderEntities(FrameInfo frameInfo) {
+    PROFILE_FUNCTION();
+    auto startTime = std::chrono::high_resolution_clock::now();
     auto projectionView = frameInfo.camera.getProjection() * frameInfo.camera.getView();
 
-    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    gatherDraws(frameInfo, projectionView);
+    drawCount = static_cast<uint32_t>(entityData.size());
+
+    uint32_t subpass = 0;
+    if (!recordsInParallel()) {
+        createRecordingJobs(frameInfo, 1);
+        for (const auto& job : recordingJobs) {
+            advanceSubpass(frameInfo.commandBuffer, subpass, job.subpass, VK_SUBPASS_CONTENTS_INLINE);
+            recordJob(job, frameInfo);
+        }
+    } else {
+        assert(frameInfo.renderPass != VK_NULL_HANDLE && "Cannot record secondary command buffers without a render pass");
+
+        // The frame fence has been waited on, so its command buffers can be recycled
+        for (auto& recordingPool : recordingPools[frameInfo.frameIndex]) {
+            vkResetCommandPool(device.device(), recordingPool.commandPool, 0);
+            recordingPool.usedCount = 0;
+        }
 
-    // TRIANGULAR MESHES
-    pipelines->meshes->bind(commandBuffer);
-    for (auto& entity : scene.getEntities()) {
-        if (!entity.mesh) continue;
-        entity.render(projectionView, frameInfo, pipelineLayout);
+        // A few jobs per type and thread, so threads finishing early pick up the remaining ones
+        createRecordingJobs(frameInfo, 2 * threadPool->threadCount());
+        secondaryCommandBuffers.resize(recordingJobs.size());
+        threadPool->run(static_cast<uint32_t>(recordingJobs.size()), [&](uint32_t jobIndex, uint32_t threadIndex) {
+            PROFILE_SCOPE("Record Job");
+            FrameInfo jobFrameInfo = frameInfo;
+            jobFrameInfo.commandBuffer = beginSecondaryCommandBuffer(frameInfo, threadIndex, recordingJobs[jobIndex].subpass);
+            recordJob(recordingJobs[jobIndex], jobFrameInfo);
+            if (vkEndCommandBuffer(jobFrameInfo.commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            secondaryCommandBuffers[jobIndex] = jobFrameInfo.commandBuffer;
+        });
+
+        // Jobs are sorted by subpass, each one executes its own range
+        uint32_t first = 0;
+        for (uint32_t i = 1; i <= recordingJobs.size(); i++) {
+            if (i < recordingJobs.size() && recordingJobs[i].subpass == recordingJobs[first].subpass) continue;
+
+            advanceSubpass(frameInfo.commandBuffer, subpass, recordingJobs[first].subpass,
+                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(frameInfo.commandBuffer, i - first, &secondaryCommandBuffers[first]);
+            first = i;
+        }
     }
 
-    // HAIR (LINES)
-    pipelines->hair->bind(commandBuffer);
-    for (auto& entity : scene.getEntities()) {
-        if (!entity.hair) continue;
-
-        auto modelMatrix = entity.transform.mat4();
-        EntityUBO entityUBO = {projectionView, modelMatrix, entity.transform.normalMatrix(), frameInfo.camera.getPosition()};
-
-        entity.uboBuffers[frameInfo.frameIndex]->writeToBuffer(&entityUBO);
-        entity.uboBuffers[frameInfo.frameIndex]->flush();
-
-        SimplePushConstantData push{0.1f};
-        vkCmdPushConstants(
-            commandBuffer,
-            pipelineLayout,
-            VK_SHADER_STAGE_FRAGMENT_BIT,
-            0,
-            sizeof(SimplePushConstantData),
-            &push);
-
-        entity.hair->bind(commandBuffer);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &entity.descriptorSet, 0, nullptr);
-        entity.hair->draw(commandBuffer);
+    // The render pass must reach the composite subpass even without hair
+    if (hairTransparency.getMode() != TransparencyMode::Opaque) {
+        advanceSubpass(frameInfo.commandBuffer, subpass, SwapChain::COMPOSITE_SUBPASS, VK_SUBPASS_CONTENTS_INLINE);
+        if (!hairDraws.empty()) {
+            GpuZone zone{frameInfo.gpuProfiler, frameInfo.commandBuffer, "Hair Composite"};
+            pipelines->hairComposite->bind(frameInfo.commandBuffer);
+            hairTransparency.drawComposite(frameInfo.commandBuffer);
+        }
     }
 
-    // SKYBOX
-    if (scene.getMainCamera().hasSkybox()) {
-        pipelines->skybox->bind(commandBuffer);
-        scene.getMainCamera().getSkybox().render(projectionView, frameInfo, pipelineLayout);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    recordTime = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+VkSubpassContents RenderSystem::getSubpassContents() const {
+    return recordsInParallel() ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+}
+
+bool RenderSystem::recordsInParallel() const {
+    if (!threadPool) return false;
+
+    const Registry& registry = scene.getRegistry();
+    return registry.count<MeshComponent>() + registry.count<HairComponent>() >= PARALLEL_RECORDING_MIN_DRAWS;
+}
+
+void RenderSystem::createRecordingJobs(FrameInfo& frameInfo, uint32_t jobsPerType) {
+    recordingJobs.clear();
+
+    auto addJobs = [&](RecordingJob::Type type, uint32_t subpass, uint32_t count, const char* zoneName) {
+        if (count == 0) return;
+
+        uint32_t zoneQuery = frameInfo.gpuProfiler ? frameInfo.gpuProfiler->reserveZone(zoneName) : 0;
+        uint32_t jobCount = std::max(1u, std::min(jobsPerType, count / MIN_DRAWS_PER_JOB));
+        uint32_t countPerJob = (count + jobCount - 1) / jobCount;
+        for (uint32_t first = 0; first < count; first += countPerJob) {
+            uint32_t jobDraws = std::min(countPerJob, count - first);
+            recordingJobs.push_back({type, subpass, first, jobDraws, zoneQuery, first == 0, first + jobDraws == count});
+        }
+    };
+    const uint32_t hairCount = static_cast<uint32_t>(hairDraws.size());
+    const uint32_t skyboxCount = scene.getMainCamera().hasSkybox() ? 1 : 0;
+    addJobs(RecordingJob::Type::Meshes, 0, static_cast<uint32_t>(meshDraws.size()), "Meshes");
+    if (hairTransparency.getMode() == TransparencyMode::Opaque) {
+        addJobs(RecordingJob::Type::Hair, 0, hairCount, "Hair");
+        addJobs(RecordingJob::Type::Skybox, 0, skyboxCount, "Skybox");
+    } else {
+        // Transparent hair blends over the whole opaque scene
+        addJobs(RecordingJob::Type::Skybox, 0, skyboxCount, "Skybox");
+        addJobs(RecordingJob::Type::Hair, SwapChain::TRANSPARENT_SUBPASS, hairCount, "Hair");
+    }
+}
+
+VkCommandBuffer RenderSystem::beginSecondaryCommandBuffer(FrameInfo& frameInfo, uint32_t threadIndex, uint32_t subpass) {
+    RecordingPool& recordingPool = recordingPools[frameInfo.frameIndex][threadIndex];
+    if (recordingPool.usedCount == recordingPool.commandBuffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = recordingPool.commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+        recordingPool.commandBuffers.push_back(commandBuffer);
+    }
+    VkCommandBuffer commandBuffer = recordingPool.commandBuffers[recordingPool.usedCount++];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = frameInfo.renderPass;
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = frameInfo.framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording secondary command buffer!");
     }
+
+    // Dynamic state is not inherited from the primary command buffer
+    VkViewport viewport{0.f, 0.f, static_cast<float>(frameInfo.extent.width), static_cast<float>(frameInfo.extent.height), 0.f, 1.f};
+    VkRect2D scissor{{0, 0}, frameInfo.extent};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    return commandBuffer;
+}
+
+void RenderSystem::recordJob(const RecordingJob& job, FrameInfo frameInfo) {
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    if (job.beginsZone && frameInfo.gpuProfiler) frameInfo.gpuProfiler->beginZone(commandBuffer, job.zoneQuery);
+
+    // Entity data is indexed as gatherDraws laid it out
+    const uint32_t hairOffset = static_cast<uint32_t>(meshDraws.size());
+    const uint32_t skyboxIndex = hairOffset + static_cast<uint32_t>(hairDraws.size());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                            &descriptorSets[frameInfo.frameIndex], 0, nullptr);
+
+    switch (job.type) {
+        // TRIANGULAR MESHES
+        case RecordingJob::Type::Meshes:
+            pipelines->meshes->bind(commandBuffer);
+            lightClusters.bind(commandBuffer, pipelineLayout, 3, frameInfo.frameIndex);
+            for (uint32_t i = job.first; i < job.first + job.count; i++) {
+                renderMesh(*meshDraws[i], frameInfo, i);
+            }
+            break;
+
+        // HAIR (LINES)
+        case RecordingJob::Type::Hair:
+            if (hairTransparency.getMode() == TransparencyMode::Opaque) {
+                pipelines->hair->bind(commandBuffer);
+            } else {
+                pipelines->hairTransparent->bind(commandBuffer);
+                if (hairTransparency.getMode() == TransparencyMode::LinkedList) {
+                    hairTransparency.bind(commandBuffer, pipelineLayout, 1);
+                }
+            }
+            hairShadows.bind(commandBuffer, pipelineLayout, 2, frameInfo.frameIndex);
+            lightClusters.bind(commandBuffer, pipelineLayout, 3, frameInfo.frameIndex);
+            for (uint32_t i = job.first; i < job.first + job.count; i++) {
+                renderHair(*hairDraws[i], frameInfo, hairOffset + i);
+            }
+            break;
+
+        // SKYBOX
+        case RecordingJob::Type::Skybox:
+            pipelines->skybox->bind(commandBuffer);
+            renderMesh(*scene.getMainCamera().getSkybox().mesh, frameInfo, skyboxIndex);
+            break;
+    }
+
+    if (job.endsZone && frameInfo.gpuProfiler) frameInfo.gpuProfiler->endZone(commandBuffer, job.zoneQuery);
+}
+
+void RenderSystem::renderMesh(Mesh& mesh, FrameInfo& frameInfo, uint32_t entityIndex) {
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    SimplePushConstantData push{entityIndex, 0.0f};
+    vkCmdPushConstants(
+        commandBuffer,
+        pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(SimplePushConstantData),
+        &push);
+
+    mesh.bind(commandBuffer);
+    mesh.draw(commandBuffer);
+}
+
+void RenderSystem::renderHair(Hair& hair, FrameInfo& frameInfo, uint32_t entityIndex) {
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    SimplePushConstantData push{entityIndex, 0.1f, hairOpacity};
+    vkCmdPushConstants(
+        commandBuffer,
+        pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(SimplePushConstantData),
+        &push);
+
+    hair.bind(commandBuffer);
+    hair.draw(commandBuffer);
 }
 
-void RenderSystem::recreatePipelines(VkRenderPass renderPass, bool useMSAA) {
-    createPipeline(renderPass, useMSAA);
+void RenderSystem::recreateSwapChainResources(SwapChain& swapChain) {
+    hairTransparency.recreate(swapChain);
+    createPipeline(swapChain);
 }
 
 }  // namespace vkr
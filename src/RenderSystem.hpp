@@ -10,11 +10,19 @@
 #include <Device.hpp>
 #include <Entity.hpp>
 #include <Pipeline.hpp>
+#include <PipelineCache.hpp>
 #include <FrameInfo.hpp>
+#include <HairShadows.hpp>
+#include <HairTransparency.hpp>
+#include <LightClusters.hpp>
+#include <MarschnerLUT.hpp>
 #include <Scene.hpp>
+#include <SwapChain.hpp>
+#include <ThreadPool.hpp>
 
 // std
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace vkr {
@@ -24,9 +32,20 @@ struct PoolSize {
     uint32_t descriptorCount;
 };
 
+// Entities are drawn bindless: set 0 holds the data of every entity drawn in the frame, in a storage
+// buffer, and an array with the textures of their materials. Draws only push the index of their
+// entity, so nothing is bound between them. Textures are registered the first time an entity
+// samples them, without waiting for the frames in flight (VK_EXT_descriptor_indexing).
 class RenderSystem {
    public:
-    RenderSystem(Device &device, VkRenderPass renderPass, Scene &scene, bool useMSAA = true);
+    // Texture slots of the array, sampled textures are never unregistered
+    static constexpr uint32_t MAX_TEXTURES = 1024;
+
+    // recordingThreads includes the calling thread: 0 for one per hardware thread, 1 records inline.
+    // linkedListBudget bounds the memory of linked list hair transparency, see HairTransparency.
+    RenderSystem(Device &device, PipelineCache &pipelineCache, SwapChain &swapChain, Scene &scene, uint32_t recordingThreads = 0,
+                 VkDeviceSize linkedListBudget = HairTransparency::DEFAULT_LINKED_LIST_BUDGET,
+                 const HairShadowSettings &hairShadowSettings = HairShadowSettings{});
     ~RenderSystem();
 
     RenderSystem(const RenderSystem &) = delete;
@@ -34,22 +53,108 @@ class RenderSystem {
 
     void setupDescriptors();
 
+    // Uploads the simulated hair strands and empties the transparency lists. Records transfers, so
+    // it goes before the render pass begins.
+    void updateHairBuffers(FrameInfo frameInfo);
+    // Uploads the scene lights and records their assignment to the froxels of the camera, before
+    // the render pass begins. frameInfo needs its extent.
+    void updateLights(FrameInfo frameInfo);
+    // Records the hair shadow passes, after updateHairBuffers and before the render pass begins
+    void renderHairShadows(FrameInfo frameInfo);
+    // Large scenes are split between the recording threads into secondary command buffers, the
+    // render pass must then be begun with getSubpassContents. frameInfo needs its render pass,
+    // framebuffer and extent in that case. With hair transparency, it also records the transparent
+    // and composite subpasses.
     void renderEntities(FrameInfo frameInfo);
-    void recreatePipelines(VkRenderPass renderPass, bool useMSAA = true);
+    VkSubpassContents getSubpassContents() const;
+    // Draw calls recorded by the last renderEntities
+    uint32_t getDrawCount() const { return drawCount; }
+    // Milliseconds the last renderEntities took
+    double getRecordTime() const { return recordTime; }
+    // Pipelines and transparency resources follow the swap chain, call it whenever it is recreated.
+    // Cheap once the pipelines were built with the same state, see PipelineCache.
+    void recreateSwapChainResources(SwapChain &swapChain);
+
+    // Scales the strand opacities of transparent hair
+    void setHairOpacity(float opacity) { hairOpacity = opacity; }
+    float getHairOpacity() const { return hairOpacity; }
+    const HairTransparency &getHairTransparency() const { return hairTransparency; }
+    // Resolution and layer count changes wait for the device to be idle, see HairShadows
+    void setHairShadowSettings(const HairShadowSettings &settings) { hairShadows.setSettings(settings); }
+    const HairShadowSettings &getHairShadowSettings() const { return hairShadows.getSettings(); }
+    VkDeviceSize getHairShadowMemory() const { return hairShadows.getMemoryUsage(); }
 
    private:
+    // Matches entities.glsl, followed by the data of every entity drawn in the frame
+    struct EntitiesHeader {
+        glm::mat4 projectionView;
+        glm::vec4 camPos;
+    };
+
+    struct EntityData {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+        uint32_t albedo;  // slot of the texture array
+        uint32_t padding[3];
+    };
+
+    struct TextureSlot {
+        std::weak_ptr<Texture> texture;
+        uint32_t index;
+    };
+
     void createDescriptorSetLayout();
-    void createUniformBuffers();
     void createDescriptorPool(const std::vector<PoolSize> &poolSizes, int maxSets);
     void createDescriptorSets();
+    void createEntityBuffer(int frameIndex, uint32_t capacity);
+    // Collects the draws of the frame from the entities of the scene inside the camera frustum, see
+    // EntityBVH, and writes their entity data: meshes first, then hair and the skybox. Entities are
+    // drawn with their cached WorldTransform, the scene updates them.
+    void gatherDraws(FrameInfo &frameInfo, const glm::mat4 &projectionView);
+    uint32_t textureIndex(const std::shared_ptr<Texture> &texture);
 
     void createPipelineLayout();
-    void createPipeline(VkRenderPass renderPass, bool useMSAA = true);
-
-    void updateDescriptorSet(Entity& entity);
+    void createPipeline(SwapChain &swapChain);
+
+
+    // A range of the entities of one pipeline, recorded into one command buffer
+    struct RecordingJob {
+        enum class Type { Meshes, Hair, Skybox } type;
+        uint32_t subpass;
+        uint32_t first;
+        uint32_t count;
+        uint32_t zoneQuery;  // shared by the jobs of a type, begun by the first and ended by the last
+        bool beginsZone;
+        bool endsZone;
+    };
+
+    // Per frame in flight and recording thread, reset once its frame is done
+    struct RecordingPool {
+        VkCommandPool commandPool;
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint32_t usedCount = 0;
+    };
+
+    // Below, waking the workers costs more than recording inline
+    static constexpr uint32_t PARALLEL_RECORDING_MIN_DRAWS = 64;
+    static constexpr uint32_t MIN_DRAWS_PER_JOB = 16;
+
+    bool recordsInParallel() const;
+    void createRecordingPools();
+    void createRecordingJobs(FrameInfo &frameInfo, uint32_t jobsPerType);
+    void recordJob(const RecordingJob &job, FrameInfo frameInfo);
+    void renderMesh(Mesh &mesh, FrameInfo &frameInfo, uint32_t entityIndex);
+    void renderHair(Hair &hair, FrameInfo &frameInfo, uint32_t entityIndex);
+    VkCommandBuffer beginSecondaryCommandBuffer(FrameInfo &frameInfo, uint32_t threadIndex, uint32_t subpass);
 
     Device &device;
+    PipelineCache &pipelineCache;
 
+    HairTransparency hairTransparency;
+    MarschnerLUT marschnerLUT;
+    HairShadows hairShadows;
+    LightClusters lightClusters;
+    float hairOpacity = 0.6f;
     std::unique_ptr<PipelineSet> pipelines;
 
     VkDescriptorSetLayout descriptorSetLayout;
@@ -58,6 +163,23 @@ class RenderSystem {
     Scene& scene;
 
     VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;                 // per frame in flight
+    std::vector<std::unique_ptr<Buffer>> entityBuffers;          // per frame in flight, grown as entities are added
+    std::unordered_map<const Texture *, TextureSlot> textureSlots;
+    uint32_t textureCount = 0;
+
+    uint32_t drawCount = 0;
+    double recordTime = 0.0;
+
+    std::unique_ptr<ThreadPool> threadPool;  // null when recording inline
+    std::vector<std::vector<RecordingPool>> recordingPools;
+    // Draws of the frame, in the order of entityData. Kept between frames to reuse their memory.
+    std::vector<Entity> visibleEntities;
+    std::vector<Mesh *> meshDraws;
+    std::vector<Hair *> hairDraws;
+    std::vector<EntityData> entityData;
+    std::vector<RecordingJob> recordingJobs;
+    std::vector<VkCommandBuffer> secondaryCommandBuffers;
 
     void *data;
 };
@@ -0,0 +1,137 @@
+#include <ScalpBinding.hpp>
+#include <TriangleBVH.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+namespace vkr {
+
+// 1 when value is above threshold and 0 otherwise, as a clamp rather than a comparison, which
+// compilers do not turn into vector selects with trapping math. threshold must be above 1e-20.
+static inline float above(float value, float threshold) {
+    return std::min(std::max((value - threshold) * 1e30f, 0.f), 1.f);
+}
+
+// Orthonormal frame of a triangle: first edge, normal, and their cross product. Degenerate
+// triangles still get an orthonormal frame, so offsets from them are rebuilt exactly as well. The
+// fallbacks are blended in with above(), without branches, so loops calling it vectorise.
+static inline void triangleFrame(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                                 glm::vec3 &tangent, glm::vec3 &bitangent, glm::vec3 &normal) {
+    glm::vec3 edge = b - a;
+    float edgeLength = std::sqrt(glm::dot(edge, edge));
+    float hasEdge = above(edgeLength, 1e-20f);
+    tangent = edge * (hasEdge / std::max(edgeLength, 1e-20f)) + glm::vec3{1.f - hasEdge, 0.f, 0.f};
+
+    glm::vec3 n = glm::cross(tangent, c - a);
+    float hasNormal = above(std::sqrt(glm::dot(n, n)), 1e-12f);
+    float fallbackY = above(1.9f - std::fabs(tangent.y), 1.f);  // |tangent.y| < 0.9
+    glm::vec3 fallback = glm::cross(tangent, glm::vec3{1.f - fallbackY, fallbackY, 0.f});
+    n = n * hasNormal + fallback * (1.f - hasNormal);
+    normal = n * (1.f / std::sqrt(glm::dot(n, n)));
+    bitangent = glm::cross(normal, tangent);
+}
+
+ScalpBinding::ScalpBinding(const std::vector<glm::vec3> &meshPositions, const std::vector<uint32_t> &meshIndices,
+                           const std::vector<glm::vec3> &roots) {
+    TriangleBVH bvh{meshPositions, meshIndices};
+    if (bvh.triangleCount() == 0) {
+        throw std::runtime_error("cannot bind hair to a mesh without triangles");
+    }
+
+    triangles.resize(roots.size());
+    barycentrics.resize(roots.size());
+    offsets.resize(roots.size());
+
+    auto bindRange = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            TriangleBVH::ClosestPoint closest = bvh.closestPoint(roots[i]);
+            const uint32_t *triangle = &meshIndices[3 * closest.triangle];
+
+            glm::vec3 tangent, bitangent, normal;
+            triangleFrame(meshPositions[triangle[0]], meshPositions[triangle[1]], meshPositions[triangle[2]],
+                          tangent, bitangent, normal);
+
+            glm::vec3 offset = roots[i] - closest.position;
+            triangles[i] = closest.triangle;
+            barycentrics[i] = closest.barycentrics;
+            offsets[i] = {glm::dot(offset, tangent), glm::dot(offset, bitangent), glm::dot(offset, normal)};
+        }
+    };
+
+    // Queries only read the BVH, each thread writes its own range of roots
+    const size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), roots.size() / 1024));
+    const size_t rootsPerThread = (roots.size() + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < threadCount; t++) {
+        threads.emplace_back(bindRange, t * rootsPerThread, std::min(roots.size(), (t + 1) * rootsPerThread));
+    }
+    bindRange(0, std::min(roots.size(), rootsPerThread));
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+ScalpBinding::ScalpBinding(std::vector<uint32_t> triangles, std::vector<glm::vec2> barycentrics,
+                           std::vector<glm::vec3> offsets)
+    : triangles{std::move(triangles)}, barycentrics{std::move(barycentrics)}, offsets{std::move(offsets)} {
+    assert(this->barycentrics.size() == this->triangles.size() && this->offsets.size() == this->triangles.size() &&
+           "Every root needs a triangle, barycentrics and an offset");
+}
+
+void ScalpBinding::evaluate(const std::vector<glm::vec3> &meshPositions, const std::vector<uint32_t> &meshIndices,
+                            const glm::mat4 &meshTransform, std::vector<glm::vec3> &roots) const {
+    roots.resize(triangles.size());
+
+    // Roots go through in blocks: the vertices of their triangles and their binding are gathered
+    // into deinterleaved arrays, then the frames and roots are rebuilt by a straight float pass the
+    // compiler vectorises (see the flags of this file in CMakeLists.txt)
+    constexpr size_t BLOCK_SIZE = 256;
+    float ax[BLOCK_SIZE], ay[BLOCK_SIZE], az[BLOCK_SIZE];
+    float bx[BLOCK_SIZE], by[BLOCK_SIZE], bz[BLOCK_SIZE];
+    float cx[BLOCK_SIZE], cy[BLOCK_SIZE], cz[BLOCK_SIZE];
+    float u[BLOCK_SIZE], v[BLOCK_SIZE];
+    float ox[BLOCK_SIZE], oy[BLOCK_SIZE], oz[BLOCK_SIZE];
+    for (size_t first = 0; first < triangles.size(); first += BLOCK_SIZE) {
+        const size_t blockCount = std::min(BLOCK_SIZE, triangles.size() - first);
+        for (size_t i = 0; i < blockCount; i++) {
+            const uint32_t *triangle = &meshIndices[3 * triangles[first + i]];
+            const glm::vec3 &a = meshPositions[triangle[0]];
+            const glm::vec3 &b = meshPositions[triangle[1]];
+            const glm::vec3 &c = meshPositions[triangle[2]];
+            ax[i] = a.x, ay[i] = a.y, az[i] = a.z;
+            bx[i] = b.x, by[i] = b.y, bz[i] = b.z;
+            cx[i] = c.x, cy[i] = c.y, cz[i] = c.z;
+            u[i] = barycentrics[first + i].x, v[i] = barycentrics[first + i].y;
+            ox[i] = offsets[first + i].x, oy[i] = offsets[first + i].y, oz[i] = offsets[first + i].z;
+        }
+
+        // The roots overwrite the first vertices once they are rebuilt
+        for (size_t i = 0; i < blockCount; i++) {
+            glm::vec3 a{ax[i], ay[i], az[i]};
+            glm::vec3 b{bx[i], by[i], bz[i]};
+            glm::vec3 c{cx[i], cy[i], cz[i]};
+
+            glm::vec3 tangent, bitangent, normal;
+            triangleFrame(a, b, c, tangent, bitangent, normal);
+
+            glm::vec3 surface = a + (b - a) * u[i] + (c - a) * v[i];
+            glm::vec3 root = surface + tangent * ox[i] + bitangent * oy[i] + normal * oz[i];
+            ax[i] = meshTransform[0][0] * root.x + meshTransform[1][0] * root.y + meshTransform[2][0] * root.z +
+                    meshTransform[3][0];
+            ay[i] = meshTransform[0][1] * root.x + meshTransform[1][1] * root.y + meshTransform[2][1] * root.z +
+                    meshTransform[3][1];
+            az[i] = meshTransform[0][2] * root.x + meshTransform[1][2] * root.y + meshTransform[2][2] * root.z +
+                    meshTransform[3][2];
+        }
+
+        for (size_t i = 0; i < blockCount; i++) {
+            roots[first + i] = {ax[i], ay[i], az[i]};
+        }
+    }
+}
+
+}  // namespace vkr
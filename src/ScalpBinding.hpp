@@ -0,0 +1,40 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vkr {
+
+// Binds hair roots to the closest triangle of a scalp mesh, so that they follow the mesh as it
+// moves or deforms. Each root keeps its triangle, the barycentric coordinates of the closest point
+// and its offset from that point in the triangle tangent frame, which rebuilds the bound pose exactly.
+class ScalpBinding {
+   public:
+    // Roots and mesh positions in mesh model space. Closest points are searched on several threads.
+    // Throws when the mesh has no triangles.
+    ScalpBinding(const std::vector<glm::vec3> &meshPositions, const std::vector<uint32_t> &meshIndices,
+                 const std::vector<glm::vec3> &roots);
+    // Binding as returned by the getters below, e.g. read back from a recording
+    ScalpBinding(std::vector<uint32_t> triangles, std::vector<glm::vec2> barycentrics, std::vector<glm::vec3> offsets);
+
+    // World space roots for the current mesh positions, which must keep the bound topology
+    void evaluate(const std::vector<glm::vec3> &meshPositions, const std::vector<uint32_t> &meshIndices,
+                  const glm::mat4 &meshTransform, std::vector<glm::vec3> &roots) const;
+
+    size_t rootCount() const { return triangles.size(); }
+    const std::vector<uint32_t> &getTriangles() const { return triangles; }
+    const std::vector<glm::vec2> &getBarycentrics() const { return barycentrics; }
+    const std::vector<glm::vec3> &getOffsets() const { return offsets; }
+
+   private:
+    // Structure of arrays, one entry per root
+    std::vector<uint32_t> triangles;
+    std::vector<glm::vec2> barycentrics;
+    std::vector<glm::vec3> offsets;
+};
+
+}  // namespace vkr
@@ -1,6 +1,12 @@
+#include <Profiler.hpp>
 #include <Scene.hpp>
 #include <Utils.hpp>
 
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 namespace vkr {
 
 Scene::Scene(Device& device) : device{device} {
@@ -16,63 +22,231 @@ void Scene::initialize() {
 }
 
 void Scene::loadEntities() {
-    std::string textures_path(TEXTURES_PATH);
-    std::shared_ptr<Texture> texture = Texture::createTextureFromFile(device, (textures_path + "/head.png"));
-    std::shared_ptr<Material> material = std::make_shared<Material>(texture);
+    assetLoader = std::make_unique<AssetLoader>(device);
 
-    std::shared_ptr<Texture> blankTexture = Texture::createTextureFromFile(device, (textures_path + "/blank.jpg"));
+    // The blank texture stands in for the others until they are resident
+    std::string textures_path(TEXTURES_PATH);
+    std::shared_ptr<Texture> blankTexture = Texture::createTextureFromFile(device, textures_path + "/blank.jpg");
     blankMaterial = std::make_shared<Material>(blankTexture);
 
+    std::shared_ptr<Material> material = std::make_shared<Material>(blankTexture);
+    AssetHandle<Texture> texture = assetLoader->loadTexture(textures_path + "/head.png");
+    pendingAssets.push_back([this, material, texture] {
+        if (!texture->isResident()) return false;
+        material->setAlbedo(texture->get());
+        return true;
+    });
+
     std::string models_path(MODELS_PATH);
 
     // Mesh Entities
-    std::shared_ptr<Mesh> mesh =
-        Mesh::createModelFromFile(device, (models_path + "/head.obj").c_str());
-    auto head = Entity::createEntity();
-    head.mesh = mesh;
-    head.material = material;
-    head.transform.translation = {0.f, 2.2f, 2.5f};
-    head.transform.scale = {3.1f, 3.1f, 3.1f};
-    head.transform.rotation = {0.f, PI, 0.f};
-    entities.push_back(std::move(head));
+    AssetHandle<Mesh> mesh = assetLoader->loadMesh(models_path + "/head.obj");
+    Entity head = registry.create();
+    registry.emplace<TransformComponent>(head, glm::vec3{0.f, 2.2f, 2.5f}, glm::vec3{3.1f, 3.1f, 3.1f}, glm::vec3{0.f, PI, 0.f});
+    registry.emplace<MaterialComponent>(head, material);
+    // Kept inside the scalp, so the strands rest on the mesh rather than on the proxy
+    registry.emplace<Collider>(head, Collider::sphere({0.f, 0.f, 0.035f}, 0.3f));
+    pendingAssets.push_back([this, mesh, head] {
+        if (!mesh->isResident()) return false;
+        registry.emplace<MeshComponent>(head, mesh->get());
+        return true;
+    });
 
     // mesh = Mesh::createModelFromFile(device, (models_path + "/smooth_vase.obj").c_str());
-    // auto smoothVase = Entity::createEntity();
-    // smoothVase.mesh = mesh;
-    // smoothVase.material = material;
-    // smoothVase.transform.translation = {.5f, .5f, 2.5f};
-    // smoothVase.transform.scale = {1.5f, 1.5f, 1.5f};
-    // entities.push_back(std::move(smoothVase));
+    // Entity smoothVase = registry.create();
+    // registry.emplace<TransformComponent>(smoothVase, glm::vec3{.5f, .5f, 2.5f}, glm::vec3{1.5f, 1.5f, 1.5f});
+    // registry.emplace<MeshComponent>(smoothVase, mesh);
+    // registry.emplace<MaterialComponent>(smoothVase, material);
 
     // Hair Entities
-    auto hairEntity = Entity::createEntity();
-    hairEntity.hair = std::make_shared<Hair>(device, (models_path + "/wWavy.hair").c_str());
+    AssetHandle<Hair> hair = assetLoader->loadHair(models_path + "/wWavy.hair");
+    Entity hairEntity = registry.create();
+    registry.emplace<TransformComponent>(hairEntity, glm::vec3{0.f, 2.f, 2.5f}, glm::vec3{0.03f, 0.03f, 0.03f},
+                                         glm::vec3{PI_2, PI_2, 0});
+    registry.emplace<MaterialComponent>(hairEntity, material);
+    registry.emplace<ForceField>(hairEntity);
+    // Follows the head from where the groom was placed in the world
+    transformSystem.setParent(registry, hairEntity, head);
+    pendingAssets.push_back([this, hair, hairEntity] {
+        if (!hair->isResident()) return false;
+        registry.emplace<HairComponent>(hairEntity, hair->get());
+        return true;
+    });
+
+    // The strands are simulated once both are resident, already pinned to the scalp
+    pendingAssets.push_back([this, mesh, hair, head, hairEntity] {
+        if (!mesh->isResident() || !hair->isResident()) return false;
+        attachToScalp(hairEntity, head);
+        return true;
+    });
+}
 
-    // TO DO: Might not have a material, support multiple descriptor set layouts!
-    hairEntity.material = material;
-    hairEntity.transform.translation = {0.f, 2.f, 2.5f};
-    hairEntity.transform.scale = {0.03f, 0.03f, 0.03f};
-    hairEntity.transform.rotation = {PI_2, PI_2, 0};
+void Scene::updateAssets(VkCommandBuffer commandBuffer) {
+    if (assetLoader->update(commandBuffer)) assignAssets();
+}
 
-    entities.push_back(std::move(hairEntity));
+void Scene::finishLoading() {
+    assetLoader->finish();
+    assignAssets();
+}
+
+void Scene::assignAssets() {
+    pendingAssets.erase(std::remove_if(pendingAssets.begin(), pendingAssets.end(), [](auto& assign) { return assign(); }),
+                        pendingAssets.end());
+}
+
+void Scene::attachToScalp(Entity hairEntity, Entity meshEntity) {
+    const HairSimulation& simulation = registry.get<HairComponent>(hairEntity).hair->getSimulation();
+    Mesh& mesh = *registry.get<MeshComponent>(meshEntity).mesh;
+
+    // Roots in their rest pose, brought to the mesh model space
+    const glm::mat4 hairToMesh = glm::inverse(TransformSystem::worldMatrix(registry, meshEntity)) *
+                                 TransformSystem::worldMatrix(registry, hairEntity);
+    const auto& strandOffsets = simulation.getStrandOffsets();
+    std::vector<glm::vec3> roots(simulation.strandCount());
+    for (size_t s = 0; s < roots.size(); s++) {
+        roots[s] = glm::vec3(hairToMesh * glm::vec4(simulation.getRestPositions()[strandOffsets[s]], 1.f));
+    }
+
+    auto binding = std::make_shared<ScalpBinding>(mesh.getPositions(), mesh.getIndices(), roots);
+    scalpAttachments.push_back({hairEntity, meshEntity, std::move(binding)});
 }
 
 void Scene::loadLights() {
     // Light Entities
-    auto mainLight = Entity::createEntity();
-    Light light{1.f, glm::vec3{1.f, 1.f, 1.f}};
-    mainLight.light = std::make_shared<Light>(1.f, glm::vec3(1.f, 1.f, 1.f));
-    mainLight.transform.translation = {0.f, 2.f, 0.f};
-    mainLight.transform.rotation = {PI_2, PI_2, 0};
-
-    lights.push_back(std::move(mainLight));
+    Entity mainLight = registry.create();
+    registry.emplace<Light>(mainLight, 1.f, glm::vec3(1.f, 1.f, 1.f), Light::Type::Directional);
+    registry.emplace<TransformComponent>(mainLight, glm::vec3{0.f, 2.f, 0.f}, glm::vec3{1.f, 1.f, 1.f}, glm::vec3{PI_2, PI_2, 0});
 }
 
 void Scene::loadCameraSkybox() {
     mainCamera.loadSkybox(device);
 }
 
-void Scene::updateScene() {
+// Hair entities are numbered in the order of their components, the first one uses filepath as is
+static std::string cachePath(const std::string& filepath, uint32_t track) {
+    return track == 0 ? filepath : filepath + "." + std::to_string(track);
+}
+
+void Scene::updateScene(float frameTime) {
+    PROFILE_FUNCTION();
+    transformSystem.update(registry);
+    updateHair(frameTime);
+    // Hair bounds follow the strands, so they are refit last
+    entityBVH.update(registry, transformSystem);
+}
+
+void Scene::updateHair(float frameTime) {
+    if (!caches.empty()) {
+        cacheTime = std::fmod(cacheTime + frameTime, std::max(caches[0]->duration(), frameTime));
+
+        uint32_t track = 0;
+        for (auto& hair : registry.pool<HairComponent>().data()) {
+            // Only decode and upload when playback reaches a new frame
+            SimulationCache& cache = *caches[track++];
+            uint32_t frame = cache.frameAtTime(cacheTime);
+            if (frame == cache.getDecodedFrame()) continue;
+
+            std::vector<glm::vec3> positions;
+            cache.decodeFrame(frame, positions);
+            hair.hair->setStrandPositions(positions);
+        }
+        return;
+    }
+
+    if (!simulationEnabled) return;
+    simulationTime += frameTime;
+
+    std::vector<ColliderShape> colliders;
+    registry.each<Collider, WorldTransform>([&](Entity, Collider& collider, WorldTransform& world) {
+        colliders.push_back(collider.toWorld(world.model));
+    });
+
+    // Tracks of the recorder and the cache writers follow the order of the hair pool
+    ComponentPool<HairComponent>& hairPool = registry.pool<HairComponent>();
+    for (uint32_t track = 0; track < hairPool.size(); track++) {
+        const Entity entity = hairPool.entities()[track];
+        HairComponent& hair = hairPool.data()[track];
+        WorldTransform* world = registry.tryGet<WorldTransform>(entity);
+        if (!world) continue;
+
+        SimulationInput input{world->model, ForceField{}, simulationTime, frameTime, colliders};
+        if (ForceField* forces = registry.tryGet<ForceField>(entity)) {
+            input.forces = *forces;
+        }
+        glm::mat4 scalpTransform{1.f};
+        for (const auto& attachment : scalpAttachments) {
+            if (attachment.hairEntity != entity) continue;
+
+            const Mesh& mesh = *registry.get<MeshComponent>(attachment.meshEntity).mesh;
+            scalpTransform = registry.get<WorldTransform>(attachment.meshEntity).model;
+            attachment.binding->evaluate(mesh.getPositions(), mesh.getIndices(), scalpTransform, input.roots);
+        }
+        hair.hair->simulate(input);
+        if (recorder) {
+            recorder->recordStep(track, input, scalpTransform, hair.hair->getSimulation().hashState());
+        }
+        if (!cacheWriters.empty()) {
+            std::vector<glm::vec3> positions;
+            hair.hair->copyStrandPositions(positions);
+            cacheWriters[track]->writeFrame(std::move(positions), simulationTime);
+        }
+    }
+}
+
+void Scene::startRecording(const std::string& filepath) {
+    std::vector<SimulationTrack> tracks;
+    ComponentPool<HairComponent>& hairPool = registry.pool<HairComponent>();
+    for (size_t i = 0; i < hairPool.size(); i++) {
+        Hair& hair = *hairPool.data()[i].hair;
+        hair.getSimulation().reset();
+        tracks.push_back({hair.getFilepath(), hair.getSimulation().getParameters(), nullptr});
+
+        // Scalps are recorded with the mesh they were bound on, replays have no scene
+        for (const auto& attachment : scalpAttachments) {
+            if (attachment.hairEntity != hairPool.entities()[i]) continue;
+
+            const Mesh& mesh = *registry.get<MeshComponent>(attachment.meshEntity).mesh;
+            tracks.back().scalp = std::make_shared<RecordedScalp>(
+                RecordedScalp{mesh.getPositions(), mesh.getIndices(), attachment.binding});
+        }
+    }
+
+    recorder = std::make_unique<SimulationRecorder>(filepath, tracks);
+    simulationTime = 0.f;
+    simulationEnabled = true;
+}
+
+void Scene::startCacheExport(const std::string& filepath) {
+    finishCacheExport();
+
+    for (auto& hair : registry.pool<HairComponent>().data()) {
+        hair.hair->getSimulation().reset();
+        cacheWriters.push_back(std::make_unique<SimulationCacheWriter>(
+            cachePath(filepath, static_cast<uint32_t>(cacheWriters.size())), hair.hair->getSimulation().getStrandOffsets()));
+    }
+
+    simulationTime = 0.f;
+    simulationEnabled = true;
+}
+
+void Scene::finishCacheExport() {
+    // Writers flush their pending frames and frame index on destruction
+    cacheWriters.clear();
+}
+
+void Scene::playCache(const std::string& filepath) {
+    caches.clear();
+    for (auto& hair : registry.pool<HairComponent>().data()) {
+        auto cache = std::make_unique<SimulationCache>(cachePath(filepath, static_cast<uint32_t>(caches.size())));
+        if (cache->getStrandOffsets() != hair.hair->getSimulation().getStrandOffsets() || cache->frameCount() == 0) {
+            throw std::runtime_error("simulation cache does not match hair: " + hair.hair->getFilepath());
+        }
+        caches.push_back(std::move(cache));
+    }
+
+    cacheTime = 0.f;
+    simulationEnabled = false;
 }
 
 }  // namespace vkr
\ No newline at end of file
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <AssetLoader.hpp>
 #include <Camera.hpp>
 #include <Entity.hpp>
+#include <EntityBVH.hpp>
+#include <ScalpBinding.hpp>
+#include <SimulationCache.hpp>
+#include <SimulationRecorder.hpp>
 #include <Texture.hpp>
 
+// std
+#include <functional>
+#include <memory>
+
 namespace vkr {
 
 class Scene {
@@ -17,23 +26,78 @@ class Scene {
     void loadLights();
     void loadCameraSkybox();
 
+    // Hands the streamed assets that became resident to their entities, acquiring their buffers on
+    // commandBuffer, see AssetLoader. Entities are skipped by the render passes and the simulation
+    // until their mesh or hair is resident, and drawn with a blank texture until their own one is.
+    void updateAssets(VkCommandBuffer commandBuffer);
+    // Blocks until every asset of the scene is resident
+    void finishLoading();
+
     // Getters
-    std::vector<Entity>& getEntities() { return entities; }
-    std::vector<Entity>& getLightEntities() { return lights; }
+    // Entities of the scene, lights included
+    Registry& getRegistry() { return registry; }
+    // Parents entities to one another, see TransformSystem::setParent
+    TransformSystem& getTransformSystem() { return transformSystem; }
+    // World bounds of the meshes and hair, for culling and picking. Entities whose assets become
+    // resident join it at the next update.
+    const EntityBVH& getEntityBVH() const { return entityBVH; }
+    // Entity with the nearest bounds along a ray, NULL_ENTITY if there is none
+    Entity pick(const glm::vec3& origin, const glm::vec3& direction) const { return entityBVH.raycast(origin, direction); }
     Camera& getMainCamera() { return mainCamera; }
+    bool& isSimulating() { return simulationEnabled; }
+
+    // Update, starting with the world transforms of the entities moved since the last one and
+    // ending with the bounds hierarchy
+    void updateScene(float frameTime);
+
+    // Restarts the hair simulations from their rest pose and records every step into filepath
+    void startRecording(const std::string& filepath);
+
+    // Bakes the simulated strands of every frame, one cache per hair entity (see cachePath)
+    void startCacheExport(const std::string& filepath);
+    void finishCacheExport();
+    bool isExportingCache() const { return !cacheWriters.empty(); }
 
-    // Update
-    void updateScene();
+    // Replaces the simulation by the strands baked in the caches, looping over them
+    void playCache(const std::string& filepath);
+    bool isPlayingCache() const { return !caches.empty(); }
+    float getCacheTime() const { return cacheTime; }
 
    private:
-    std::vector<Entity> entities;
-    std::vector<Entity> lights;
+    // Pins the strand roots of a hair entity to the surface of a mesh entity
+    struct ScalpAttachment {
+        Entity hairEntity;
+        Entity meshEntity;
+        std::shared_ptr<const ScalpBinding> binding;  // shared with the recording, if any
+    };
+
+    void attachToScalp(Entity hairEntity, Entity meshEntity);
+    // Steps the hair simulations, or plays back their caches
+    void updateHair(float frameTime);
+    void assignAssets();
+
+    Registry registry;
+    TransformSystem transformSystem;
+    EntityBVH entityBVH;
     std::vector<Texture> textures;
     Camera mainCamera;
 
+    bool simulationEnabled = false;
+    float simulationTime = 0.f;
+    std::unique_ptr<SimulationRecorder> recorder;
+    std::vector<ScalpAttachment> scalpAttachments;
+
+    std::vector<std::unique_ptr<SimulationCacheWriter>> cacheWriters;
+    std::vector<std::unique_ptr<SimulationCache>> caches;
+    float cacheTime = 0.f;
+
     Device& device;
 
     std::shared_ptr<Material> blankMaterial;
+
+    std::unique_ptr<AssetLoader> assetLoader;
+    // Called whenever assets become resident, each returns true once it is done with its entities
+    std::vector<std::function<bool()>> pendingAssets;
 };
 
 }  // namespace vkr
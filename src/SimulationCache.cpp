@@ -0,0 +1,270 @@
+#include <SimulationCache.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vkr {
+
+static constexpr char CACHE_MAGIC[8] = {'V', 'K', 'R', 'C', 'A', 'C', 'H', 'E'};
+static constexpr uint32_t CACHE_VERSION = 1;
+
+static void writeVarint(std::vector<uint8_t> &out, int32_t value) {
+    // Zigzag, so small negative deltas stay small
+    uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    while (zigzag >= 0x80) {
+        out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(zigzag));
+}
+
+static int32_t readVarint(const uint8_t *&in, const uint8_t *end) {
+    uint32_t zigzag = 0;
+    for (uint32_t shift = 0; in < end && shift < 35; shift += 7) {
+        uint8_t byte = *in++;
+        zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        }
+    }
+    throw std::runtime_error("corrupted simulation cache chunk");
+}
+
+SimulationCacheWriter::SimulationCacheWriter(const std::string &filepath, const std::vector<uint32_t> &strandOffsets,
+                                             float precision, uint32_t keyframeInterval)
+    : file{filepath, std::ios::binary} {
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open simulation cache: " + filepath);
+    }
+
+    std::copy(CACHE_MAGIC, CACHE_MAGIC + sizeof(CACHE_MAGIC), header.magic);
+    header.version = CACHE_VERSION;
+    header.particleCount = strandOffsets.empty() ? 0 : strandOffsets.back();
+    header.strandCount = strandOffsets.empty() ? 0 : static_cast<uint32_t>(strandOffsets.size() - 1);
+    header.keyframeInterval = std::max(keyframeInterval, 1u);
+    header.precision = precision;
+
+    // The header is written again by finish(), once the frame count and index offset are known
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(strandOffsets.data()), strandOffsets.size() * sizeof(uint32_t));
+
+    previousQuantized.resize(3 * header.particleCount, 0);
+    writerThread = std::thread(&SimulationCacheWriter::writerLoop, this);
+
+    printf("Exporting simulation cache to \"%s\" (%u points)\n", filepath.c_str(), header.particleCount);
+}
+
+SimulationCacheWriter::~SimulationCacheWriter() {
+    finish();
+}
+
+void SimulationCacheWriter::writeFrame(std::vector<glm::vec3> positions, float time) {
+    if (positions.size() != header.particleCount) {
+        throw std::runtime_error("simulation cache frame does not match the cached point count");
+    }
+
+    {
+        // Blocks while the writer thread is MAX_PENDING_FRAMES behind, so a slow disk holds back the
+        // export instead of growing the queue
+        std::unique_lock<std::mutex> lock(mutex);
+        frameWritten.wait(lock, [this] { return pendingFrames.size() < MAX_PENDING_FRAMES; });
+        pendingFrames.push_back({std::move(positions), time});
+    }
+    frameAvailable.notify_one();
+}
+
+void SimulationCacheWriter::finish() {
+    if (!writerThread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishing = true;
+    }
+    frameAvailable.notify_one();
+    writerThread.join();
+
+    header.frameCount = static_cast<uint32_t>(frames.size());
+    header.indexOffset = static_cast<uint64_t>(file.tellp());
+    file.write(reinterpret_cast<const char *>(frames.data()), frames.size() * sizeof(SimulationCacheFrame));
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+
+    printf("Simulation cache finished: %u frames\n", header.frameCount);
+}
+
+void SimulationCacheWriter::writerLoop() {
+    while (true) {
+        PendingFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameAvailable.wait(lock, [this] { return !pendingFrames.empty() || finishing; });
+            if (pendingFrames.empty()) {
+                return;
+            }
+            frame = std::move(pendingFrames.front());
+            pendingFrames.pop_front();
+        }
+        frameWritten.notify_one();
+
+        encodeFrame(frame);
+    }
+}
+
+void SimulationCacheWriter::encodeFrame(const PendingFrame &frame) {
+    const bool keyframe = frames.size() % header.keyframeInterval == 0;
+    const float invPrecision = 1.f / header.precision;
+
+    encoded.clear();
+    for (uint32_t i = 0; i < header.particleCount; i++) {
+        for (int c = 0; c < 3; c++) {
+            int32_t value = static_cast<int32_t>(std::lround(frame.positions[i][c] * invPrecision));
+            int32_t &previous = previousQuantized[3 * i + c];
+            writeVarint(encoded, keyframe ? value : value - previous);
+            previous = value;
+        }
+    }
+
+    frames.push_back({static_cast<uint64_t>(file.tellp()), static_cast<uint32_t>(encoded.size()), frame.time});
+    file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+}
+
+SimulationCache::SimulationCache(const std::string &filepath) {
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("failed to open simulation cache: " + filepath);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(fileHandle, &fileSize);
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    HANDLE mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping);
+    }
+    CloseHandle(fileHandle);
+#else
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open simulation cache: " + filepath);
+    }
+    struct stat fileStat;
+    size = fstat(fd, &fileStat) == 0 ? static_cast<size_t>(fileStat.st_size) : 0;
+
+    void *mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    data = mapped != MAP_FAILED ? static_cast<const uint8_t *>(mapped) : nullptr;
+    close(fd);
+#endif
+    if (!data) {
+        throw std::runtime_error("failed to map simulation cache: " + filepath);
+    }
+
+    if (size >= sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+    }
+
+    const size_t offsetsSize = (static_cast<size_t>(header.strandCount) + 1) * sizeof(uint32_t);
+    const size_t indexSize = static_cast<size_t>(header.frameCount) * sizeof(SimulationCacheFrame);
+    if (size < sizeof(header) || !std::equal(header.magic, header.magic + sizeof(header.magic), CACHE_MAGIC) ||
+        header.version != CACHE_VERSION || header.keyframeInterval == 0 ||
+        sizeof(header) + offsetsSize > size || header.indexOffset > size || indexSize > size - header.indexOffset) {
+        unmapFile();
+        throw std::runtime_error("invalid simulation cache: " + filepath);
+    }
+
+    strandOffsets.resize(static_cast<size_t>(header.strandCount) + 1);
+    memcpy(strandOffsets.data(), data + sizeof(header), offsetsSize);
+    // The decoder walks the strands through the offsets, they must cover exactly the particles
+    if (strandOffsets.front() != 0 || strandOffsets.back() != header.particleCount ||
+        !std::is_sorted(strandOffsets.begin(), strandOffsets.end())) {
+        unmapFile();
+        throw std::runtime_error("invalid strand offsets in simulation cache: " + filepath);
+    }
+    frames.resize(header.frameCount);
+    memcpy(frames.data(), data + header.indexOffset, indexSize);
+
+    quantized.resize(3 * header.particleCount, 0);
+}
+
+SimulationCache::~SimulationCache() {
+    unmapFile();
+}
+
+void SimulationCache::unmapFile() {
+    if (!data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<uint8_t *>(data), size);
+#endif
+    data = nullptr;
+}
+
+uint32_t SimulationCache::frameAtTime(float time) const {
+    auto next = std::upper_bound(frames.begin(), frames.end(), time,
+                                 [](float t, const SimulationCacheFrame &frame) { return t < frame.time; });
+    return next == frames.begin() ? 0 : static_cast<uint32_t>(next - frames.begin() - 1);
+}
+
+void SimulationCache::decodeFrame(uint32_t frame, std::vector<glm::vec3> &positions) {
+    if (frame >= header.frameCount) {
+        throw std::runtime_error("simulation cache frame out of range");
+    }
+
+    if (frame != decodedFrame) {
+        // Deltas need the previous frame, otherwise restart from the closest keyframe
+        uint32_t first = frame - frame % header.keyframeInterval;
+        if (decodedFrame != UINT32_MAX && decodedFrame >= first && decodedFrame < frame) {
+            first = decodedFrame + 1;
+        }
+        for (uint32_t f = first; f <= frame; f++) {
+            decodeChunk(f);
+        }
+        decodedFrame = frame;
+    }
+
+    positions.resize(header.particleCount);
+    for (uint32_t i = 0; i < header.particleCount; i++) {
+        positions[i] = glm::vec3(static_cast<float>(quantized[3 * i]),
+                                 static_cast<float>(quantized[3 * i + 1]),
+                                 static_cast<float>(quantized[3 * i + 2])) * header.precision;
+    }
+}
+
+void SimulationCache::decodeChunk(uint32_t frame) {
+    const SimulationCacheFrame &chunk = frames[frame];
+    if (chunk.offset > size || chunk.size > size - chunk.offset) {
+        throw std::runtime_error("corrupted simulation cache index");
+    }
+
+    const bool keyframe = frame % header.keyframeInterval == 0;
+    const uint8_t *in = data + chunk.offset;
+    const uint8_t *end = in + chunk.size;
+    for (auto &value : quantized) {
+        int32_t delta = readVarint(in, end);
+        value = keyframe ? delta : value + delta;
+    }
+}
+
+}  // namespace vkr
@@ -0,0 +1,118 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vkr {
+
+// Baked strand points, one chunk per frame.
+//
+// Points are quantized to a fixed precision and stored as zigzag varint deltas against the previous
+// frame, every keyframeInterval frames against zero instead. A frame index at the end of the file
+// gives the offset, size and timestamp of each chunk, so any frame is reached by decoding at most
+// keyframeInterval chunks.
+struct SimulationCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t particleCount;
+    uint32_t strandCount;
+    uint32_t keyframeInterval;
+    float precision;
+    uint32_t frameCount;
+    uint64_t indexOffset;
+};
+
+struct SimulationCacheFrame {
+    uint64_t offset;
+    uint32_t size;
+    float time;
+};
+
+// Encodes and writes the frames on a background thread, writeFrame only copies the points
+class SimulationCacheWriter {
+   public:
+    SimulationCacheWriter(const std::string &filepath, const std::vector<uint32_t> &strandOffsets,
+                          float precision = 1e-4f, uint32_t keyframeInterval = 30);
+    ~SimulationCacheWriter();
+
+    SimulationCacheWriter(const SimulationCacheWriter &) = delete;
+    SimulationCacheWriter &operator=(const SimulationCacheWriter &) = delete;
+
+    // Blocks while the writer thread is too far behind
+    void writeFrame(std::vector<glm::vec3> positions, float time);
+
+    // Waits for the pending frames and writes the frame index. Called by the destructor if needed.
+    void finish();
+
+   private:
+    static constexpr size_t MAX_PENDING_FRAMES = 4;
+
+    struct PendingFrame {
+        std::vector<glm::vec3> positions;
+        float time;
+    };
+
+    void writerLoop();
+    void encodeFrame(const PendingFrame &frame);
+
+    std::ofstream file;
+    SimulationCacheHeader header{};
+    std::vector<SimulationCacheFrame> frames;
+    std::vector<int32_t> previousQuantized;
+    std::vector<uint8_t> encoded;
+
+    std::thread writerThread;
+    std::mutex mutex;
+    std::condition_variable frameAvailable;
+    std::condition_variable frameWritten;  // a pending frame was taken by the writer thread
+    std::deque<PendingFrame> pendingFrames;
+    bool finishing = false;
+};
+
+// Memory mapped cache, only the chunks of the requested frame are touched
+class SimulationCache {
+   public:
+    SimulationCache(const std::string &filepath);
+    ~SimulationCache();
+
+    SimulationCache(const SimulationCache &) = delete;
+    SimulationCache &operator=(const SimulationCache &) = delete;
+
+    // Decodes a frame into positions. Sequential frames only decode their own chunk.
+    void decodeFrame(uint32_t frame, std::vector<glm::vec3> &positions);
+
+    // Last frame whose timestamp is not past time
+    uint32_t frameAtTime(float time) const;
+    uint32_t getDecodedFrame() const { return decodedFrame; }
+
+    uint32_t frameCount() const { return header.frameCount; }
+    uint32_t particleCount() const { return header.particleCount; }
+    float duration() const { return frames.empty() ? 0.f : frames.back().time; }
+    const std::vector<uint32_t> &getStrandOffsets() const { return strandOffsets; }
+
+   private:
+    void unmapFile();
+    void decodeChunk(uint32_t frame);
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    SimulationCacheHeader header{};
+    std::vector<uint32_t> strandOffsets;
+    std::vector<SimulationCacheFrame> frames;
+
+    std::vector<int32_t> quantized;
+    uint32_t decodedFrame = UINT32_MAX;
+};
+
+}  // namespace vkr
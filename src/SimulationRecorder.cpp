@@ -0,0 +1,272 @@
+#include <Hair.hpp>
+#include <SimulationRecorder.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+namespace vkr {
+
+static constexpr char RECORDING_MAGIC[8] = {'V', 'K', 'R', 'S', 'I', 'M', '\0', '\0'};
+static constexpr uint32_t RECORDING_VERSION = 5;
+
+template <typename T>
+static void writeValue(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream &file, T &value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+// Whether count elements of elementSize bytes fit before the end of the file, checked before sizing
+// anything from a count read in it
+static bool fitsInFile(std::ifstream &file, uint64_t fileSize, uint64_t count, size_t elementSize) {
+    std::streamoff position = file.tellg();
+    return position >= 0 && static_cast<uint64_t>(position) <= fileSize &&
+           count <= (fileSize - static_cast<uint64_t>(position)) / elementSize;
+}
+
+static void writeParameters(std::ofstream &file, const SimulationParameters &parameters) {
+    writeValue(file, parameters.gravity);
+    writeValue(file, parameters.damping);
+    writeValue(file, parameters.constraintIterations);
+    writeValue(file, parameters.maxTimestep);
+}
+
+static bool readParameters(std::ifstream &file, SimulationParameters &parameters) {
+    return readValue(file, parameters.gravity) &&
+           readValue(file, parameters.damping) &&
+           readValue(file, parameters.constraintIterations) &&
+           readValue(file, parameters.maxTimestep);
+}
+
+static void writeForces(std::ofstream &file, const ForceField &forces) {
+    writeValue(file, forces.wind);
+    writeValue(file, forces.drag);
+    writeValue(file, forces.turbulence);
+    writeValue(file, forces.turbulenceScale);
+    writeValue(file, forces.turbulenceSpeed);
+    writeValue(file, static_cast<uint32_t>(forces.attractors.size()));
+    for (const auto &attractor : forces.attractors) {
+        writeValue(file, attractor);
+    }
+}
+
+static bool readForces(std::ifstream &file, uint64_t fileSize, ForceField &forces) {
+    uint32_t attractorCount = 0;
+    if (!readValue(file, forces.wind) || !readValue(file, forces.drag) || !readValue(file, forces.turbulence) ||
+        !readValue(file, forces.turbulenceScale) || !readValue(file, forces.turbulenceSpeed) ||
+        !readValue(file, attractorCount) || !fitsInFile(file, fileSize, attractorCount, sizeof(Attractor))) {
+        return false;
+    }
+
+    forces.attractors.resize(attractorCount);
+    for (auto &attractor : forces.attractors) {
+        if (!readValue(file, attractor)) return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void writeArray(std::ofstream &file, const std::vector<T> &values) {
+    writeValue(file, static_cast<uint32_t>(values.size()));
+    file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+static bool readArray(std::ifstream &file, uint64_t fileSize, std::vector<T> &values) {
+    uint32_t count = 0;
+    if (!readValue(file, count) || !fitsInFile(file, fileSize, count, sizeof(T))) return false;
+    values.resize(count);
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(values.data()), count * sizeof(T)));
+}
+
+static void writeScalp(std::ofstream &file, const RecordedScalp &scalp) {
+    writeArray(file, scalp.meshPositions);
+    writeArray(file, scalp.meshIndices);
+    writeArray(file, scalp.binding->getTriangles());
+    writeArray(file, scalp.binding->getBarycentrics());
+    writeArray(file, scalp.binding->getOffsets());
+}
+
+// Also checks the binding only references vertices of the mesh, as evaluating it does not
+static bool readScalp(std::ifstream &file, uint64_t fileSize, RecordedScalp &scalp) {
+    std::vector<uint32_t> triangles;
+    std::vector<glm::vec2> barycentrics;
+    std::vector<glm::vec3> offsets;
+    if (!readArray(file, fileSize, scalp.meshPositions) || !readArray(file, fileSize, scalp.meshIndices) ||
+        !readArray(file, fileSize, triangles) || !readArray(file, fileSize, barycentrics) ||
+        !readArray(file, fileSize, offsets)) {
+        return false;
+    }
+
+    const size_t triangleCount = scalp.meshIndices.size() / 3;
+    if (barycentrics.size() != triangles.size() || offsets.size() != triangles.size() ||
+        std::any_of(triangles.begin(), triangles.end(), [&](uint32_t t) { return t >= triangleCount; }) ||
+        std::any_of(scalp.meshIndices.begin(), scalp.meshIndices.end(),
+                    [&](uint32_t i) { return i >= scalp.meshPositions.size(); })) {
+        return false;
+    }
+    scalp.binding = std::make_shared<ScalpBinding>(std::move(triangles), std::move(barycentrics), std::move(offsets));
+    return true;
+}
+
+SimulationRecorder::SimulationRecorder(const std::string &filepath, const std::vector<SimulationTrack> &tracks)
+    : file{filepath, std::ios::binary} {
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open simulation recording: " + filepath);
+    }
+
+    file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    writeValue(file, RECORDING_VERSION);
+    writeValue(file, static_cast<uint32_t>(tracks.size()));
+    for (const auto &track : tracks) {
+        writeValue(file, static_cast<uint32_t>(track.hairFilepath.size()));
+        file.write(track.hairFilepath.data(), track.hairFilepath.size());
+        writeParameters(file, track.parameters);
+        writeValue(file, static_cast<uint32_t>(track.scalp != nullptr));
+        if (track.scalp) {
+            writeScalp(file, *track.scalp);
+        }
+        scalpTracks.push_back(track.scalp != nullptr);
+    }
+
+    printf("Recording hair simulation to \"%s\" (%zu tracks)\n", filepath.c_str(), tracks.size());
+}
+
+void SimulationRecorder::recordStep(uint32_t track, const SimulationInput &input, const glm::mat4 &scalpTransform,
+                                    uint64_t stateHash) {
+    writeValue(file, track);
+    writeValue(file, input.rootTransform);
+    writeForces(file, input.forces);
+    writeValue(file, input.time);
+    writeValue(file, input.timestep);
+    writeValue(file, static_cast<uint32_t>(input.colliders.size()));
+    for (const auto &collider : input.colliders) {
+        writeValue(file, collider);
+    }
+    if (scalpTracks[track]) {
+        writeValue(file, scalpTransform);
+    }
+    writeValue(file, stateHash);
+}
+
+SimulationReplay::SimulationReplay(const std::string &filepath) : file{filepath, std::ios::binary | std::ios::ate} {
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open simulation recording: " + filepath);
+    }
+    fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    char magic[sizeof(RECORDING_MAGIC)];
+    uint32_t version = 0;
+    uint32_t trackCount = 0;
+    if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), RECORDING_MAGIC) ||
+        !readValue(file, version) || version != RECORDING_VERSION || !readValue(file, trackCount)) {
+        throw std::runtime_error("invalid simulation recording: " + filepath);
+    }
+
+    // Each track starts with the length of its path
+    if (!fitsInFile(file, fileSize, trackCount, sizeof(uint32_t))) {
+        throw std::runtime_error("invalid track count in simulation recording: " + filepath);
+    }
+    tracks.resize(trackCount);
+    for (auto &track : tracks) {
+        uint32_t pathLength = 0;
+        if (!readValue(file, pathLength) || !fitsInFile(file, fileSize, pathLength, 1)) {
+            throw std::runtime_error("truncated simulation recording: " + filepath);
+        }
+        track.hairFilepath.resize(pathLength);
+        uint32_t hasScalp = 0;
+        if (!file.read(&track.hairFilepath[0], pathLength) || !readParameters(file, track.parameters) ||
+            !readValue(file, hasScalp)) {
+            throw std::runtime_error("truncated simulation recording: " + filepath);
+        }
+        if (hasScalp) {
+            auto scalp = std::make_shared<RecordedScalp>();
+            if (!readScalp(file, fileSize, *scalp)) {
+                throw std::runtime_error("invalid scalp in simulation recording: " + filepath);
+            }
+            track.scalp = std::move(scalp);
+        }
+
+        // Only the CPU side of the hair is needed, no device is created for replays
+        Hair::Builder builder;
+        builder.loadHairModel(track.hairFilepath.c_str());
+
+        simulations.push_back(builder.createSimulation());
+        simulations.back()->getParameters() = track.parameters;
+    }
+}
+
+bool SimulationReplay::run() {
+    uint32_t step = 0;
+    double totalTime = 0.0;
+    double minTime = std::numeric_limits<double>::max();
+    double maxTime = 0.0;
+
+    uint32_t track;
+    while (readValue(file, track)) {
+        if (track >= simulations.size()) {
+            throw std::runtime_error("simulation recording references an unknown track");
+        }
+
+        SimulationInput input;
+        uint32_t colliderCount = 0;
+        uint64_t expectedHash;
+        if (!readValue(file, input.rootTransform) || !readForces(file, fileSize, input.forces) || !readValue(file, input.time) ||
+            !readValue(file, input.timestep) || !readValue(file, colliderCount) ||
+            !fitsInFile(file, fileSize, colliderCount, sizeof(ColliderShape))) {
+            throw std::runtime_error("truncated simulation recording");
+        }
+        input.colliders.resize(colliderCount);
+        for (auto &collider : input.colliders) {
+            if (!readValue(file, collider)) {
+                throw std::runtime_error("truncated simulation recording");
+            }
+        }
+
+        const RecordedScalp *scalp = tracks[track].scalp.get();
+        glm::mat4 scalpTransform;
+        if ((scalp && !readValue(file, scalpTransform)) || !readValue(file, expectedHash)) {
+            throw std::runtime_error("truncated simulation recording");
+        }
+        if (scalp) {
+            scalp->binding->evaluate(scalp->meshPositions, scalp->meshIndices, scalpTransform, input.roots);
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        simulations[track]->step(input);
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double stepTime = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+        uint64_t hash = simulations[track]->hashState();
+        printf("step %u (track %u): %.3f ms, hash %016llx\n", step, track, stepTime, static_cast<unsigned long long>(hash));
+
+        if (hash != expectedHash) {
+            printf("Error: state diverged at step %u (track %u): expected %016llx, got %016llx\n",
+                   step, track, static_cast<unsigned long long>(expectedHash), static_cast<unsigned long long>(hash));
+            return false;
+        }
+
+        totalTime += stepTime;
+        minTime = std::min(minTime, stepTime);
+        maxTime = std::max(maxTime, stepTime);
+        step++;
+    }
+
+    if (step == 0) {
+        printf("Recording has no simulation steps\n");
+        return true;
+    }
+
+    printf("Replayed %u steps bit-exact. Step time: avg %.3f ms, min %.3f ms, max %.3f ms\n",
+           step, totalTime / step, minTime, maxTime);
+    return true;
+}
+
+}  // namespace vkr
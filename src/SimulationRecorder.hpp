@@ -0,0 +1,65 @@
+#pragma once
+
+#include <HairSimulation.hpp>
+#include <ScalpBinding.hpp>
+
+// std
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vkr {
+
+// Scalp the roots of a track are bound to. It is recorded once, the steps then only carry the
+// transform of the mesh and replays evaluate the roots again.
+struct RecordedScalp {
+    std::vector<glm::vec3> meshPositions;
+    std::vector<uint32_t> meshIndices;
+    std::shared_ptr<const ScalpBinding> binding;
+};
+
+// Simulated hair of a recording: which groom it was and the solver parameters it ran with
+struct SimulationTrack {
+    std::string hairFilepath;
+    SimulationParameters parameters;
+    std::shared_ptr<const RecordedScalp> scalp;  // null when the roots follow the root transform
+};
+
+// Writes every input fed to the hair solvers, along with the hash of the state each step produced,
+// so that a later build can replay the same steps and check it reaches the exact same states.
+class SimulationRecorder {
+   public:
+    SimulationRecorder(const std::string &filepath, const std::vector<SimulationTrack> &tracks);
+
+    SimulationRecorder(const SimulationRecorder &) = delete;
+    SimulationRecorder &operator=(const SimulationRecorder &) = delete;
+
+    // scalpTransform is the world transform of the scalp mesh of the track, ignored without one.
+    // The roots of input are not recorded, they are evaluated from it.
+    void recordStep(uint32_t track, const SimulationInput &input, const glm::mat4 &scalpTransform, uint64_t stateHash);
+
+   private:
+    std::ofstream file;
+    std::vector<bool> scalpTracks;
+};
+
+// Re-runs a recording without window or device, timing each step and comparing the state hashes
+class SimulationReplay {
+   public:
+    SimulationReplay(const std::string &filepath);
+
+    SimulationReplay(const SimulationReplay &) = delete;
+    SimulationReplay &operator=(const SimulationReplay &) = delete;
+
+    // Returns false at the first step whose state differs from the recorded one
+    bool run();
+
+   private:
+    std::ifstream file;
+    uint64_t fileSize = 0;
+    std::vector<SimulationTrack> tracks;
+    std::vector<std::unique_ptr<HairSimulation>> simulations;
+};
+
+}  // namespace vkr
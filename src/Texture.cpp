@@ -1,93 +1,310 @@
+#include <Profiler.hpp>
 #include <SwapChain.hpp>
 #include <Texture.hpp>
+#include <ThreadPool.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 namespace vkr {
 
-void Texture::Builder::loadImage(const std::string& filepath) {
-    pixels = stbi_load(filepath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+// KTX2 container (Khronos), up to the level index
+struct KTX2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;  // 0 asks the loader to generate the mip chain
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct KTX2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static const uint8_t KTX2_IDENTIFIER[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+// Levels are copied at offsets aligned for any texel block size
+static constexpr VkDeviceSize LEVEL_ALIGNMENT = 16;
+
+static uint32_t fullMipLevels(uint32_t width, uint32_t height) {
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+static VkDeviceSize layerSize(const Texture::Builder& builder) {
+    return static_cast<VkDeviceSize>(builder.texWidth) * builder.texHeight * 4;
+}
+
+// One region per level of a KTX2 texture, or per layer of decoded images
+static std::vector<VkBufferImageCopy> copyRegions(const Texture::Builder& builder) {
+    const uint32_t width = static_cast<uint32_t>(builder.texWidth);
+    const uint32_t height = static_cast<uint32_t>(builder.texHeight);
+    const bool hasLevels = !builder.levelData.empty();
+    std::vector<VkBufferImageCopy> regions(hasLevels ? builder.levelOffsets.size() : builder.layerPaths.size());
+    for (uint32_t i = 0; i < regions.size(); i++) {
+        const uint32_t level = hasLevels ? i : 0;
+        regions[i].bufferOffset = hasLevels ? builder.levelOffsets[i] : i * layerSize(builder);
+        regions[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, hasLevels ? 0 : i, 1};
+        regions[i].imageExtent = {std::max(width >> level, 1u), std::max(height >> level, 1u), 1};
+    }
+    return regions;
+}
 
+// Decodes a layer of the builder into dst, layerSize bytes
+static void decodeLayerInto(const Texture::Builder& builder, uint32_t layer, void* dst) {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(builder.layerPaths[layer].c_str(), &width, &height, &channels, STBI_rgb_alpha);
     if (!pixels) {
         throw std::runtime_error("failed to load texture image!");
     }
+
+    // stb_image decodes into its own allocation, copied once to the range of the layer
+    const bool sameSize = width == builder.texWidth && height == builder.texHeight;
+    if (sameSize) {
+        memcpy(dst, pixels, static_cast<size_t>(layerSize(builder)));
+    }
+    stbi_image_free(pixels);
+    if (!sameSize) {
+        throw std::runtime_error("texture image changed size while loading: " + builder.layerPaths[layer]);
+    }
+}
+
+static bool canSample(Device& device, VkFormat format) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device.physicalDevice(), format, &formatProperties);
+    return formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+void Texture::Builder::loadImage(const std::string& filepath) {
+    PROFILE_FUNCTION();
+    // Only the header for now, the pixels are decoded into the staging memory of the texture
+    layerPaths = {filepath};
+    if (!stbi_info(filepath.c_str(), &texWidth, &texHeight, &texChannels)) {
+        throw std::runtime_error("failed to load texture image!");
+    }
 }
 
 void Texture::Builder::loadCubemap(const std::string& filepath) {
+    PROFILE_FUNCTION();
     std::array<std::string, 6> facePathStrings{{"posx.jpg", "negx.jpg", "posy.jpg", "negy.jpg", "posz.jpg", "negz.jpg"}};
+    layerPaths.clear();
     for (int i = 0; i < 6; i++) {
-        cubemapPixels[i] = stbi_load((filepath + facePathStrings[i]).c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-
-        if (!cubemapPixels[i]) {
+        layerPaths.push_back(filepath + facePathStrings[i]);
+        int faceWidth, faceHeight;
+        if (!stbi_info(layerPaths[i].c_str(), &faceWidth, &faceHeight, &texChannels)) {
             throw std::runtime_error("failed to load texture image!");
         }
+        if (i > 0 && (faceWidth != texWidth || faceHeight != texHeight)) {
+            throw std::runtime_error("cubemap faces of different sizes: " + filepath);
+        }
+        texWidth = faceWidth;
+        texHeight = faceHeight;
     }
 }
 
-Texture::Texture(Device& device, const Texture::Builder& builder) : device{device} {
-    uint32_t numPixels = builder.texWidth * builder.texHeight * 4;
-    VkDeviceSize bufferSize = builder.pixels ? numPixels : numPixels * 6;
-    device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                        stagingBuffer, stagingBufferMemory);
+void Texture::Builder::loadKTX2(const std::string& filepath) {
+    PROFILE_FUNCTION();
+    std::ifstream file{filepath, std::ios::binary | std::ios::ate};
+    if (!file) {
+        throw std::runtime_error("failed to open KTX2 texture: " + filepath);
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    KTX2Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        throw std::runtime_error("not a KTX2 texture: " + filepath);
+    }
+    if (header.supercompressionScheme != 0 || header.vkFormat == VK_FORMAT_UNDEFINED) {
+        throw std::runtime_error("supercompressed KTX2 textures are not supported: " + filepath);
+    }
+    if (header.pixelDepth > 0 || header.layerCount > 0 || header.faceCount != 1) {
+        throw std::runtime_error("only 2D KTX2 textures are supported: " + filepath);
+    }
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 ||
+        header.levelCount > fullMipLevels(header.pixelWidth, header.pixelHeight)) {
+        throw std::runtime_error("invalid KTX2 texture size or level count: " + filepath);
+    }
 
-    void* data;
-    vkMapMemory(device.device(), stagingBufferMemory, 0, bufferSize, 0, &data);
-    if (builder.pixels)
-        memcpy(data, builder.pixels, static_cast<size_t>(bufferSize));
-    else {
-        stbi_uc* imagesData = (stbi_uc*)malloc(bufferSize);
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < numPixels; j++) {
-                imagesData += numPixels * i + j;
-                *imagesData = builder.cubemapPixels[i][j];
-                imagesData -= numPixels * i + j;
-            }
+    std::vector<KTX2Level> levels(std::max(header.levelCount, 1u));
+    if (!file.read(reinterpret_cast<char*>(levels.data()), levels.size() * sizeof(KTX2Level))) {
+        throw std::runtime_error("corrupted KTX2 texture: " + filepath);
+    }
+    for (const KTX2Level& level : levels) {
+        if (level.byteOffset > fileSize || level.byteLength > fileSize - level.byteOffset) {
+            throw std::runtime_error("KTX2 level past the end of the file: " + filepath);
         }
-        memcpy(data, imagesData, static_cast<size_t>(bufferSize));
-        free(imagesData);
     }
-    vkUnmapMemory(device.device(), stagingBufferMemory);
 
-    bool isCubemap = false;
-    if (builder.pixels)
-        stbi_image_free(builder.pixels);
-    else {
-        for (int i = 0; i < 6; i++)
-            stbi_image_free(builder.cubemapPixels[i]);
+    format = static_cast<VkFormat>(header.vkFormat);
+    texWidth = static_cast<int>(header.pixelWidth);
+    texHeight = static_cast<int>(header.pixelHeight);
+    texChannels = 4;
+    generateMipmaps = header.levelCount == 0;
+
+    // The file stores the smallest level first, the levels are kept largest first
+    levelOffsets.resize(levels.size());
+    VkDeviceSize size = 0;
+    for (size_t level = 0; level < levels.size(); level++) {
+        levelOffsets[level] = size;
+        size += (levels[level].byteLength + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+    }
+    levelData.resize(size);
+    for (size_t level = 0; level < levels.size(); level++) {
+        file.seekg(static_cast<std::streamoff>(levels[level].byteOffset));
+        if (!file.read(reinterpret_cast<char*>(levelData.data() + levelOffsets[level]), levels[level].byteLength)) {
+            throw std::runtime_error("corrupted KTX2 texture: " + filepath);
+        }
+    }
+}
 
-        isCubemap = true;
+void Texture::Builder::decodeImages() {
+    PROFILE_FUNCTION();
+    if (!levelData.empty()) return;
+
+    pixels.resize(static_cast<size_t>(layerSize(*this) * layerPaths.size()));
+    for (uint32_t layer = 0; layer < layerPaths.size(); layer++) {
+        decodeLayerInto(*this, layer, pixels.data() + layer * layerSize(*this));
     }
+}
 
-    createImage(builder, VK_FORMAT_R8G8B8A8_SRGB, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                textureImage, textureImageMemory, isCubemap);
+Texture::Texture(Device& device, const Texture::Builder& builder, UploadBatch* uploads) : device{device} {
+    if (uploads) {
+        // Decoded ahead by decodeImages, the batch stages the pixels itself
+        assert((!builder.levelData.empty() || !builder.pixels.empty()) && "Batched textures must be decoded");
+        const bool isCubemap = builder.layerPaths.size() == 6;
+        const bool blitLevels = createTextureImage(builder, isCubemap);
+        const std::vector<uint8_t>& data = builder.levelData.empty() ? builder.pixels : builder.levelData;
+        uploads->copyToImage(data.data(), data.size(), textureImage, copyRegions(builder),
+                             {static_cast<uint32_t>(builder.texWidth), static_cast<uint32_t>(builder.texHeight)}, mipLevels,
+                             isCubemap ? 6 : 1, blitLevels);
+        descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        createTextureImageView(isCubemap);
+        createTextureSampler();
+        return;
+    }
 
-    // could be improved executing asynchronously
-    device.transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, isCubemap);
-    descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    beginUpload(builder);
+    if (builder.pixels.empty()) {
+        for (uint32_t layer = 0; layer < builder.layerPaths.size(); layer++) {
+            decodeLayer(builder, layer);
+        }
+    }
+    endUpload(builder);
+}
+
+void Texture::beginUpload(const Builder& builder) {
+    format = builder.format;
+    VkDeviceSize bufferSize = builder.levelData.empty() ? layerSize(builder) * builder.layerPaths.size() : builder.levelData.size();
+    device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        stagingBuffer, stagingBufferMemory);
+
+    vkMapMemory(device.device(), stagingBufferMemory, 0, bufferSize, 0, &stagingData);
+    if (!builder.levelData.empty()) {
+        memcpy(stagingData, builder.levelData.data(), static_cast<size_t>(bufferSize));
+    } else if (!builder.pixels.empty()) {
+        memcpy(stagingData, builder.pixels.data(), static_cast<size_t>(bufferSize));
+    }
+}
+
+void Texture::decodeLayer(const Builder& builder, uint32_t layer) {
+    PROFILE_FUNCTION();
+    decodeLayerInto(builder, layer, static_cast<stbi_uc*>(stagingData) + layer * layerSize(builder));
+}
 
-    if (!isCubemap)
-        device.copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(builder.texWidth), static_cast<uint32_t>(builder.texHeight));
+void Texture::endUpload(const Builder& builder) {
+    vkUnmapMemory(device.device(), stagingBufferMemory);
+    stagingData = nullptr;
+
+    const uint32_t width = static_cast<uint32_t>(builder.texWidth);
+    const uint32_t height = static_cast<uint32_t>(builder.texHeight);
+    const bool isCubemap = builder.layerPaths.size() == 6;
+    const bool blitLevels = createTextureImage(builder, isCubemap);
+
+    device.transitionImageLayout(textureImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, isCubemap, mipLevels);
+    if (!builder.levelData.empty())
+        device.copyBufferToImageLevels(stagingBuffer, textureImage, width, height, builder.levelOffsets);
+    else if (!isCubemap)
+        device.copyBufferToImage(stagingBuffer, textureImage, width, height);
     else
-        device.copyBufferToCubemap(stagingBuffer, textureImage, static_cast<uint32_t>(builder.texWidth), static_cast<uint32_t>(builder.texHeight), numPixels);
+        device.copyBufferToCubemap(stagingBuffer, textureImage, width, height, static_cast<uint32_t>(layerSize(builder)));
 
-    device.transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, isCubemap);
+    if (blitLevels)
+        device.generateMipmaps(textureImage, width, height, mipLevels, isCubemap ? 6 : 1);
+    else
+        device.transitionImageLayout(textureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                     isCubemap, mipLevels);
     descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-    vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+    device.freeMemory(stagingBufferMemory);
+    stagingBuffer = VK_NULL_HANDLE;
+    stagingBufferMemory = VK_NULL_HANDLE;
 
     createTextureImageView(isCubemap);
     createTextureSampler();
 }
 
+bool Texture::createTextureImage(const Builder& builder, bool isCubemap) {
+    format = builder.format;
+    const uint32_t width = static_cast<uint32_t>(builder.texWidth);
+    const uint32_t height = static_cast<uint32_t>(builder.texHeight);
+
+    // Compressed blocks stay compressed in device memory, with the levels of the file. Levels past
+    // the first are blitted from it for images and KTX2 files without levels, when the device can
+    // filter the format.
+    const bool generatesLevels = builder.levelData.empty() || builder.generateMipmaps;
+    const bool blitLevels = generatesLevels && device.supportsMipmapBlits(format) && fullMipLevels(width, height) > 1;
+    if (blitLevels) {
+        mipLevels = fullMipLevels(width, height);
+    } else {
+        mipLevels = builder.levelData.empty() ? 1 : static_cast<uint32_t>(builder.levelOffsets.size());
+    }
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (blitLevels) usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    createImage(builder, format, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                textureImage, textureImageMemory, isCubemap);
+    return blitLevels;
+}
+
 Texture::~Texture() {
     destroy();
 }
 
 void Texture::destroy() {
+    // Left over when decoding failed
+    if (stagingBuffer) {
+        if (stagingData) vkUnmapMemory(device.device(), stagingBufferMemory);
+        vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
+        device.freeMemory(stagingBufferMemory);
+        stagingBuffer = VK_NULL_HANDLE;
+        stagingData = nullptr;
+    }
     if (descriptorInfo.imageView) {
         vkDestroyImageView(device.device(), descriptorInfo.imageView, nullptr);
         descriptorInfo.imageView = nullptr;
@@ -101,7 +318,7 @@ void Texture::destroy() {
         descriptorInfo.sampler = nullptr;
     }
     if (textureImageMemory) {
-        vkFreeMemory(device.device(), textureImageMemory, nullptr);
+        device.freeMemory(textureImageMemory);
         textureImageMemory = nullptr;
     }
 }
@@ -115,7 +332,7 @@ void Texture::createImage(const Builder& builder, VkFormat format, VkSampleCount
     imageInfo.extent.width = builder.texWidth;
     imageInfo.extent.height = builder.texHeight;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = isCubemap ? 6 : 1;
     imageInfo.format = format;
     imageInfo.samples = numSamples;
@@ -137,29 +354,86 @@ void Texture::createImage(const Builder& builder, VkFormat format, VkSampleCount
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = device.findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(device.device(), &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+    if (device.allocateMemory(allocInfo, imageMemory) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate image memory!");
     }
 
     vkBindImageMemory(device.device(), image, imageMemory, 0);
 }
 
-std::unique_ptr<Texture> Texture::createTextureFromFile(Device& device, const std::string& filepath) {
+Texture::Builder Texture::loadBuilder(Device& device, const std::string& filepath) {
     Builder builder{};
+    std::filesystem::path path{filepath};
+    if (path.extension() == ".ktx2") {
+        builder.loadKTX2(filepath);
+        if (!canSample(device, builder.format)) {
+            throw std::runtime_error("texture format not supported by the device: " + filepath);
+        }
+        return builder;
+    }
+
+    std::filesystem::path compressedPath = path.replace_extension(".ktx2");
+    std::error_code error;
+    if (std::filesystem::exists(compressedPath, error)) {
+        builder.loadKTX2(compressedPath.string());
+        if (canSample(device, builder.format)) {
+            return builder;
+        }
+        printf("Texture format of %s not supported by the device, loading %s\n", compressedPath.string().c_str(),
+               filepath.c_str());
+        builder = Builder{};
+    }
     builder.loadImage(filepath);
+    return builder;
+}
 
-    return std::make_unique<Texture>(device, builder);
+std::vector<std::unique_ptr<Texture>> Texture::createTextures(Device& device, const std::vector<Builder>& builders) {
+    PROFILE_FUNCTION();
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<std::pair<uint32_t, uint32_t>> layers;  // texture and layer of every image to decode
+    for (uint32_t i = 0; i < builders.size(); i++) {
+        textures.push_back(std::unique_ptr<Texture>(new Texture(device)));
+        textures[i]->beginUpload(builders[i]);
+        for (uint32_t layer = 0; layer < builders[i].layerPaths.size(); layer++) {
+            layers.push_back({i, layer});
+        }
+    }
+
+    // Images decode in parallel, each into its range of the mapped staging memory
+    const uint32_t layerCount = static_cast<uint32_t>(layers.size());
+    ThreadPool threadPool{std::max(1u, std::min(layerCount, std::thread::hardware_concurrency()))};
+    threadPool.run(layerCount, [&](uint32_t task, uint32_t) {
+        const auto [texture, layer] = layers[task];
+        textures[texture]->decodeLayer(builders[texture], layer);
+    });
+
+    for (uint32_t i = 0; i < builders.size(); i++) {
+        textures[i]->endUpload(builders[i]);
+    }
+    return textures;
+}
+
+std::unique_ptr<Texture> Texture::createTextureFromFile(Device& device, const std::string& filepath) {
+    return std::move(createTextures(device, {loadBuilder(device, filepath)})[0]);
+}
+
+std::vector<std::unique_ptr<Texture>> Texture::createTexturesFromFiles(Device& device, const std::vector<std::string>& filepaths) {
+    std::vector<Builder> builders;
+    for (const auto& filepath : filepaths) {
+        builders.push_back(loadBuilder(device, filepath));
+    }
+    return createTextures(device, builders);
 }
 
 std::unique_ptr<Texture> Texture::createCubemapFromFile(Device& device, const std::string& filepath) {
     Builder builder{};
     builder.loadCubemap(filepath);
 
-    return std::make_unique<Texture>(device, builder);
+    return std::move(createTextures(device, {builder})[0]);
 }
 
 void Texture::createTextureImageView(bool isCubemap) {
-    descriptorInfo.imageView = SwapChain::createImageView(device, textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, isCubemap);
+    descriptorInfo.imageView = SwapChain::createImageView(device, textureImage, format, VK_IMAGE_ASPECT_COLOR_BIT, isCubemap, mipLevels);
 }
 
 void Texture::createTextureSampler() {
@@ -184,7 +458,7 @@ void Texture::createTextureSampler() {
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(mipLevels);
 
     if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &descriptorInfo.sampler) != VK_SUCCESS) {
         throw std::runtime_error("failed to create texture sampler!");
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Device.hpp>
+#include <UploadBatch.hpp>
 
 // img
 #include <stb_image.h>
@@ -10,22 +11,40 @@
 
 // std
 #include <array>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace vkr {
 class Texture {
    public:
     struct Builder {
-        stbi_uc *pixels;
-        std::array<stbi_uc *, 6> cubemapPixels;
+        // One image, or the six faces of a cubemap
+        std::vector<std::string> layerPaths;
         int texWidth, texHeight, texChannels;
 
+        // Textures loaded from KTX2 keep their format and mip levels, largest first
+        VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+        std::vector<uint8_t> levelData;
+        std::vector<VkDeviceSize> levelOffsets;
+        // Set by KTX2 files without levels, the chain is blitted from the first one
+        bool generateMipmaps = false;
+
+        // Layers decoded ahead of the upload by decodeImages, copied as is to the staging memory
+        std::vector<uint8_t> pixels;
+
         void loadImage(const std::string &filepath);
         void loadCubemap(const std::string &filepath);
+        // 2D textures without supercompression, BC, ETC2 and ASTC formats among others
+        void loadKTX2(const std::string &filepath);
+        // Decodes the layers on the calling thread, nothing to do for KTX2 textures
+        void decodeImages();
     };
 
-    Texture(Device &device, const Builder &builder);
+    // With uploads, the builder must be decoded and the texture is only sampled once the batch has
+    // been acquired. Otherwise it is uploaded before returning.
+    Texture(Device &device, const Builder &builder, UploadBatch *uploads = nullptr);
     ~Texture();
 
     void destroy();
@@ -36,22 +55,47 @@ class Texture {
     void createImage(const Builder &builder, VkFormat format, VkSampleCountFlagBits numSamples,
                      VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
                      VkImage &image, VkDeviceMemory &imageMemory, bool isCubemap = false);
+    // A .ktx2 file next to the image, with the same name, is loaded instead when the device can
+    // sample its format. Images without one get their mip chain generated on the GPU.
     static std::unique_ptr<Texture> createTextureFromFile(Device &device, const std::string &filepath);
+    // Decodes the images of every texture in parallel
+    static std::vector<std::unique_ptr<Texture>> createTexturesFromFiles(Device &device,
+                                                                         const std::vector<std::string> &filepaths);
     static std::unique_ptr<Texture> createCubemapFromFile(Device &device, const std::string &filepath);
+    // Reads the headers of a texture, or the whole KTX2 file, picked as createTextureFromFile does.
+    // Does not touch the device queues, so it can run on any thread.
+    static Builder loadBuilder(Device &device, const std::string &filepath);
     VkImage getTextureImage() { return textureImage; }
+    uint32_t getMipLevels() const { return mipLevels; }
     const VkDescriptorImageInfo &getDescriptorInfo() { return descriptorInfo; }
 
     void createTextureImageView(bool isCubemap = false);
     void createTextureSampler();
 
    private:
+    explicit Texture(Device &device) : device{device} {}
+
+    static std::vector<std::unique_ptr<Texture>> createTextures(Device &device, const std::vector<Builder> &builders);
+
+    // Staging memory is mapped between beginUpload and endUpload. Layers can be decoded from any
+    // thread in between, each writes its own range.
+    void beginUpload(const Builder &builder);
+    void decodeLayer(const Builder &builder, uint32_t layer);
+    void endUpload(const Builder &builder);
+    // Picks the mip levels and creates the image, returns whether the levels past the first are
+    // blitted from it
+    bool createTextureImage(const Builder &builder, bool isCubemap);
+
     Device &device;
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    void *stagingData = nullptr;
+    VkImage textureImage = VK_NULL_HANDLE;
+    VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+    uint32_t mipLevels = 1;
 
-    VkDescriptorImageInfo descriptorInfo;
+    VkDescriptorImageInfo descriptorInfo{};
 };
 }  // namespace vkr
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include <ThreadPool.hpp>
+
+// std
+#include <algorithm>
+
+namespace vkr {
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(uint32_t taskCount, const std::function<void(uint32_t, uint32_t)> &task) {
+    if (taskCount == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        this->task = &task;
+        this->taskCount = taskCount;
+        nextTask.store(0, std::memory_order_relaxed);
+        busyWorkers = static_cast<uint32_t>(workers.size());
+        error = nullptr;
+        generation++;
+    }
+    wakeCondition.notify_all();
+
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock{mutex};
+    doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+    this->task = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::work(uint32_t threadIndex) {
+    uint64_t lastGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            wakeCondition.wait(lock, [&] { return stopping || generation != lastGeneration; });
+            if (stopping) return;
+            lastGeneration = generation;
+        }
+
+        runTasks(threadIndex);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        if (--busyWorkers == 0) {
+            doneCondition.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runTasks(uint32_t threadIndex) {
+    for (uint32_t i = nextTask.fetch_add(1); i < taskCount; i = nextTask.fetch_add(1)) {
+        try {
+            (*task)(i, threadIndex);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (!error) error = std::current_exception();
+        }
+    }
+}
+
+}  // namespace vkr
@@ -0,0 +1,52 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vkr {
+
+// Persistent worker threads running batches of indexed tasks. The calling thread takes part in
+// every batch, so a pool of one thread runs everything inline.
+class ThreadPool {
+   public:
+    // threadCount includes the calling thread, 0 picks one per hardware thread
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+    // Calls task(taskIndex, threadIndex) for every task in [0, taskCount) and returns once all
+    // are done, rethrowing the first exception raised. threadIndex is below threadCount and
+    // unique among the threads running at once, to index per thread resources.
+    void run(uint32_t taskCount, const std::function<void(uint32_t, uint32_t)> &task);
+
+   private:
+    void work(uint32_t threadIndex);
+    void runTasks(uint32_t threadIndex);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    // Current batch, published under the mutex by bumping the generation
+    const std::function<void(uint32_t, uint32_t)> *task = nullptr;
+    uint32_t taskCount = 0;
+    std::atomic<uint32_t> nextTask{0};
+    uint64_t generation = 0;
+    uint32_t busyWorkers = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+};
+
+}  // namespace vkr
@@ -0,0 +1,146 @@
+#include <TriangleBVH.hpp>
+
+// std
+#include <algorithm>
+#include <limits>
+
+namespace vkr {
+
+// Closest point of triangle abc to p, from Ericson's Real-Time Collision Detection (5.1.5).
+// Returns the barycentric weights (v, w) of b and c.
+static glm::vec2 closestOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.f && d2 <= 0.f) return {0.f, 0.f};
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.f && d4 <= d3) return {1.f, 0.f};
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) return {d1 / (d1 - d3), 0.f};
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.f && d5 <= d6) return {0.f, 1.f};
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) return {0.f, d2 / (d2 - d6)};
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f) {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return {1.f - w, w};
+    }
+
+    float denom = 1.f / (va + vb + vc);
+    return {vb * denom, vc * denom};
+}
+
+static float distance2ToBounds(const glm::vec3 &p, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 offset = glm::max(glm::max(boundsMin - p, p - boundsMax), glm::vec3(0.f));
+    return glm::dot(offset, offset);
+}
+
+TriangleBVH::TriangleBVH(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices)
+    : positions{positions}, indices{indices} {
+    const uint32_t count = static_cast<uint32_t>(indices.size() / 3);
+    triangles.resize(count);
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t t = 0; t < count; t++) {
+        triangles[t] = t;
+        centroids[t] = (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]]) / 3.f;
+    }
+
+    nodes.reserve(count > 0 ? 2 * count : 1);
+    nodes.push_back({});
+    build(0, 0, count, centroids);
+}
+
+void TriangleBVH::build(uint32_t node, uint32_t first, uint32_t count, std::vector<glm::vec3> &centroids) {
+    glm::vec3 boundsMin{std::numeric_limits<float>::max()};
+    glm::vec3 boundsMax{-std::numeric_limits<float>::max()};
+    glm::vec3 centroidMin = boundsMin;
+    glm::vec3 centroidMax = boundsMax;
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t t = triangles[i];
+        for (int v = 0; v < 3; v++) {
+            boundsMin = glm::min(boundsMin, positions[indices[3 * t + v]]);
+            boundsMax = glm::max(boundsMax, positions[indices[3 * t + v]]);
+        }
+        centroidMin = glm::min(centroidMin, centroids[t]);
+        centroidMax = glm::max(centroidMax, centroids[t]);
+    }
+    nodes[node].boundsMin = boundsMin;
+    nodes[node].boundsMax = boundsMax;
+
+    if (count <= MAX_LEAF_TRIANGLES) {
+        nodes[node].first = first;
+        nodes[node].count = count;
+        return;
+    }
+
+    // Median split along the widest axis of the centroids
+    glm::vec3 extent = centroidMax - centroidMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    uint32_t half = count / 2;
+    std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+                     [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    uint32_t children = static_cast<uint32_t>(nodes.size());
+    nodes[node].first = children;
+    nodes[node].count = 0;
+    nodes.push_back({});
+    nodes.push_back({});
+    build(children, first, half, centroids);
+    build(children + 1, first + half, count - half, centroids);
+}
+
+TriangleBVH::ClosestPoint TriangleBVH::closestPoint(const glm::vec3 &point) const {
+    ClosestPoint closest{0, glm::vec3{0.f}, glm::vec2{0.f}, std::numeric_limits<float>::max()};
+    if (triangles.empty()) return closest;
+
+    uint32_t stack[64];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node &node = nodes[stack[--stackSize]];
+        if (distance2ToBounds(point, node.boundsMin, node.boundsMax) >= closest.distance2) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                uint32_t t = triangles[i];
+                const glm::vec3 &a = positions[indices[3 * t]];
+                const glm::vec3 &b = positions[indices[3 * t + 1]];
+                const glm::vec3 &c = positions[indices[3 * t + 2]];
+                glm::vec2 barycentrics = closestOnTriangle(point, a, b, c);
+                glm::vec3 position = a + (b - a) * barycentrics.x + (c - a) * barycentrics.y;
+                glm::vec3 offset = point - position;
+                float distance2 = glm::dot(offset, offset);
+                if (distance2 < closest.distance2) {
+                    closest = {t, position, barycentrics, distance2};
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearest child first, so the farthest one is more likely to be culled
+        uint32_t nearChild = node.first;
+        uint32_t farChild = node.first + 1;
+        if (distance2ToBounds(point, nodes[farChild].boundsMin, nodes[farChild].boundsMax) <
+            distance2ToBounds(point, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax)) {
+            std::swap(nearChild, farChild);
+        }
+        stack[stackSize++] = farChild;
+        stack[stackSize++] = nearChild;
+    }
+
+    return closest;
+}
+
+}  // namespace vkr
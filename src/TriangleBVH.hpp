@@ -0,0 +1,50 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace vkr {
+
+// Bounding volume hierarchy over the triangles of an indexed mesh, for closest point queries.
+// Only references the mesh data, which must outlive it and keep its topology.
+class TriangleBVH {
+   public:
+    struct ClosestPoint {
+        uint32_t triangle;
+        glm::vec3 position;
+        glm::vec2 barycentrics;  // weights of the second and third triangle vertices
+        float distance2;
+    };
+
+    TriangleBVH(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices);
+
+    // Safe to call from several threads at once
+    ClosestPoint closestPoint(const glm::vec3 &point) const;
+
+    uint32_t triangleCount() const { return static_cast<uint32_t>(triangles.size()); }
+
+   private:
+    // Leaves have count > 0 and reference triangles[first..first + count], inner nodes have their
+    // children at first and first + 1
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t first;
+        glm::vec3 boundsMax;
+        uint32_t count;
+    };
+
+    static constexpr uint32_t MAX_LEAF_TRIANGLES = 4;
+
+    void build(uint32_t node, uint32_t first, uint32_t count, std::vector<glm::vec3> &centroids);
+
+    const std::vector<glm::vec3> &positions;
+    const std::vector<uint32_t> &indices;
+    std::vector<uint32_t> triangles;
+    std::vector<Node> nodes;
+};
+
+}  // namespace vkr
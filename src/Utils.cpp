@@ -0,0 +1,39 @@
+#include <Utils.hpp>
+
+// std
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace vkr {
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t value = seed;
+    for (size_t i = 0; i < size; i++) {
+        value = (value ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return value;
+}
+
+void writeFileAtomically(const std::string &filepath, std::initializer_list<std::pair<const void *, size_t>> pieces) {
+    const std::string temporaryPath = filepath + ".tmp";
+    {
+        std::ofstream file{temporaryPath, std::ios::binary};
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to write file: " + temporaryPath);
+        }
+        for (const auto &[data, size] : pieces) {
+            if (!file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size))) {
+                throw std::runtime_error("failed to write file: " + temporaryPath);
+            }
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, filepath, error);
+    if (error) {
+        throw std::runtime_error("failed to write file: " + filepath);
+    }
+}
+
+}  // namespace vkr
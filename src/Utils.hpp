@@ -6,7 +6,13 @@
 
 #pragma once
 
+// std
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <initializer_list>
+#include <string>
+#include <utility>
 
 
 namespace vkr {
@@ -23,4 +29,13 @@ void hashCombine(std::size_t& seed, const T& v, const Rest&... rest) {
     (hashCombine(seed, rest), ...);
 };
 
+static constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+
+// FNV-1a, 64 bits. Data in several pieces is hashed by passing the previous value as seed.
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = FNV_OFFSET_BASIS);
+
+// Writes the pieces of data, pointer and size, one after the other. They go to a temporary file
+// renamed over filepath, so an interrupted write never leaves a truncated file.
+void writeFileAtomically(const std::string &filepath, std::initializer_list<std::pair<const void *, size_t>> pieces);
+
 }  // namespace vkr
@@ -11,11 +11,13 @@
 
 namespace vkr {
 
-Window::Window(int w, int h, std::string name) : width{w}, height{h}, windowName{name} {
-    initWindow();
+Window::Window(int w, int h, std::string name, bool headless)
+    : width{w}, height{h}, headless{headless}, windowName{name} {
+    if (!headless) initWindow();
 }
 
 Window::~Window() {
+    if (headless) return;
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -31,6 +33,9 @@ void Window::initWindow() {
 }
 
 void Window::createWindowSurface(VkInstance instance, VkSurfaceKHR *surface) {
+    if (headless) {
+        throw std::runtime_error("headless window has no surface");
+    }
     if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface");
     }
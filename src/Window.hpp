@@ -15,14 +15,15 @@ namespace vkr {
 
 class Window {
    public:
-    // Create window
-    Window(int w, int h, std::string name);
+    // Create window. Headless windows create no GLFW window, only keep the extent to render at.
+    Window(int w, int h, std::string name, bool headless = false);
     ~Window();
 
     Window(const Window &) = delete;
     Window &operator=(const Window &) = delete;
 
     bool shouldClose() { return glfwWindowShouldClose(window); }
+    bool isHeadless() const { return headless; }
     VkExtent2D getExtent() { return {static_cast<uint32_t>(width), static_cast<uint32_t>(height)}; }
     bool wasWindowResized() { return framebufferResized; }
     void resetWindowResizedFlag() { framebufferResized = false; }
@@ -39,8 +40,9 @@ class Window {
     int width;
     int height;
     bool framebufferResized = false;
+    bool headless = false;
 
     std::string windowName;
-    GLFWwindow *window;
+    GLFWwindow *window = nullptr;
 };
 }  // namespace vkr
@@ -5,21 +5,154 @@
 */
 
 #include <Application.hpp>
+#include <Benchmark.hpp>
+#include <Profiler.hpp>
+#include <SimulationRecorder.hpp>
 
 // std
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
-int main() {
-    vkr::Application app{};
+static bool parseTransparencyMode(const char *name, vkr::TransparencyMode &mode) {
+    if (strcmp(name, "opaque") == 0) {
+        mode = vkr::TransparencyMode::Opaque;
+    } else if (strcmp(name, "weighted") == 0) {
+        mode = vkr::TransparencyMode::WeightedBlended;
+    } else if (strcmp(name, "linked-list") == 0) {
+        mode = vkr::TransparencyMode::LinkedList;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string recordPath;
+    std::string replayPath;
+    std::string exportCachePath;
+    std::string playCachePath;
+    uint32_t benchmarkParticles = 0;
+    uint32_t headlessFrames = 0;
+    std::string frameDirectory;
+    std::string benchmarkScene;
+    std::string benchmarkOutput = "benchmark.json";
+    std::string tracePath;
+    int recordingThreads = -1;
+    vkr::TransparencyMode hairTransparency = vkr::TransparencyMode::Opaque;
+    VkDeviceSize oitBudget = vkr::HairTransparency::DEFAULT_LINKED_LIST_BUDGET;
+    vkr::HairShadowSettings hairShadows;
+    bool withUI = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--export-cache") == 0 && i + 1 < argc) {
+            exportCachePath = argv[++i];
+        } else if (strcmp(argv[i], "--play-cache") == 0 && i + 1 < argc) {
+            playCachePath = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headlessFrames = 600;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                headlessFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            }
+        } else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+            frameDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmarkScene = argv[++i];
+        } else if (strcmp(argv[i], "--benchmark-output") == 0 && i + 1 < argc) {
+            benchmarkOutput = argv[++i];
+        } else if (strcmp(argv[i], "--no-ui") == 0) {
+            withUI = false;
+        } else if (strcmp(argv[i], "--recording-threads") == 0 && i + 1 < argc) {
+            recordingThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hair-transparency") == 0 && i + 1 < argc &&
+                   parseTransparencyMode(argv[i + 1], hairTransparency)) {
+            i++;
+        } else if (strcmp(argv[i], "--oit-budget") == 0 && i + 1 < argc) {
+            oitBudget = static_cast<VkDeviceSize>(strtoull(argv[++i], nullptr, 10)) << 20;
+        } else if (strcmp(argv[i], "--shadow-resolution") == 0 && i + 1 < argc) {
+            hairShadows.resolution = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+        } else if (strcmp(argv[i], "--shadow-layers") == 0 && i + 1 < argc) {
+            hairShadows.layerCount = std::min(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)), vkr::HairShadows::MAX_LAYERS);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--benchmark-forces") == 0) {
+            benchmarkParticles = 1000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                benchmarkParticles = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--record <file>] [--replay <file>] [--export-cache <file>] [--play-cache <file>]"
+                      << " [--headless [frames]] [--dump-frames <directory>]"
+                      << " [--benchmark <scene>] [--benchmark-output <file>] [--benchmark-forces [points]]"
+                      << " [--no-ui] [--recording-threads <count>] [--trace <file>]"
+                      << " [--hair-transparency <opaque|weighted|linked-list>] [--oit-budget <MiB>]"
+                      << " [--shadow-resolution <texels>] [--shadow-layers <count>]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Benchmarks always run headless, for the default number of frames unless given
+    if (!benchmarkScene.empty() && headlessFrames == 0) {
+        headlessFrames = 600;
+    }
 
     try {
-        app.run();
+        if (benchmarkParticles > 0) {
+            vkr::benchmarkForceField(benchmarkParticles);
+            return EXIT_SUCCESS;
+        }
+        if (!replayPath.empty()) {
+            vkr::SimulationReplay replay{replayPath};
+            return replay.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        vkr::Application app{headlessFrames > 0, withUI};
+        if (recordingThreads >= 0) {
+            app.setRecordingThreads(static_cast<uint32_t>(recordingThreads));
+        }
+        if (hairTransparency != vkr::TransparencyMode::Opaque) {
+            app.setHairTransparency(hairTransparency, oitBudget);
+        }
+        app.setHairShadows(hairShadows);
+        if (!benchmarkScene.empty()) {
+            vkr::configureBenchmarkScene(app.getScene(), benchmarkScene);
+        }
+        if (!recordPath.empty()) {
+            app.recordSimulation(recordPath);
+        }
+        if (!exportCachePath.empty()) {
+            app.exportSimulationCache(exportCachePath);
+        }
+        if (!playCachePath.empty()) {
+            app.playSimulationCache(playCachePath);
+        }
+        if (headlessFrames > 0) {
+            auto frames = app.runHeadless(headlessFrames, frameDirectory);
+            if (!benchmarkScene.empty()) {
+                vkr::writeBenchmarkResults(benchmarkOutput, benchmarkScene, frames);
+            }
+        } else {
+            app.run();
+        }
+
+        if (!tracePath.empty()) {
+#ifdef VKR_PROFILE
+            vkr::Profiler::writeChromeTrace(tracePath);
+#else
+            std::cerr << "CPU profiling is compiled out, configure with -DVKR_PROFILE=ON to write a trace\n";
+#endif
+        }
     } catch (const std::exception &e) {
         std::cerr << e.what() << '\n';
         return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
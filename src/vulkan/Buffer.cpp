@@ -48,7 +48,7 @@ Buffer::Buffer(
 Buffer::~Buffer() {
     unmap();
     vkDestroyBuffer(device.device(), buffer, nullptr);
-    vkFreeMemory(device.device(), memory, nullptr);
+    device.freeMemory(memory);
 }
 
 /**
@@ -7,6 +7,7 @@
 #include <Device.hpp>
 
 // std headers
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <iostream>
@@ -55,6 +56,12 @@ void DestroyDebugUtilsMessengerEXT(
 
 // class member functions
 Device::Device(Window &window) : _window{window} {
+    if (_window.isHeadless()) {
+        _deviceExtensions.clear();
+    }
+    // Bindless textures, see RenderSystem
+    _deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
     createInstance();
     setupDebugMessenger();
     createSurface();
@@ -71,7 +78,9 @@ Device::~Device() {
         DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(_instance, _surface, nullptr);
+    if (_surface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(_instance, _surface, nullptr);
+    }
     vkDestroyInstance(_instance, nullptr);
 }
 
@@ -86,7 +95,7 @@ void Device::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -170,7 +179,8 @@ VkSampleCountFlagBits Device::getMaxUsableSampleCount() {
 
 void Device::createLogicalDevice() {
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {_queueFamilyindices.graphicsFamily, _queueFamilyindices.presentFamily};
+    std::set<uint32_t> uniqueQueueFamilies = {_queueFamilyindices.graphicsFamily, _queueFamilyindices.presentFamily,
+                                              _queueFamilyindices.transferFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -182,11 +192,26 @@ void Device::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+    _fragmentStores = supportedFeatures.fragmentStoresAndAtomics == VK_TRUE;
+
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics;
+    deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+    // Texture arrays registered into while frames using them are in flight, see isDeviceSuitable
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &indexingFeatures;
 
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -210,6 +235,7 @@ void Device::createLogicalDevice() {
 
     vkGetDeviceQueue(_device, _queueFamilyindices.graphicsFamily, 0, &_graphicsQueue);
     vkGetDeviceQueue(_device, _queueFamilyindices.presentFamily, 0, &_presentQueue);
+    vkGetDeviceQueue(_device, _queueFamilyindices.transferFamily, 0, &_transferQueue);
 }
 
 void Device::createCommandPool() {
@@ -217,11 +243,13 @@ void Device::createCommandPool() {
 }
 
 void Device::createCommandPool(VkCommandPool &commandPool, VkCommandPoolCreateFlags flags) {
-    QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
+    createCommandPool(commandPool, flags, _queueFamilyindices.graphicsFamily);
+}
 
+void Device::createCommandPool(VkCommandPool &commandPool, VkCommandPoolCreateFlags flags, uint32_t queueFamily) {
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+    poolInfo.queueFamilyIndex = queueFamily;
     poolInfo.flags = flags;
 
     if (vkCreateCommandPool(_device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
@@ -229,24 +257,36 @@ void Device::createCommandPool(VkCommandPool &commandPool, VkCommandPoolCreateFl
     }
 }
 
-void Device::createSurface() { _window.createWindowSurface(_instance, &_surface); }
+void Device::createSurface() {
+    if (_window.isHeadless()) return;
+    _window.createWindowSurface(_instance, &_surface);
+}
 
 bool Device::isDeviceSuitable(VkPhysicalDevice device) {
     _queueFamilyindices = findQueueFamilies(device);
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = _window.isHeadless();
+    if (extensionsSupported && !_window.isHeadless()) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    VkPhysicalDeviceFeatures supportedFeatures;
-    vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 supportedFeatures = {};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &indexingFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &supportedFeatures);
+
+    bool bindlessSupported = supportedFeatures.features.shaderSampledImageArrayDynamicIndexing &&
+                             indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound &&
+                             indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+                             indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
 
     return _queueFamilyindices.isComplete() && extensionsSupported && swapChainAdequate &&
-           supportedFeatures.samplerAnisotropy;
+           supportedFeatures.features.samplerAnisotropy && bindlessSupported;
 }
 
 void Device::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
@@ -296,11 +336,13 @@ bool Device::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> Device::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    if (!_window.isHeadless()) {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -367,8 +409,11 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
             indices.graphicsFamily = i;
             indices.graphicsFamilyHasValue = true;
         }
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+        // Headless devices never present, the graphics queue stands in for the present one
+        VkBool32 presentSupport = _window.isHeadless() && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        if (!_window.isHeadless()) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+        }
         if (queueFamily.queueCount > 0 && presentSupport) {
             indices.presentFamily = i;
             indices.presentFamilyHasValue = true;
@@ -380,6 +425,17 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
         i++;
     }
 
+    // Copies run on a transfer only family when there is one, in parallel with the graphics work
+    indices.transferFamily = indices.graphicsFamily;
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if (queueFamilies[family].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+            !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -426,16 +482,24 @@ VkFormat Device::findSupportedFormat(
 }
 
 uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    uint32_t memoryType;
+    if (!findMemoryType(typeFilter, properties, memoryType)) {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    return memoryType;
+}
+
+bool Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &memoryType) {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
     for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
         if ((typeFilter & (1 << i)) &&
             (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+            memoryType = i;
+            return true;
         }
     }
-
-    throw std::runtime_error("failed to find suitable memory type!");
+    return false;
 }
 
 void Device::createBuffer(
@@ -462,13 +526,54 @@ void Device::createBuffer(
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+    if (allocateMemory(allocInfo, bufferMemory) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate vertex buffer memory!");
     }
 
     vkBindBufferMemory(_device, buffer, bufferMemory, 0);
 }
 
+VkResult Device::allocateMemory(const VkMemoryAllocateInfo &allocInfo, VkDeviceMemory &memory) {
+    VkResult result = vkAllocateMemory(_device, &allocInfo, nullptr, &memory);
+    if (result == VK_SUCCESS) {
+        std::lock_guard<std::mutex> lock{_allocationMutex};
+        _allocationSizes[memory] = allocInfo.allocationSize;
+        _allocatedMemory += allocInfo.allocationSize;
+        _peakAllocatedMemory = std::max(_peakAllocatedMemory, _allocatedMemory);
+    }
+    return result;
+}
+
+void Device::freeMemory(VkDeviceMemory memory) {
+    if (memory == VK_NULL_HANDLE) return;
+
+    {
+        std::lock_guard<std::mutex> lock{_allocationMutex};
+        auto allocation = _allocationSizes.find(memory);
+        if (allocation != _allocationSizes.end()) {
+            _allocatedMemory -= allocation->second;
+            _allocationSizes.erase(allocation);
+        }
+    }
+    vkFreeMemory(_device, memory, nullptr);
+}
+
+VkDeviceSize Device::allocationSize(VkDeviceMemory memory) {
+    std::lock_guard<std::mutex> lock{_allocationMutex};
+    auto allocation = _allocationSizes.find(memory);
+    return allocation != _allocationSizes.end() ? allocation->second : 0;
+}
+
+VkDeviceSize Device::allocatedMemory() {
+    std::lock_guard<std::mutex> lock{_allocationMutex};
+    return _allocatedMemory;
+}
+
+VkDeviceSize Device::peakAllocatedMemory() {
+    std::lock_guard<std::mutex> lock{_allocationMutex};
+    return _peakAllocatedMemory;
+}
+
 VkCommandBuffer Device::beginSingleTimeCommands() {
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -501,7 +606,8 @@ void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
     vkFreeCommandBuffers(_device, _commandPool, 1, &commandBuffer);
 }
 
-void Device::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool isCubemap) {
+void Device::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool isCubemap,
+                                   uint32_t mipLevels) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
     VkImageMemoryBarrier barrier{};
@@ -513,7 +619,7 @@ void Device::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout
     barrier.image = image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = mipLevels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = isCubemap ? 6 : 1;
 
@@ -614,11 +720,108 @@ void Device::copyBufferToCubemap(
     endSingleTimeCommands(commandBuffer);
 }
 
-void Device::createImageWithInfo(
+void Device::copyBufferToImageLevels(
+    VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, const std::vector<VkDeviceSize> &levelOffsets) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    std::vector<VkBufferImageCopy> regions(levelOffsets.size());
+    for (uint32_t level = 0; level < regions.size(); level++) {
+        regions[level].bufferOffset = levelOffsets[level];
+        regions[level].bufferRowLength = 0;
+        regions[level].bufferImageHeight = 0;
+        regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[level].imageSubresource.mipLevel = level;
+        regions[level].imageSubresource.baseArrayLayer = 0;
+        regions[level].imageSubresource.layerCount = 1;
+        regions[level].imageOffset = {0, 0, 0};
+        regions[level].imageExtent = {std::max(width >> level, 1u), std::max(height >> level, 1u), 1};
+    }
+
+    vkCmdCopyBufferToImage(
+        commandBuffer,
+        buffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(regions.size()),
+        regions.data());
+    endSingleTimeCommands(commandBuffer);
+}
+
+bool Device::supportsMipmapBlits(VkFormat format) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &formatProperties);
+    const VkFormatFeatureFlags features =
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & features) == features;
+}
+
+void Device::generateMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t layerCount) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    recordMipmaps(commandBuffer, image, width, height, mipLevels, layerCount);
+    endSingleTimeCommands(commandBuffer);
+}
+
+void Device::recordMipmaps(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels,
+                           uint32_t layerCount) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = layerCount;
+
+    int32_t mipWidth = static_cast<int32_t>(width);
+    int32_t mipHeight = static_cast<int32_t>(height);
+    for (uint32_t level = 1; level < mipLevels; level++) {
+        // The previous level is complete, it becomes the source of this one
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, &barrier);
+
+        const int32_t nextWidth = std::max(mipWidth / 2, 1);
+        const int32_t nextHeight = std::max(mipHeight / 2, 1);
+        VkImageBlit blit{};
+        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, layerCount};
+        blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, layerCount};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                       &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                             0, nullptr, 1, &barrier);
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    // The last level was only written
+    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+}
+
+VkMemoryPropertyFlags Device::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    VkDeviceMemory &imageMemory,
+    VkMemoryPropertyFlags preferredProperties) {
     if (vkCreateImage(_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
         throw std::runtime_error("failed to create image!");
     }
@@ -629,15 +832,21 @@ void Device::createImageWithInfo(
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    if (preferredProperties != 0 &&
+        findMemoryType(memRequirements.memoryTypeBits, properties | preferredProperties, allocInfo.memoryTypeIndex)) {
+        properties |= preferredProperties;
+    } else {
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    }
 
-    if (vkAllocateMemory(_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+    if (allocateMemory(allocInfo, imageMemory) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate image memory!");
     }
 
     if (vkBindImageMemory(_device, image, imageMemory, 0) != VK_SUCCESS) {
         throw std::runtime_error("failed to bind image memory!");
     }
+    return properties;
 }
 
 }  // namespace vkr
\ No newline at end of file
@@ -9,7 +9,9 @@
 #include <Window.hpp>
 
 // std lib headers
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace vkr {
@@ -23,6 +25,7 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
+    uint32_t transferFamily;  // dedicated to copies when the device has one, the graphics family otherwise
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
     bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
@@ -51,9 +54,14 @@ class Device {
     VkSurfaceKHR surface() { return _surface; }
     VkQueue graphicsQueue() { return _graphicsQueue; }
     VkQueue presentQueue() { return _presentQueue; }
+    VkQueue transferQueue() { return _transferQueue; }
     VkInstance instance() { return _instance; }
     QueueFamilyIndices queueFamilyIndices() { return _queueFamilyindices; }
     VkSampleCountFlagBits msaaSamples() { return _msaaSamples; }
+    // Fragment shaders writing storage buffers, needed by linked list transparency
+    bool supportsFragmentStores() { return _fragmentStores; }
+    // Without a surface nothing is presented, the swap chain renders into offscreen images
+    bool isHeadless() { return _window.isHeadless(); }
 
     SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(_physicalDevice); }
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -70,21 +78,44 @@ class Device {
         VkDeviceMemory &bufferMemory);
     VkCommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool isCubemap = false);
+    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool isCubemap = false,
+                               uint32_t mipLevels = 1);
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize offset = 0, uint32_t regionCount = 1);
     void copyBufferToImage(
         VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount = 1);
     void copyBufferToCubemap(
         VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t faceSize, uint32_t layerCount = 1);
-
-    void createImageWithInfo(
+    // One region per mip level, each starting at its offset in the buffer
+    void copyBufferToImageLevels(
+        VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, const std::vector<VkDeviceSize> &levelOffsets);
+    // Whether format can be blitted into its own mip chain with linear filtering
+    bool supportsMipmapBlits(VkFormat format);
+    // Fills the levels past the first by successive blits, with level 0 in TRANSFER_DST_OPTIMAL.
+    // Every level ends up in SHADER_READ_ONLY_OPTIMAL.
+    void generateMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t layerCount = 1);
+    // Same as generateMipmaps, recorded on a graphics command buffer
+    void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels,
+                       uint32_t layerCount = 1);
+
+    // Every device allocation goes through these, so the renderer knows how much memory it holds
+    VkResult allocateMemory(const VkMemoryAllocateInfo &allocInfo, VkDeviceMemory &memory);
+    void freeMemory(VkDeviceMemory memory);
+    VkDeviceSize allocatedMemory();
+    VkDeviceSize peakAllocatedMemory();
+    VkDeviceSize allocationSize(VkDeviceMemory memory);
+
+    // Memory with preferredProperties on top of properties is used when the image can live in it,
+    // returns the properties the memory was chosen with
+    VkMemoryPropertyFlags createImageWithInfo(
         const VkImageCreateInfo &imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage &image,
-        VkDeviceMemory &imageMemory);
+        VkDeviceMemory &imageMemory,
+        VkMemoryPropertyFlags preferredProperties = 0);
 
     VkPhysicalDeviceProperties properties;
     void createCommandPool(VkCommandPool &commandPool, VkCommandPoolCreateFlags flags);
+    void createCommandPool(VkCommandPool &commandPool, VkCommandPoolCreateFlags flags, uint32_t queueFamily);
 
    private:
     void createInstance();
@@ -96,6 +127,7 @@ class Device {
     void createCommandPool();
 
     // helper functions
+    bool findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &memoryType);
     bool isDeviceSuitable(VkPhysicalDevice device);
     std::vector<const char *> getRequiredExtensions();
     bool checkValidationLayerSupport();
@@ -112,14 +144,21 @@ class Device {
     VkCommandPool _commandPool;
 
     VkDevice _device;
-    VkSurfaceKHR _surface;
+    VkSurfaceKHR _surface = VK_NULL_HANDLE;
     QueueFamilyIndices _queueFamilyindices;
     VkQueue _graphicsQueue;
     VkQueue _presentQueue;
+    VkQueue _transferQueue;
     VkSampleCountFlagBits _msaaSamples;
+    bool _fragmentStores = false;
+
+    std::mutex _allocationMutex;
+    std::unordered_map<VkDeviceMemory, VkDeviceSize> _allocationSizes;
+    VkDeviceSize _allocatedMemory = 0;
+    VkDeviceSize _peakAllocatedMemory = 0;
 
     const std::vector<const char *> _validationLayers = {"VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char *> _deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    std::vector<const char *> _deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 };
 
 }  // namespace vkr
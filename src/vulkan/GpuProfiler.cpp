@@ -0,0 +1,150 @@
+#include <GpuProfiler.hpp>
+#include <SwapChain.hpp>
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace vkr {
+
+static constexpr uint32_t INVALID_QUERY = UINT32_MAX;
+
+GpuProfiler::GpuProfiler(Device &device, size_t historySize) : device{device}, historySize{historySize} {
+    pendingZones.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    pendingFrameNumbers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    zoneNames.push_back("Frame");
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device.physicalDevice(), &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device.physicalDevice(), &queueFamilyCount, queueFamilies.data());
+
+    const uint32_t validBits = queueFamilies[device.queueFamilyIndices().graphicsFamily].timestampValidBits;
+    if (validBits == 0) {
+        printf("GPU profiler: timestamps are not supported by the graphics queue\n");
+        return;
+    }
+    timestampMask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+    timestampPeriod = device.properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * MAX_ZONES_PER_FRAME * SwapChain::MAX_FRAMES_IN_FLIGHT;
+    if (vkCreateQueryPool(device.device(), &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+GpuProfiler::~GpuProfiler() {
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device.device(), queryPool, nullptr);
+    }
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+    if (!isSupported()) return;
+
+    collect(frameIndex);
+
+    currentFrameIndex = frameIndex;
+    pendingFrameNumbers[frameIndex] = frameNumber++;
+    vkCmdResetQueryPool(commandBuffer, queryPool, 2 * MAX_ZONES_PER_FRAME * frameIndex, 2 * MAX_ZONES_PER_FRAME);
+    frameQuery = beginZone(commandBuffer, "Frame");
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+    if (!isSupported() || currentFrameIndex < 0) return;
+
+    endZone(commandBuffer, frameQuery);
+    currentFrameIndex = -1;
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer commandBuffer, const char *name) {
+    uint32_t query = reserveZone(name);
+    beginZone(commandBuffer, query);
+    return query;
+}
+
+uint32_t GpuProfiler::reserveZone(const char *name) {
+    if (!isSupported() || currentFrameIndex < 0) return INVALID_QUERY;
+
+    auto &zones = pendingZones[currentFrameIndex];
+    if (zones.size() >= MAX_ZONES_PER_FRAME) return INVALID_QUERY;
+
+    uint32_t query = 2 * (MAX_ZONES_PER_FRAME * currentFrameIndex + static_cast<uint32_t>(zones.size()));
+    zones.push_back({findZone(name), query});
+    return query;
+}
+
+void GpuProfiler::beginZone(VkCommandBuffer commandBuffer, uint32_t query) {
+    if (query == INVALID_QUERY) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, query);
+}
+
+void GpuProfiler::endZone(VkCommandBuffer commandBuffer, uint32_t query) {
+    if (query == INVALID_QUERY) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, query + 1);
+}
+
+void GpuProfiler::collect() {
+    for (int frameIndex = 0; frameIndex < SwapChain::MAX_FRAMES_IN_FLIGHT; frameIndex++) {
+        collect(frameIndex);
+    }
+}
+
+void GpuProfiler::collect(int frameIndex) {
+    auto &zones = pendingZones[frameIndex];
+    if (zones.empty()) return;
+
+    Frame frame{pendingFrameNumbers[frameIndex], std::vector<float>(zoneNames.size(), 0.f)};
+    for (const auto &zone : zones) {
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device.device(), queryPool, zone.query, 2, sizeof(timestamps), timestamps,
+                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            continue;
+        }
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+        frame.zoneTimes[zone.zone] += static_cast<float>(ticks * timestampPeriod * 1e-6);
+    }
+    zones.clear();
+
+    history.push_back(std::move(frame));
+    while (history.size() > historySize) {
+        history.pop_front();
+    }
+}
+
+uint32_t GpuProfiler::findZone(const char *name) {
+    for (uint32_t i = 0; i < zoneNames.size(); i++) {
+        if (strcmp(zoneNames[i].c_str(), name) == 0) return i;
+    }
+    zoneNames.push_back(name);
+    return static_cast<uint32_t>(zoneNames.size() - 1);
+}
+
+void GpuProfiler::exportCSV(const std::string &filepath) const {
+    std::ofstream file{filepath};
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open GPU profile for writing: " + filepath);
+    }
+
+    file << "frame";
+    for (const auto &name : zoneNames) {
+        file << "," << name;
+    }
+    file << "\n";
+
+    // Zones seen for the first time in later frames are missing from the earlier rows
+    for (const auto &frame : history) {
+        file << frame.number;
+        for (size_t zone = 0; zone < zoneNames.size(); zone++) {
+            file << "," << (zone < frame.zoneTimes.size() ? frame.zoneTimes[zone] : 0.f);
+        }
+        file << "\n";
+    }
+}
+
+}  // namespace vkr
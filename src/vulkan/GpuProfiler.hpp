@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Device.hpp>
+
+// std
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace vkr {
+
+// Timestamp queries around named zones of the frame command buffers. Each frame in flight has its
+// own range of queries, read back when that frame comes around again, after its fence has been
+// waited on, so reading results never stalls the CPU. Results lag MAX_FRAMES_IN_FLIGHT frames.
+class GpuProfiler {
+   public:
+    static constexpr uint32_t MAX_ZONES_PER_FRAME = 32;
+
+    // Milliseconds spent in each zone of a frame, indexed as getZoneNames, 0 if it did not run
+    struct Frame {
+        uint64_t number;
+        std::vector<float> zoneTimes;
+    };
+
+    GpuProfiler(Device &device, size_t historySize = 1024);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    // Collects the results of the last use of frameIndex, then starts the "Frame" zone, which
+    // endFrame closes on the last command buffer submitted for the frame
+    void beginFrame(VkCommandBuffer commandBuffer, int frameIndex);
+    void endFrame(VkCommandBuffer commandBuffer);
+
+    // Zones may span command buffers as long as they are submitted in order. Returns the query to end it with.
+    uint32_t beginZone(VkCommandBuffer commandBuffer, const char *name);
+    void endZone(VkCommandBuffer commandBuffer, uint32_t query);
+
+    // Zones recorded from worker threads: reserved on the thread that owns the profiler, then begun
+    // and ended from any thread, in command buffers executed in order
+    uint32_t reserveZone(const char *name);
+    void beginZone(VkCommandBuffer commandBuffer, uint32_t query);
+
+    // Reads every pending result, the device must be idle
+    void collect();
+
+    bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+    const std::vector<std::string> &getZoneNames() const { return zoneNames; }
+    const std::deque<Frame> &getHistory() const { return history; }
+
+    // One row per frame of the history, one column per zone
+    void exportCSV(const std::string &filepath) const;
+
+   private:
+    struct PendingZone {
+        uint32_t zone;
+        uint32_t query;  // begin, end is query + 1
+    };
+
+    uint32_t findZone(const char *name);
+    void collect(int frameIndex);
+
+    Device &device;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    double timestampPeriod;  // nanoseconds per tick
+    uint64_t timestampMask;
+
+    std::vector<std::string> zoneNames;
+    std::vector<std::vector<PendingZone>> pendingZones;  // per frame in flight
+    std::vector<uint64_t> pendingFrameNumbers;
+    int currentFrameIndex = -1;
+    uint32_t frameQuery = 0;
+    uint64_t frameNumber = 0;
+
+    std::deque<Frame> history;
+    size_t historySize;
+};
+
+// Profiles its scope, does nothing without a profiler
+class GpuZone {
+   public:
+    GpuZone(GpuProfiler *profiler, VkCommandBuffer commandBuffer, const char *name)
+        : profiler{profiler}, commandBuffer{commandBuffer} {
+        if (profiler) query = profiler->beginZone(commandBuffer, name);
+    }
+    ~GpuZone() {
+        if (profiler) profiler->endZone(commandBuffer, query);
+    }
+
+    GpuZone(const GpuZone &) = delete;
+    GpuZone &operator=(const GpuZone &) = delete;
+
+   private:
+    GpuProfiler *profiler;
+    VkCommandBuffer commandBuffer;
+    uint32_t query = 0;
+};
+
+}  // namespace vkr
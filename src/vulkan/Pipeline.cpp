@@ -6,60 +6,41 @@
 
 #include <Mesh.hpp>
 #include <Pipeline.hpp>
+#include <Profiler.hpp>
 
 // std
 #include <cassert>
-#include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 namespace vkr {
 
 Pipeline::Pipeline(Device& device) : device{device} {}
 
 Pipeline::~Pipeline() {
-    vkDestroyShaderModule(device.device(), vertShaderModule, nullptr);
-    vkDestroyShaderModule(device.device(), fragShaderModule, nullptr);
+    // Shader modules belong to the pipeline cache, shared with other pipelines
     vkDestroyPipeline(device.device(), graphicsPipeline, nullptr);
 }
 
-std::vector<char> Pipeline::readFile(const std::string& filepath) {
-    std::ifstream file{filepath, std::ios::ate | std::ios::binary};
-
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file: " + filepath);
+std::vector<std::shared_ptr<Pipeline>> Pipeline::createGraphicsPipelines(Device& device,
+                                                                         PipelineCache& pipelineCache,
+                                                                         const std::vector<ShaderPaths>& shadersFilepaths,
+                                                                         const std::vector<PipelineConfigInfo>& configInfo,
+                                                                         std::vector<VertexInputDescriptions>& vertexInputDescriptions) {
+    PROFILE_FUNCTION();
+    uint32_t numPipelines = static_cast<uint32_t>(configInfo.size());
+    std::vector<std::shared_ptr<Pipeline>> pipelinesVector(numPipelines);
+    for (auto& pipeline : pipelinesVector) {
+        pipeline = std::make_shared<Pipeline>(device);
     }
 
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-    return buffer;
-}
-
-std::unique_ptr<PipelineSet> Pipeline::createGraphicsPipelines(Device& device,
-                                                               const std::vector<ShaderPaths>& shadersFilepaths,
-                                                               const std::vector<PipelineConfigInfo>& configInfo,
-                                                               std::vector<VertexInputDescriptions>& vertexInputDescriptions) {
-    std::unique_ptr<PipelineSet> pipelines(new PipelineSet(std::make_shared<Pipeline>(device),
-                                                           std::make_shared<Pipeline>(device),
-                                                           std::make_shared<Pipeline>(device)));
-    std::vector<std::shared_ptr<Pipeline>> pipelinesVector = {pipelines->meshes, pipelines->hair, pipelines->skybox};
-    uint32_t numPipelines = static_cast<uint32_t>(pipelinesVector.size());
-
     std::vector<VkGraphicsPipelineCreateInfo> pipelinesInfo(numPipelines);
-    std::vector<VkPipeline> vkPipelines(numPipelines);
     std::vector<VkPipelineVertexInputStateCreateInfo> pipelinesVertexInputInfos(numPipelines);
     std::vector<std::vector<VkPipelineShaderStageCreateInfo>> shaderStages(numPipelines);
-    for (auto shaderStage : shaderStages) {
-        shaderStage.resize(2);
-    }
 
     // set info for each pipeline
-    for (int i = 0; i < numPipelines; i++) {
+    for (uint32_t i = 0; i < numPipelines; i++) {
         auto* currentPipelineConfigInfo = &configInfo[i];
         assert(
             currentPipelineConfigInfo->pipelineLayout != VK_NULL_HANDLE &&
@@ -68,15 +49,9 @@ std::unique_ptr<PipelineSet> Pipeline::createGraphicsPipelines(Device& device,
             currentPipelineConfigInfo->renderPass != VK_NULL_HANDLE &&
             "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-        vkPipelines.push_back(pipelinesVector[i]->graphicsPipeline);
-
-        auto vertCode = readFile(shadersFilepaths[i].vertFilepath);
-        auto fragCode = readFile(shadersFilepaths[i].fragFilepath);
-
-        createShaderModule(device, vertCode, &pipelinesVector[i]->vertShaderModule);
-        createShaderModule(device, fragCode, &pipelinesVector[i]->fragShaderModule);
-
-        createShaderStageInfo(pipelinesVector[i]->vertShaderModule, pipelinesVector[i]->fragShaderModule, shaderStages[i]);
+        VkShaderModule vertShaderModule = pipelineCache.getShaderModule(shadersFilepaths[i].vertFilepath);
+        VkShaderModule fragShaderModule = pipelineCache.getShaderModule(shadersFilepaths[i].fragFilepath);
+        createShaderStageInfo(vertShaderModule, fragShaderModule, shaderStages[i]);
 
         auto* vertexInputDescription = &vertexInputDescriptions[i];
         auto* vertexInputInfo = &pipelinesVertexInputInfos[i];
@@ -109,32 +84,35 @@ std::unique_ptr<PipelineSet> Pipeline::createGraphicsPipelines(Device& device,
         pipelineInfo->basePipelineHandle = VK_NULL_HANDLE;
     }
 
-    if (vkCreateGraphicsPipelines(
+    // One pipeline per thread, drivers compile a batch sequentially. The pipeline cache is
+    // internally synchronized, so all of them share it.
+    std::vector<VkResult> results(numPipelines, VK_SUCCESS);
+    auto createPipeline = [&](uint32_t i) {
+        PROFILE_SCOPE("Create Pipeline");
+        results[i] = vkCreateGraphicsPipelines(
             device.device(),
-            VK_NULL_HANDLE,
-            numPipelines,
-            pipelinesInfo.data(),
+            pipelineCache.getPipelineCache(),
+            1,
+            &pipelinesInfo[i],
             nullptr,
-            vkPipelines.data()) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create graphics pipeline");
+            &pipelinesVector[i]->graphicsPipeline);
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < numPipelines; i++) {
+        threads.emplace_back(createPipeline, i);
+    }
+    createPipeline(0);
+    for (auto& thread : threads) {
+        thread.join();
     }
 
-    pipelines->meshes->graphicsPipeline = vkPipelines[0];
-    pipelines->hair->graphicsPipeline = vkPipelines[1];
-    pipelines->skybox->graphicsPipeline = vkPipelines[2];
-
-    return pipelines;
-}
-
-void Pipeline::createShaderModule(Device& device, const std::vector<char>& code, VkShaderModule* shaderModule) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    if (vkCreateShaderModule(device.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create shader module");
+    for (VkResult result : results) {
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline");
+        }
     }
+
+    return pipelinesVector;
 }
 
 void Pipeline::createShaderStageInfo(VkShaderModule& vertShader,
@@ -7,15 +7,15 @@
 #pragma once
 
 #include <Device.hpp>
+#include <PipelineCache.hpp>
 
 // std
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace vkr {
 
-struct PipelineSet;
-
 struct ShaderPaths {
     std::string vertFilepath;
     std::string fragFilepath;
@@ -55,32 +55,33 @@ class Pipeline {
     void bind(VkCommandBuffer commandBuffer);
 
     static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo, Device& device, bool useMSAA = true);
-    static std::unique_ptr<PipelineSet> createGraphicsPipelines(
+    // One pipeline per config, in the same order
+    static std::vector<std::shared_ptr<Pipeline>> createGraphicsPipelines(
         Device& device,
+        PipelineCache& pipelineCache,
         const std::vector<ShaderPaths>& shadersFilepaths,
         const std::vector<PipelineConfigInfo>& configInfo,
         std::vector<VertexInputDescriptions>& vertexInputDescriptions);
 
    private:
-    static std::vector<char> readFile(const std::string& filepath);
-
-    static void createShaderModule(Device& device, const std::vector<char>& code, VkShaderModule* shaderModule);
     static void createShaderStageInfo(VkShaderModule& vertShader, VkShaderModule& fragShader,
                                       std::vector<VkPipelineShaderStageCreateInfo>& shaderStages);
 
     Device& device;
     VkPipeline graphicsPipeline{nullptr};
-    VkShaderModule vertShaderModule{nullptr};
-    VkShaderModule fragShaderModule{nullptr};
 };
 
 struct PipelineSet {
     std::shared_ptr<Pipeline> meshes;
     std::shared_ptr<Pipeline> hair;
     std::shared_ptr<Pipeline> skybox;
+    // Null when the hair is opaque
+    std::shared_ptr<Pipeline> hairTransparent;
+    std::shared_ptr<Pipeline> hairComposite;
 
-    PipelineSet(std::shared_ptr<Pipeline> meshes, std::shared_ptr<Pipeline> hair, std::shared_ptr<Pipeline> skybox)
-        : meshes{meshes}, hair{hair}, skybox{skybox} {}
+    PipelineSet(std::shared_ptr<Pipeline> meshes, std::shared_ptr<Pipeline> hair, std::shared_ptr<Pipeline> skybox,
+                std::shared_ptr<Pipeline> hairTransparent = nullptr, std::shared_ptr<Pipeline> hairComposite = nullptr)
+        : meshes{meshes}, hair{hair}, skybox{skybox}, hairTransparent{hairTransparent}, hairComposite{hairComposite} {}
 };
 
 }  // namespace vkr
@@ -0,0 +1,145 @@
+#include <PipelineCache.hpp>
+#include <Utils.hpp>
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace vkr {
+
+PipelineCache::PipelineCache(Device &device, const std::string &filepath) : device{device}, filepath{filepath} {
+    std::vector<char> data = loadCacheData();
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(device.device(), &createInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+        // Drivers may still reject data they wrote, start over rather than fail
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        if (vkCreatePipelineCache(device.device(), &createInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+}
+
+PipelineCache::~PipelineCache() {
+    try {
+        save();
+    } catch (const std::exception &e) {
+        printf("Warning: %s\n", e.what());
+    }
+
+    for (auto &module : shaderModules) {
+        vkDestroyShaderModule(device.device(), module.second, nullptr);
+    }
+    vkDestroyPipelineCache(device.device(), pipelineCache, nullptr);
+}
+
+std::vector<char> PipelineCache::readFile(const std::string &filepath) {
+    std::ifstream file{filepath, std::ios::ate | std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file: " + filepath);
+    }
+
+    std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+    return buffer;
+}
+
+PipelineCache::FileHeader PipelineCache::deviceHeader() const {
+    FileHeader header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vendorID = device.properties.vendorID;
+    header.deviceID = device.properties.deviceID;
+    header.driverVersion = device.properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, device.properties.pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+std::vector<char> PipelineCache::loadCacheData() const {
+    std::ifstream file{filepath, std::ios::binary | std::ios::ate};
+    if (!file.is_open()) {
+        return {};
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    FileHeader header{};
+    FileHeader expected = deviceHeader();
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != expected.magic ||
+        header.version != expected.version || header.vendorID != expected.vendorID ||
+        header.deviceID != expected.deviceID || header.driverVersion != expected.driverVersion ||
+        memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        printf("Pipeline cache \"%s\" is from another device or driver, rebuilding it\n", filepath.c_str());
+        return {};
+    }
+
+    if (header.dataSize != fileSize - sizeof(header)) {
+        printf("Pipeline cache \"%s\" is corrupted, rebuilding it\n", filepath.c_str());
+        return {};
+    }
+    std::vector<char> data(header.dataSize);
+    if (!file.read(data.data(), data.size()) || hashBytes(data.data(), data.size()) != header.dataHash) {
+        printf("Pipeline cache \"%s\" is corrupted, rebuilding it\n", filepath.c_str());
+        return {};
+    }
+    return data;
+}
+
+void PipelineCache::save() {
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device.device(), pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+        throw std::runtime_error("failed to get pipeline cache data!");
+    }
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(device.device(), pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to get pipeline cache data!");
+    }
+    data.resize(dataSize);
+
+    FileHeader header = deviceHeader();
+    header.dataSize = dataSize;
+    header.dataHash = hashBytes(data.data(), data.size());
+
+    writeFileAtomically(filepath, {{&header, sizeof(header)}, {data.data(), data.size()}});
+}
+
+VkShaderModule PipelineCache::getShaderModule(const std::string &filepath) {
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(filepath, error);
+
+    std::lock_guard<std::mutex> lock{shaderMutex};
+    auto file = shaderFiles.find(filepath);
+    if (!error && file != shaderFiles.end() && file->second.writeTime == writeTime) {
+        return shaderModules.at(file->second.codeHash);
+    }
+
+    std::vector<char> code = readFile(filepath);
+    uint64_t codeHash = hashBytes(code.data(), code.size());
+    shaderFiles[filepath] = {writeTime, codeHash};
+
+    auto module = shaderModules.find(codeHash);
+    if (module != shaderModules.end()) {
+        return module->second;
+    }
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device.device(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shader module");
+    }
+    shaderModules[codeHash] = shaderModule;
+    return shaderModule;
+}
+
+}  // namespace vkr
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Device.hpp>
+
+// std
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vkr {
+
+// Shared VkPipelineCache persisted to disk between runs, plus the shader modules of every pipeline
+// created so far. Pipeline rebuilds (MSAA toggles, new render passes) then neither read SPIR-V
+// again nor compile it in the driver. Thread safe.
+class PipelineCache {
+   public:
+    // Loads filepath when it was written by the same device and driver, starts empty otherwise
+    PipelineCache(Device &device, const std::string &filepath);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+
+    VkPipelineCache getPipelineCache() { return pipelineCache; }
+
+    // Modules are shared between pipelines and live as long as the cache. A file is read again
+    // only once modified, and files with the same SPIR-V share one module.
+    VkShaderModule getShaderModule(const std::string &filepath);
+
+    // Writes the driver's cache data to disk, also done on destruction
+    void save();
+
+   private:
+    // Prepended to the driver data, which the driver validates itself but only for the device
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    struct ShaderFile {
+        std::filesystem::file_time_type writeTime;
+        uint64_t codeHash;
+    };
+
+    static constexpr uint32_t MAGIC = 0x43504b56;  // "VKPC"
+    static constexpr uint32_t VERSION = 1;
+
+    static std::vector<char> readFile(const std::string &filepath);
+
+    FileHeader deviceHeader() const;
+    std::vector<char> loadCacheData() const;
+
+    Device &device;
+    std::string filepath;
+    VkPipelineCache pipelineCache{VK_NULL_HANDLE};
+
+    std::mutex shaderMutex;
+    std::unordered_map<std::string, ShaderFile> shaderFiles;
+    std::unordered_map<uint64_t, VkShaderModule> shaderModules;
+};
+
+}  // namespace vkr
@@ -4,6 +4,7 @@
 *   Copyright (c) 2020 Brendan Galea
 */
 
+#include <Profiler.hpp>
 #include <Renderer.hpp>
 
 #include <imgui.h>
@@ -13,19 +14,30 @@
 // std
 #include <array>
 #include <cassert>
+#include <cstdio>
 #include <stdexcept>
 
 namespace vkr {
 
-Renderer::Renderer(Window &window, Device &device)
-    : window{window}, device{device} {
+Renderer::Renderer(Window &window, Device &device, bool withUI)
+    : window{window}, device{device}, withUI{withUI} {
     recreateSwapChain();
     createCommandBuffers();
 }
 
 Renderer::~Renderer() { freeCommandBuffers(); }
 
-void Renderer::recreateSwapChain(bool useMSAA) {
+void Renderer::recreateSwapChain(bool useMSAA, TransparencyMode transparencyMode) {
+    if (transparencyMode == TransparencyMode::LinkedList && !device.supportsFragmentStores()) {
+        printf("Linked list transparency needs fragment stores, using weighted blended transparency\n");
+        transparencyMode = TransparencyMode::WeightedBlended;
+    }
+    this->useMSAA = useMSAA;
+    this->transparencyMode = transparencyMode;
+    recreateSwapChain();
+}
+
+void Renderer::recreateSwapChain() {
     auto extent = window.getExtent();
     while (extent.width == 0 || extent.height == 0) {
         extent = window.getExtent();
@@ -34,10 +46,10 @@ void Renderer::recreateSwapChain(bool useMSAA) {
     vkDeviceWaitIdle(device.device());
 
     if (swapChain == nullptr) {
-        swapChain = std::make_unique<SwapChain>(device, extent, useMSAA);
+        swapChain = std::make_unique<SwapChain>(device, extent, useMSAA, withUI, transparencyMode);
     } else {
         std::shared_ptr<SwapChain> oldSwapChain = std::move(swapChain);
-        swapChain = std::make_unique<SwapChain>(device, extent, oldSwapChain, useMSAA);
+        swapChain = std::make_unique<SwapChain>(device, extent, oldSwapChain, useMSAA, withUI, transparencyMode);
 
         if (!oldSwapChain->compareSwapFormats(*swapChain.get())) {
             throw std::runtime_error("Swap chain image(or depth) format has changed!");
@@ -74,6 +86,7 @@ void Renderer::freeCommandBuffers() {
 }
 
 VkCommandBuffer Renderer::beginFrame() {
+    PROFILE_FUNCTION();
     assert(!isFrameStarted && "Can't call beginFrame while already in progress");
 
     if (!acquireNextSwapChainImage()) {
@@ -86,6 +99,7 @@ VkCommandBuffer Renderer::beginFrame() {
 }
 
 void Renderer::endFrame(std::vector<VkCommandBuffer> commandBuffers, bool &wasWindowResized) {
+    PROFILE_FUNCTION();
     assert(isFrameStarted && "Can't call endFrame while frame is not in progress");
 
     auto result = swapChain->submitCommandBuffers(commandBuffers, &currentImageIndex);
@@ -96,7 +110,9 @@ void Renderer::endFrame(std::vector<VkCommandBuffer> commandBuffers, bool &wasWi
         wasWindowResized = true;
 
         // upon recreating the swapchain, the minimum amount of image views might have changed
-        ImGui_ImplVulkan_SetMinImageCount(device.getSwapChainSupport().capabilities.minImageCount + 1);
+        if (withUI) {
+            ImGui_ImplVulkan_SetMinImageCount(device.getSwapChainSupport().capabilities.minImageCount + 1);
+        }
 
     } else if (result != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image!");
@@ -125,7 +141,8 @@ void Renderer::beginSwapChainRenderPass(VkCommandBuffer &commandBuffer,
                                         VkRenderPass renderPass,
                                         VkFramebuffer framebuffer,
                                         const std::vector<VkClearValue> &clearValues,
-                                        bool isFirstPass) {
+                                        bool isFirstPass,
+                                        VkSubpassContents contents) {
     if (isFirstPass) {
         assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
         assert(
@@ -144,7 +161,8 @@ void Renderer::beginSwapChainRenderPass(VkCommandBuffer &commandBuffer,
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+    if (contents != VK_SUBPASS_CONTENTS_INLINE) return;
 
     VkViewport viewport{};
     viewport.x = 0.0f;
@@ -158,11 +176,13 @@ void Renderer::beginSwapChainRenderPass(VkCommandBuffer &commandBuffer,
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 
-void Renderer::beginSwapChainRenderPass(VkCommandBuffer &commandBuffer) {
+void Renderer::beginSwapChainRenderPass(VkCommandBuffer &commandBuffer, VkSubpassContents contents) {
     beginSwapChainRenderPass(commandBuffer,
                              swapChain->getRenderPass(),
                              swapChain->getFrameBuffer(currentImageIndex),
-                             std::vector<VkClearValue>({{0.01f, 0.01f, 0.01f, 1.0f}, {1.0f, 0.f}}));
+                             swapChain->getClearValues(),
+                             true,
+                             contents);
 }
 
 void Renderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer, bool isFirstPass) {
@@ -18,7 +18,8 @@
 namespace vkr {
 class Renderer {
    public:
-    Renderer(Window &window, Device &device);
+    // With a UI, the swap chain render pass ends with its UI subpass
+    Renderer(Window &window, Device &device, bool withUI = false);
     ~Renderer();
 
     Renderer(const Renderer &) = delete;
@@ -29,6 +30,7 @@ class Renderer {
     uint32_t getSwapChainImageCount() const { return static_cast<uint32_t>(swapChain->imageCount()); }
     std::shared_ptr<SwapChain> getSwapChain() { return swapChain; }
     bool isFrameInProgress() const { return isFrameStarted; }
+    bool hasUI() const { return withUI; }
 
     VkCommandBuffer getCurrentCommandBuffer(bool requireSync = true) const {
         if (requireSync)
@@ -42,6 +44,8 @@ class Renderer {
         return currentFrameIndex;
     }
     int getImageIndex() const { return currentImageIndex; }
+    VkFramebuffer getCurrentFramebuffer() const { return swapChain->getFrameBuffer(currentImageIndex); }
+    VkExtent2D getSwapChainExtent() const { return swapChain->getSwapChainExtent(); }
 
     VkCommandBuffer beginFrame();
     void endFrame(std::vector<VkCommandBuffer> commandBuffers, bool &wasWindowResized);
@@ -51,14 +55,19 @@ class Renderer {
                                   VkRenderPass renderPass,
                                   VkFramebuffer framebuffer,
                                   const std::vector<VkClearValue> &clearValues,
-                                  bool isFirstPass = true);
-    void beginSwapChainRenderPass(VkCommandBuffer &commandBuffer);
+                                  bool isFirstPass = true,
+                                  VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+    // With secondary command buffer contents, these set their own viewport and scissor
+    void beginSwapChainRenderPass(VkCommandBuffer &commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
     void endSwapChainRenderPass(VkCommandBuffer commandBuffer, bool isFirstPass = true);
     bool acquireNextSwapChainImage();
     void createCommandBuffers(std::vector<VkCommandBuffer> &commandBuffers,
                               VkCommandPool commandPool,
                               uint32_t commandBufferCount = static_cast<uint32_t>(SwapChain::MAX_FRAMES_IN_FLIGHT));
-    void recreateSwapChain(bool useMSAA = true);
+    // Keeps the MSAA and transparency settings of the current swap chain
+    void recreateSwapChain();
+    // Linked list transparency falls back to weighted blended on devices without fragment stores
+    void recreateSwapChain(bool useMSAA, TransparencyMode transparencyMode);
 
    private:
     void createCommandBuffers();
@@ -66,6 +75,9 @@ class Renderer {
 
     Window &window;
     Device &device;
+    bool withUI;
+    bool useMSAA = true;
+    TransparencyMode transparencyMode = TransparencyMode::Opaque;
     std::shared_ptr<SwapChain> swapChain;
     std::vector<VkCommandBuffer> commandBuffers;
 
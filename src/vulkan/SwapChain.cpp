@@ -4,6 +4,7 @@
 *   Copyright (c) 2020 Brendan Galea
 */
 
+#include <Profiler.hpp>
 #include <SwapChain.hpp>
 
 // std
@@ -17,29 +18,55 @@
 
 namespace vkr {
 
-SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent, bool useMSAA)
-    : device{deviceRef}, windowExtent{extent} {
+SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent, bool useMSAA, bool uiSubpass, TransparencyMode transparencyMode)
+    : device{deviceRef}, windowExtent{extent}, uiSubpass{uiSubpass}, transparencyMode{transparencyMode} {
     init(useMSAA);
 }
 
 SwapChain::SwapChain(
-    Device &deviceRef, VkExtent2D extent, std::shared_ptr<SwapChain> previous, bool useMSAA)
-    : device{deviceRef}, windowExtent{extent}, oldSwapChain{previous} {
+    Device &deviceRef, VkExtent2D extent, std::shared_ptr<SwapChain> previous, bool useMSAA, bool uiSubpass,
+    TransparencyMode transparencyMode)
+    : device{deviceRef}, windowExtent{extent}, uiSubpass{uiSubpass}, transparencyMode{transparencyMode}, oldSwapChain{previous} {
     init(useMSAA);
     oldSwapChain = nullptr;
 }
 
 void SwapChain::init(bool useMSAA) {
+    this->useMSAA = useMSAA;
     swapChainAttachments.clear();
-    createSwapChain();
-    createImageViews(); // Swap chain image views to present (before imgui)
+    if (device.isHeadless()) {
+        createOffscreenImages();
+    } else {
+        createSwapChain();
+    }
+    createImageViews(); // Swap chain image views to present
     if (useMSAA) createColorResources(); // image views for MSAA to resolve
     createDepthResources(useMSAA); // depth views
+    if (transparencyMode == TransparencyMode::WeightedBlended) createTransparencyResources();
     createRenderPass(useMSAA);
     createFramebuffers();
     createSyncObjects();
 }
 
+VkDeviceSize SwapChain::getTransparencyMemory() {
+    return device.allocationSize(accumImageMemory) + device.allocationSize(revealageImageMemory);
+}
+
+SwapChain::AttachmentMemory SwapChain::getAttachmentMemory() {
+    AttachmentMemory memory{0, 0, 0};
+    for (VkDeviceMemory attachmentMemory : attachmentMemories) {
+        memory.allocated += device.allocationSize(attachmentMemory);
+    }
+    memory.committed = memory.allocated;
+    for (VkDeviceMemory lazyMemory : lazyAttachmentMemories) {
+        VkDeviceSize committed;
+        vkGetDeviceMemoryCommitment(device.device(), lazyMemory, &committed);
+        memory.committed -= device.allocationSize(lazyMemory) - committed;
+    }
+    memory.unshared = memory.allocated * imageCount();
+    return memory;
+}
+
 SwapChain::~SwapChain() {
     for (auto imageView : swapChainImageViews) {
         vkDestroyImageView(device.device(), imageView, nullptr);
@@ -51,17 +78,26 @@ SwapChain::~SwapChain() {
         swapChain = nullptr;
     }
 
-    for (int i = 0; i < depthImages.size(); i++) {
-        vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-        vkDestroyImage(device.device(), depthImages[i], nullptr);
-        vkFreeMemory(device.device(), depthImageMemories[i], nullptr);
+    for (int i = 0; i < offscreenImageMemories.size(); i++) {
+        vkDestroyImage(device.device(), swapChainImages[i], nullptr);
+        device.freeMemory(offscreenImageMemories[i]);
     }
 
-    for (int i = 0; i < colorImages.size(); i++) {
-        vkDestroyImageView(device.device(), colorImageViews[i], nullptr);
-        vkDestroyImage(device.device(), colorImages[i], nullptr);
-        vkFreeMemory(device.device(), colorImageMemories[i], nullptr);
-    }
+    vkDestroyImageView(device.device(), depthImageView, nullptr);
+    vkDestroyImage(device.device(), depthImage, nullptr);
+    device.freeMemory(depthImageMemory);
+
+    vkDestroyImageView(device.device(), colorImageView, nullptr);
+    vkDestroyImage(device.device(), colorImage, nullptr);
+    device.freeMemory(colorImageMemory);
+
+    vkDestroyImageView(device.device(), accumImageView, nullptr);
+    vkDestroyImage(device.device(), accumImage, nullptr);
+    device.freeMemory(accumImageMemory);
+
+    vkDestroyImageView(device.device(), revealageImageView, nullptr);
+    vkDestroyImage(device.device(), revealageImage, nullptr);
+    device.freeMemory(revealageImageMemory);
 
     for (auto framebuffer : swapChainFramebuffers) {
         vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
@@ -78,13 +114,23 @@ SwapChain::~SwapChain() {
 }
 
 VkResult SwapChain::acquireNextImage(uint32_t *imageIndex) {
-    vkWaitForFences(
-        device.device(),
-        1,
-        &inFlightFences[currentFrame],
-        VK_TRUE,
-        std::numeric_limits<uint64_t>::max());
+    {
+        PROFILE_SCOPE("Wait Frame Fence");
+        vkWaitForFences(
+            device.device(),
+            1,
+            &inFlightFences[currentFrame],
+            VK_TRUE,
+            std::numeric_limits<uint64_t>::max());
+    }
+
+    if (device.isHeadless()) {
+        // One offscreen image per frame in flight, the fence above guarantees it is not in use
+        *imageIndex = static_cast<uint32_t>(currentFrame);
+        return VK_SUCCESS;
+    }
 
+    PROFILE_SCOPE("Acquire Image");
     VkResult result = vkAcquireNextImageKHR(
         device.device(),
         swapChain,
@@ -98,6 +144,7 @@ VkResult SwapChain::acquireNextImage(uint32_t *imageIndex) {
 
 VkResult SwapChain::submitCommandBuffers(const std::vector<VkCommandBuffer> &buffers, uint32_t *imageIndex) {
     if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
+        PROFILE_SCOPE("Wait Image Fence");
         vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
     }
     imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
@@ -107,7 +154,7 @@ VkResult SwapChain::submitCommandBuffers(const std::vector<VkCommandBuffer> &buf
 
     VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = device.isHeadless() ? 0 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
@@ -115,13 +162,22 @@ VkResult SwapChain::submitCommandBuffers(const std::vector<VkCommandBuffer> &buf
     submitInfo.pCommandBuffers = buffers.data();
 
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = device.isHeadless() ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-    if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-        VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    {
+        // Closed before presenting, which has its own zone for the vsync waits
+        PROFILE_SCOPE("Submit");
+        vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
+        if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+    }
+
+    if (device.isHeadless()) {
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        return VK_SUCCESS;
     }
 
     VkPresentInfoKHR presentInfo = {};
@@ -136,7 +192,11 @@ VkResult SwapChain::submitCommandBuffers(const std::vector<VkCommandBuffer> &buf
 
     presentInfo.pImageIndices = imageIndex;
 
-    auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+    VkResult result;
+    {
+        PROFILE_SCOPE("Present");
+        result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+    }
 
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
@@ -204,7 +264,36 @@ void SwapChain::createSwapChain() {
     swapChainExtent = extent;
 }
 
-VkImageView SwapChain::createImageView(Device &device, VkImage image, VkFormat format, VkImageAspectFlagBits aspectMask, bool isCubemap) {
+void SwapChain::createOffscreenImages() {
+    // RGBA so frames read back from these can be written out as they are
+    swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    swapChainExtent = windowExtent;
+
+    swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreenImageMemories.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = swapChainExtent.width;
+        imageInfo.extent.height = swapChainExtent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = swapChainImageFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i],
+                                   offscreenImageMemories[i]);
+    }
+}
+
+VkImageView SwapChain::createImageView(Device &device, VkImage image, VkFormat format, VkImageAspectFlagBits aspectMask, bool isCubemap,
+                                       uint32_t mipLevels) {
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = image;
@@ -212,7 +301,7 @@ VkImageView SwapChain::createImageView(Device &device, VkImage image, VkFormat f
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = aspectMask;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = isCubemap ? 6 : 1;
 
@@ -233,17 +322,21 @@ void SwapChain::createImageViews() {
 }
 
 void SwapChain::createRenderPass(bool useMSAA) {
+    // Headless frames are read back right after the pass, the others presented
+    const VkImageLayout outputLayout =
+        device.isHeadless() ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    const VkSampleCountFlagBits samples = useMSAA ? device.msaaSamples() : VK_SAMPLE_COUNT_1_BIT;
+
     VkAttachmentDescription colorAttachment = {};
     colorAttachment.format = getSwapChainImageFormat();
-    colorAttachment.samples = useMSAA ? device.msaaSamples() : VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.samples = samples;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    // Multisampled color is resolved within the pass, only the resolved image is kept
+    colorAttachment.storeOp = useMSAA ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-    // Since we are going to add an ImGui render pass, we are not presenting yet (VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = useMSAA ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : outputLayout;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
@@ -251,7 +344,7 @@ void SwapChain::createRenderPass(bool useMSAA) {
 
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = findDepthFormat();
-    depthAttachment.samples = useMSAA ? device.msaaSamples() : VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.samples = samples;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -263,10 +356,16 @@ void SwapChain::createRenderPass(bool useMSAA) {
     depthAttachmentRef.attachment = 1;
     depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    VkSubpassDescription subpass = {};
+    // Single sampled image the frame ends up in, where the UI is drawn
+    VkAttachmentReference outputAttachmentRef = colorAttachmentRef;
+
     std::vector<VkAttachmentDescription> attachments = {colorAttachment, depthAttachment};
     swapChainAttachments.push_back(swapChainImageViews);
-    swapChainAttachments.push_back(depthImageViews);
+    swapChainAttachments.push_back(std::vector<VkImageView>(imageCount(), depthImageView));
+    clearValues = {{}, {}};
+    clearValues[0].color = {{0.01f, 0.01f, 0.01f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    VkAttachmentReference resolveAttachmentRef = {};
     if (useMSAA) {
         VkAttachmentDescription colorAttachmentResolve{};
         colorAttachmentResolve.format = getSwapChainImageFormat();
@@ -276,44 +375,179 @@ void SwapChain::createRenderPass(bool useMSAA) {
         colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachmentResolve.finalLayout = outputLayout;
 
-        // same as above if using MSAA
-        colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentReference resolveAttachmentRef = {};
         resolveAttachmentRef.attachment = 2;
         resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        outputAttachmentRef = resolveAttachmentRef;
 
-        subpass.pResolveAttachments = &resolveAttachmentRef;
         swapChainAttachments.push_back(swapChainAttachments[0]);
-        swapChainAttachments[0] = colorImageViews;
+        swapChainAttachments[0] = std::vector<VkImageView>(imageCount(), colorImageView);
         attachments.push_back(colorAttachmentResolve);
+        clearValues.push_back({});
     }
 
+    // Weighted blended transparency sums the weighted colors in accum and multiplies the
+    // transmittances in revealage, both cleared and only read by the composite subpass
+    VkAttachmentReference transparencyAttachmentRefs[2] = {};
+    VkAttachmentReference transparencyInputRefs[2] = {};
+    if (transparencyMode == TransparencyMode::WeightedBlended) {
+        VkAttachmentDescription transparencyAttachment{};
+        transparencyAttachment.samples = samples;
+        transparencyAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        transparencyAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        transparencyAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        transparencyAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        transparencyAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        transparencyAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        for (uint32_t i = 0; i < 2; i++) {
+            transparencyAttachment.format = i == 0 ? ACCUM_FORMAT : REVEALAGE_FORMAT;
+            transparencyAttachmentRefs[i].attachment = static_cast<uint32_t>(attachments.size());
+            transparencyAttachmentRefs[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            transparencyInputRefs[i].attachment = transparencyAttachmentRefs[i].attachment;
+            transparencyInputRefs[i].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            attachments.push_back(transparencyAttachment);
+        }
+        swapChainAttachments.push_back(std::vector<VkImageView>(imageCount(), accumImageView));
+        swapChainAttachments.push_back(std::vector<VkImageView>(imageCount(), revealageImageView));
+        clearValues.push_back({});
+        clearValues.back().color = {{0.f, 0.f, 0.f, 0.f}};
+        clearValues.push_back({});
+        clearValues.back().color = {{1.f, 0.f, 0.f, 0.f}};
+    }
+
+    VkSubpassDescription subpass = {};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    std::vector<VkSubpassDescription> subpasses = {subpass};
+
+    // Transparent hair is depth tested against the scene without writing depth. Linked lists are
+    // written to storage buffers, the scene color is left alone until the composite.
+    uint32_t preservedColor = 0;
+    VkSubpassDescription transparentSubpass = {};
+    transparentSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    transparentSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+    if (transparencyMode == TransparencyMode::WeightedBlended) {
+        transparentSubpass.colorAttachmentCount = 2;
+        transparentSubpass.pColorAttachments = transparencyAttachmentRefs;
+    }
+    transparentSubpass.preserveAttachmentCount = 1;
+    transparentSubpass.pPreserveAttachments = &preservedColor;
+
+    VkSubpassDescription compositeSubpass = {};
+    compositeSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    compositeSubpass.colorAttachmentCount = 1;
+    compositeSubpass.pColorAttachments = &colorAttachmentRef;
+    if (transparencyMode == TransparencyMode::WeightedBlended) {
+        compositeSubpass.inputAttachmentCount = 2;
+        compositeSubpass.pInputAttachments = transparencyInputRefs;
+    }
 
-    VkSubpassDependency dependency = {};
-    dependency.dstSubpass = 0;
-    dependency.dstAccessMask =
+    if (hasTransparency()) {
+        subpasses.push_back(transparentSubpass);
+        subpasses.push_back(compositeSubpass);
+    }
+    // Multisampled color is resolved by the last subpass drawing the scene
+    if (useMSAA) subpasses.back().pResolveAttachments = &resolveAttachmentRef;
+    const uint32_t sceneSubpassCount = static_cast<uint32_t>(subpasses.size());
+
+    VkSubpassDescription uiSubpassDescription = {};
+    uiSubpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    uiSubpassDescription.colorAttachmentCount = 1;
+    uiSubpassDescription.pColorAttachments = &outputAttachmentRef;
+    if (uiSubpass) subpasses.push_back(uiSubpassDescription);
+
+    // The shared color and depth attachments are written by the previous frame too, which must be
+    // done with them before they are cleared
+    std::vector<VkSubpassDependency> dependencies(1);
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].dstAccessMask =
         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    dependency.dstStageMask =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.srcAccessMask = 0;
-    dependency.srcStageMask =
+    dependencies[0].dstStageMask =
         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].srcAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].srcStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    if (transparencyMode == TransparencyMode::WeightedBlended) {
+        // Same for the transparency targets, also read by the previous composite
+        VkSubpassDependency targetsDependency = {};
+        targetsDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        targetsDependency.dstSubpass = TRANSPARENT_SUBPASS;
+        targetsDependency.srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        targetsDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        targetsDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        targetsDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies.push_back(targetsDependency);
+    }
+
+    if (hasTransparency()) {
+        VkSubpassDependency depthDependency = {};
+        depthDependency.srcSubpass = 0;
+        depthDependency.dstSubpass = TRANSPARENT_SUBPASS;
+        depthDependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        depthDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+        depthDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependencies.push_back(depthDependency);
+
+        // Each composited pixel only reads the layers of that pixel
+        VkSubpassDependency layersDependency = {};
+        layersDependency.srcSubpass = TRANSPARENT_SUBPASS;
+        layersDependency.dstSubpass = COMPOSITE_SUBPASS;
+        layersDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (transparencyMode == TransparencyMode::WeightedBlended) {
+            layersDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            layersDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            layersDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+        } else {
+            layersDependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            layersDependency.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            layersDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        layersDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependencies.push_back(layersDependency);
+
+        // The composite blends over the scene color
+        VkSubpassDependency colorDependency = {};
+        colorDependency.srcSubpass = 0;
+        colorDependency.dstSubpass = COMPOSITE_SUBPASS;
+        colorDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        colorDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        colorDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        colorDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        colorDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependencies.push_back(colorDependency);
+    }
+
+    if (uiSubpass) {
+        // The UI blends over the scene (or its resolve), pixel by pixel, so tilers keep it on chip
+        VkSubpassDependency uiDependency = {};
+        uiDependency.srcSubpass = sceneSubpassCount - 1;
+        uiDependency.dstSubpass = getUISubpass();
+        uiDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        uiDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        uiDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        uiDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        uiDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependencies.push_back(uiDependency);
+    }
 
     VkRenderPassCreateInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
     renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+    renderPassInfo.pSubpasses = subpasses.data();
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
     if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass!");
@@ -358,30 +592,30 @@ void SwapChain::createFramebuffers() {
 void SwapChain::createColorResources() {
     VkFormat colorFormat = swapChainImageFormat;
 
-    VkExtent2D swapChainExtent = getSwapChainExtent();
-
-    createImages(swapChainExtent.width, swapChainExtent.height, 1, device.msaaSamples(),
-                 colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImages, colorImageMemories, colorImageViews);
-
-    for (int i = 0; i < colorImages.size(); i++) {
-        colorImageViews[i] = createImageView(device, colorImages[i], colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
-    }
+    createAttachmentImage(device.msaaSamples(), colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                          colorImage, colorImageMemory);
+    colorImageView = createImageView(device, colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
 void SwapChain::createDepthResources(bool useMSAA) {
     VkFormat depthFormat = findDepthFormat();
     swapChainDepthFormat = depthFormat;
 
-    VkExtent2D swapChainExtent = getSwapChainExtent();
+    createAttachmentImage(useMSAA ? device.msaaSamples() : VK_SAMPLE_COUNT_1_BIT, depthFormat,
+                          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthImage, depthImageMemory);
+    depthImageView = createImageView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
 
-    createImages(swapChainExtent.width, swapChainExtent.height, 1, useMSAA ? device.msaaSamples() : VK_SAMPLE_COUNT_1_BIT,
-                 depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImages, depthImageMemories, depthImageViews);
+void SwapChain::createTransparencyResources() {
+    VkSampleCountFlagBits samples = useMSAA ? device.msaaSamples() : VK_SAMPLE_COUNT_1_BIT;
 
-    for (int i = 0; i < depthImages.size(); i++) {
-        depthImageViews[i] = createImageView(device, depthImages[i], depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-    }
+    createAttachmentImage(samples, ACCUM_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+                          accumImage, accumImageMemory);
+    accumImageView = createImageView(device, accumImage, ACCUM_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    createAttachmentImage(samples, REVEALAGE_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+                          revealageImage, revealageImageMemory);
+    revealageImageView = createImageView(device, revealageImage, REVEALAGE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
 void SwapChain::createSyncObjects() {
@@ -408,35 +642,32 @@ void SwapChain::createSyncObjects() {
     }
 }
 
-void SwapChain::createImages(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
-                             VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-                             std::vector<VkImage> &images, std::vector<VkDeviceMemory> &imageMemories, std::vector<VkImageView> &imageViews) {
-    images.resize(imageCount());
-    imageMemories.resize(imageCount());
-    imageViews.resize(imageCount());
-
-    for (int i = 0; i < images.size(); i++) {
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = width;
-        imageInfo.extent.height = height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = mipLevels;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = format;
-        imageInfo.tiling = tiling;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = usage;
-        imageInfo.samples = numSamples;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        imageInfo.flags = 0;
-
-        device.createImageWithInfo(
-            imageInfo,
-            properties,
-            images[i],
-            imageMemories[i]);
+void SwapChain::createAttachmentImage(VkSampleCountFlagBits numSamples, VkFormat format, VkImageUsageFlags usage,
+                                      VkImage &image, VkDeviceMemory &imageMemory) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = swapChainExtent.width;
+    imageInfo.extent.height = swapChainExtent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.samples = numSamples;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+
+    // Tilers keep transient attachments on chip and only back what spills out of it. Desktop GPUs
+    // have no lazily allocated memory, they get plain device local memory.
+    VkMemoryPropertyFlags properties = device.createImageWithInfo(
+        imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+    attachmentMemories.push_back(imageMemory);
+    if (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+        lazyAttachmentMemories.push_back(imageMemory);
     }
 }
 
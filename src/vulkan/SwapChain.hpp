@@ -18,13 +18,30 @@
 
 namespace vkr {
 
+// How hair is blended. Unless it is opaque, the render pass draws the transparent hair in a subpass
+// of its own, composited over the scene by the next one.
+enum class TransparencyMode { Opaque, WeightedBlended, LinkedList };
+
 class SwapChain {
    public:
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-    SwapChain(Device &deviceRef, VkExtent2D windowExtent, bool useMSAA = true);
+    // Subpasses in order: the scene, the transparent hair and its composite when there is
+    // transparency, then the UI, single sampled, straight on the presented image
+    static constexpr uint32_t TRANSPARENT_SUBPASS = 1;
+    static constexpr uint32_t COMPOSITE_SUBPASS = 2;
+
+    // Memory of the multisampled color, depth and transparency attachments
+    struct AttachmentMemory {
+        VkDeviceSize allocated;  // bytes bound to the attachments
+        VkDeviceSize committed;  // bytes backed so far, below allocated with lazily allocated memory
+        VkDeviceSize unshared;   // bytes a fully backed copy per swap chain image would take
+    };
+
+    SwapChain(Device &deviceRef, VkExtent2D windowExtent, bool useMSAA = true, bool uiSubpass = false,
+              TransparencyMode transparencyMode = TransparencyMode::Opaque);
     SwapChain(
-        Device &deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous, bool useMSAA = true);
+        Device &deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous, bool useMSAA = true,
+        bool uiSubpass = false, TransparencyMode transparencyMode = TransparencyMode::Opaque);
 
     ~SwapChain();
 
@@ -33,7 +50,18 @@ class SwapChain {
 
     VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
     VkRenderPass getRenderPass() { return renderPass; }
+    bool hasUISubpass() const { return uiSubpass; }
+    uint32_t getUISubpass() const { return hasTransparency() ? COMPOSITE_SUBPASS + 1 : 1; }
+    bool usesMSAA() const { return useMSAA; }
+    TransparencyMode getTransparencyMode() const { return transparencyMode; }
+    bool hasTransparency() const { return transparencyMode != TransparencyMode::Opaque; }
+    // Weighted blended transparency targets, input attachments of the composite subpass
+    VkImageView getAccumImageView() { return accumImageView; }
+    VkImageView getRevealageImageView() { return revealageImageView; }
+    // One per attachment of the render pass
+    const std::vector<VkClearValue> &getClearValues() const { return clearValues; }
     VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+    VkImage getImage(int index) { return swapChainImages[index]; }
     std::vector<VkImageView> getImageViews() { return swapChainImageViews; }
     size_t imageCount() { return swapChainImages.size(); }
     VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
@@ -45,10 +73,14 @@ class SwapChain {
         return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
     }
     VkFormat findDepthFormat();
+    AttachmentMemory getAttachmentMemory();
+    // Bytes of the weighted blended transparency targets
+    VkDeviceSize getTransparencyMemory();
 
     VkResult acquireNextImage(uint32_t *imageIndex);
     VkResult submitCommandBuffers(const std::vector<VkCommandBuffer> &buffers, uint32_t *imageIndex);
-    static VkImageView createImageView(Device &device, VkImage image, VkFormat format, VkImageAspectFlagBits aspectMask, bool isCubemap = false);
+    static VkImageView createImageView(Device &device, VkImage image, VkFormat format, VkImageAspectFlagBits aspectMask, bool isCubemap = false,
+                                       uint32_t mipLevels = 1);
 
     bool compareSwapFormats(const SwapChain &swapChain) const {
         return swapChain.swapChainDepthFormat == swapChainDepthFormat &&
@@ -58,17 +90,22 @@ class SwapChain {
     void createFramebuffers(const std::vector<std::vector<VkImageView>> &attachments, std::vector<VkFramebuffer> &framebuffers, VkRenderPass renderPass);
 
    private:
+    static constexpr VkFormat ACCUM_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+    static constexpr VkFormat REVEALAGE_FORMAT = VK_FORMAT_R16_SFLOAT;
+
     void init(bool useMSAA = true);
     void createSwapChain();
+    void createOffscreenImages();
     void createImageViews();
     void createColorResources();
     void createDepthResources(bool useMSAA = true);
+    void createTransparencyResources();
     void createRenderPass(bool useMSAA = true);
     void createFramebuffers();
     void createSyncObjects();
-    void createImages(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
-                     VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-                     std::vector<VkImage> &images, std::vector<VkDeviceMemory> &imageMemories, std::vector<VkImageView> &imageViews);
+    // Transient attachment image, only ever accessed within the render pass
+    void createAttachmentImage(VkSampleCountFlagBits numSamples, VkFormat format, VkImageUsageFlags usage,
+                               VkImage &image, VkDeviceMemory &imageMemory);
 
     // Helper functions
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -84,22 +121,40 @@ class SwapChain {
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkRenderPass renderPass;
 
-    std::vector<VkImage> colorImages;
-    std::vector<VkDeviceMemory> colorImageMemories;
-    std::vector<VkImageView> colorImageViews;
+    // The render pass clears these and never stores them, so a single copy is shared by every
+    // framebuffer, and the frames in flight are ordered by the render pass external dependency
+    VkImage colorImage = VK_NULL_HANDLE;
+    VkDeviceMemory colorImageMemory = VK_NULL_HANDLE;
+    VkImageView colorImageView = VK_NULL_HANDLE;
+
+    VkImage depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory depthImageMemory = VK_NULL_HANDLE;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+
+    VkImage accumImage = VK_NULL_HANDLE;
+    VkDeviceMemory accumImageMemory = VK_NULL_HANDLE;
+    VkImageView accumImageView = VK_NULL_HANDLE;
+
+    VkImage revealageImage = VK_NULL_HANDLE;
+    VkDeviceMemory revealageImageMemory = VK_NULL_HANDLE;
+    VkImageView revealageImageView = VK_NULL_HANDLE;
 
-    std::vector<VkImage> depthImages;
-    std::vector<VkDeviceMemory> depthImageMemories;
-    std::vector<VkImageView> depthImageViews;
+    std::vector<VkDeviceMemory> attachmentMemories;
+    std::vector<VkDeviceMemory> lazyAttachmentMemories;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
+    std::vector<VkDeviceMemory> offscreenImageMemories;  // headless only, presentable images are owned by the swap chain
 
     std::vector<std::vector<VkImageView>> swapChainAttachments;
+    std::vector<VkClearValue> clearValues;
 
     Device &device;
     VkExtent2D windowExtent;
+    bool uiSubpass;
+    TransparencyMode transparencyMode;
+    bool useMSAA = true;
 
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::shared_ptr<SwapChain> oldSwapChain;
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
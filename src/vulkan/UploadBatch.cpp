@@ -0,0 +1,175 @@
+#include <UploadBatch.hpp>
+
+namespace vkr {
+
+UploadBatch::UploadBatch(Device &device) : device{device} {}
+
+void UploadBatch::copyToBuffer(const void *data, VkDeviceSize size, VkBuffer dst) {
+    auto stagingBuffer = std::make_unique<Buffer>(device, size, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    stagingBuffer->map();
+    stagingBuffer->writeToBuffer(const_cast<void *>(data), size);
+    copies.push_back({std::move(stagingBuffer), dst, size});
+}
+
+void UploadBatch::copyToImage(const void *data, VkDeviceSize size, VkImage dst, std::vector<VkBufferImageCopy> regions,
+                              VkExtent2D extent, uint32_t mipLevels, uint32_t layerCount, bool blitLevels) {
+    auto stagingBuffer = std::make_unique<Buffer>(device, size, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    stagingBuffer->map();
+    stagingBuffer->writeToBuffer(const_cast<void *>(data), size);
+    imageCopies.push_back({std::move(stagingBuffer), dst, std::move(regions), extent, mipLevels, layerCount, blitLevels});
+}
+
+bool UploadBatch::transfersOwnership() const {
+    QueueFamilyIndices indices = device.queueFamilyIndices();
+    return indices.transferFamily != indices.graphicsFamily;
+}
+
+VkBufferMemoryBarrier UploadBatch::ownershipBarrier(const Copy &copy) const {
+    QueueFamilyIndices indices = device.queueFamilyIndices();
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = indices.transferFamily;
+    barrier.dstQueueFamilyIndex = indices.graphicsFamily;
+    barrier.buffer = copy.dst;
+    barrier.offset = 0;
+    barrier.size = copy.size;
+    return barrier;
+}
+
+VkImageMemoryBarrier UploadBatch::imageBarrier(const ImageCopy &copy, VkImageLayout oldLayout, VkImageLayout newLayout) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = copy.dst;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, copy.mipLevels, 0, copy.layerCount};
+    return barrier;
+}
+
+void UploadBatch::recordCopies(VkCommandBuffer commandBuffer) {
+    std::vector<VkBufferMemoryBarrier> releases;
+    for (const Copy &copy : copies) {
+        VkBufferCopy copyRegion{};
+        copyRegion.size = copy.size;
+        vkCmdCopyBuffer(commandBuffer, copy.stagingBuffer->getBuffer(), copy.dst, 1, &copyRegion);
+
+        if (transfersOwnership()) {
+            VkBufferMemoryBarrier barrier = ownershipBarrier(copy);
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            releases.push_back(barrier);
+        }
+    }
+
+    // Every level is written by the copies or by the blits after the acquire
+    std::vector<VkImageMemoryBarrier> imageReleases;
+    if (!imageCopies.empty()) {
+        std::vector<VkImageMemoryBarrier> transitions;
+        for (const ImageCopy &copy : imageCopies) {
+            VkImageMemoryBarrier barrier =
+                imageBarrier(copy, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            transitions.push_back(barrier);
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                             0, nullptr, static_cast<uint32_t>(transitions.size()), transitions.data());
+    }
+    for (const ImageCopy &copy : imageCopies) {
+        vkCmdCopyBufferToImage(commandBuffer, copy.stagingBuffer->getBuffer(), copy.dst,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copy.regions.size()),
+                               copy.regions.data());
+
+        if (transfersOwnership()) {
+            // The layout is kept, it changes once the graphics queue owns the image
+            QueueFamilyIndices indices = device.queueFamilyIndices();
+            VkImageMemoryBarrier barrier =
+                imageBarrier(copy, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            barrier.srcQueueFamilyIndex = indices.transferFamily;
+            barrier.dstQueueFamilyIndex = indices.graphicsFamily;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            imageReleases.push_back(barrier);
+        }
+    }
+
+    if (!releases.empty() || !imageReleases.empty()) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, static_cast<uint32_t>(releases.size()), releases.data(),
+                             static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+    }
+}
+
+void UploadBatch::recordAcquire(VkCommandBuffer commandBuffer) {
+    if (!copies.empty()) recordBufferAcquire(commandBuffer);
+    if (!imageCopies.empty()) recordImageAcquire(commandBuffer);
+}
+
+void UploadBatch::recordBufferAcquire(VkCommandBuffer commandBuffer) {
+    // Hair vertices are also written by transfers every simulated frame
+    const VkAccessFlags dstAccess =
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    const VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    if (transfersOwnership()) {
+        std::vector<VkBufferMemoryBarrier> acquires;
+        for (const Copy &copy : copies) {
+            VkBufferMemoryBarrier barrier = ownershipBarrier(copy);
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = dstAccess;
+            acquires.push_back(barrier);
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0, 0, nullptr,
+                             static_cast<uint32_t>(acquires.size()), acquires.data(), 0, nullptr);
+        return;
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void UploadBatch::recordImageAcquire(VkCommandBuffer commandBuffer) {
+    // The copied levels become visible to the blits, still in TRANSFER_DST_OPTIMAL
+    QueueFamilyIndices indices = device.queueFamilyIndices();
+    std::vector<VkImageMemoryBarrier> acquires;
+    for (const ImageCopy &copy : imageCopies) {
+        VkImageMemoryBarrier barrier =
+            imageBarrier(copy, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        if (transfersOwnership()) {
+            barrier.srcQueueFamilyIndex = indices.transferFamily;
+            barrier.dstQueueFamilyIndex = indices.graphicsFamily;
+            barrier.srcAccessMask = 0;
+        } else {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        }
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        acquires.push_back(barrier);
+    }
+    const VkPipelineStageFlags srcStage =
+        transfersOwnership() ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(acquires.size()), acquires.data());
+
+    for (const ImageCopy &copy : imageCopies) {
+        if (copy.blitLevels && copy.mipLevels > 1) {
+            device.recordMipmaps(commandBuffer, copy.dst, copy.extent.width, copy.extent.height, copy.mipLevels,
+                                 copy.layerCount);
+            continue;
+        }
+        VkImageMemoryBarrier barrier =
+            imageBarrier(copy, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &barrier);
+    }
+}
+
+}  // namespace vkr
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Buffer.hpp>
+#include <Device.hpp>
+
+// std
+#include <memory>
+#include <vector>
+
+namespace vkr {
+
+// Buffer and image copies gathered to be recorded together, off the graphics queue when the device
+// has a transfer queue. The resources written are owned by the transfer family until recordAcquire
+// runs on a graphics command buffer, submitted after the copies have completed.
+class UploadBatch {
+   public:
+    UploadBatch(Device &device);
+
+    UploadBatch(const UploadBatch &) = delete;
+    UploadBatch &operator=(const UploadBatch &) = delete;
+
+    // Stages size bytes of data, copied to the start of dst by recordCopies
+    void copyToBuffer(const void *data, VkDeviceSize size, VkBuffer dst);
+    // Stages size bytes of data, copied to the regions of dst by recordCopies. recordAcquire blits
+    // the levels past the first when blitLevels is set, then leaves every level of dst in
+    // SHADER_READ_ONLY_OPTIMAL.
+    void copyToImage(const void *data, VkDeviceSize size, VkImage dst, std::vector<VkBufferImageCopy> regions,
+                     VkExtent2D extent, uint32_t mipLevels, uint32_t layerCount, bool blitLevels);
+
+    // On a command buffer of the transfer family, releases the resources when the families differ
+    void recordCopies(VkCommandBuffer commandBuffer);
+    // On a command buffer of the graphics family, makes the buffer copies visible to vertex input
+    // and the images to fragment shaders, blitting their mip chains
+    void recordAcquire(VkCommandBuffer commandBuffer);
+
+    bool empty() const { return copies.empty() && imageCopies.empty(); }
+
+   private:
+    struct Copy {
+        std::unique_ptr<Buffer> stagingBuffer;
+        VkBuffer dst;
+        VkDeviceSize size;
+    };
+
+    struct ImageCopy {
+        std::unique_ptr<Buffer> stagingBuffer;
+        VkImage dst;
+        std::vector<VkBufferImageCopy> regions;
+        VkExtent2D extent;
+        uint32_t mipLevels;
+        uint32_t layerCount;
+        bool blitLevels;
+    };
+
+    bool transfersOwnership() const;
+    VkBufferMemoryBarrier ownershipBarrier(const Copy &copy) const;
+    // Covers every level and layer, without changing the queue family
+    static VkImageMemoryBarrier imageBarrier(const ImageCopy &copy, VkImageLayout oldLayout, VkImageLayout newLayout);
+    void recordBufferAcquire(VkCommandBuffer commandBuffer);
+    void recordImageAcquire(VkCommandBuffer commandBuffer);
+
+    Device &device;
+    std::vector<Copy> copies;
+    std::vector<ImageCopy> imageCopies;
+};
+
+}  // namespace vkr
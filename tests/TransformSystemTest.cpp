@@ -0,0 +1,87 @@
+#include <Entity.hpp>
+#include <Utils.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace vkr;
+
+static int failures = 0;
+
+static float largestDifference(const glm::mat4 &a, const glm::mat4 &b) {
+    float difference = 0.f;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            difference = std::max(difference, std::abs(a[column][row] - b[column][row]));
+        }
+    }
+    return difference;
+}
+
+static float largestElement(const glm::mat4 &matrix) {
+    return largestDifference(matrix, glm::mat4{0.f});
+}
+
+static void check(bool condition, const char *message) {
+    if (!condition) {
+        printf("FAILED: %s\n", message);
+        failures++;
+    }
+}
+
+// The world transforms of child, model and normal matrix, must survive parenting it and updating
+static void checkParenting(const TransformComponent &parentTransform, const TransformComponent &childTransform,
+                           const char *name) {
+    Registry registry;
+    TransformSystem transformSystem;
+    Entity parent = registry.create();
+    Entity child = registry.create();
+    registry.emplace<TransformComponent>(parent, parentTransform);
+    registry.emplace<TransformComponent>(child, childTransform);
+    transformSystem.update(registry);
+    const WorldTransform before = registry.get<WorldTransform>(child);
+
+    transformSystem.setParent(registry, child, parent);
+    transformSystem.update(registry);
+    const WorldTransform &after = registry.get<WorldTransform>(child);
+
+    const float tolerance = 1e-4f;
+    if (largestDifference(after.model, before.model) > tolerance * largestElement(before.model)) {
+        printf("%s: model matrix changed by parenting\n", name);
+        check(false, "setParent keeps the world model matrix");
+    }
+    if (largestDifference(after.normalMatrix, before.normalMatrix) > tolerance * largestElement(before.normalMatrix)) {
+        printf("%s: normal matrix changed by parenting\n", name);
+        check(false, "setParent keeps the world normal matrix");
+    }
+}
+
+int main() {
+    // The groom and head of the scene, the groom starts exactly at the gimbal lock
+    checkParenting(TransformComponent{{0.f, 2.2f, 2.5f}, glm::vec3{3.1f}, {0.f, PI, 0.f}},
+                   TransformComponent{{0.f, 2.f, 2.5f}, glm::vec3{0.03f}, {PI_2, PI_2, 0.f}}, "scene groom");
+
+    // Under an identity parent, the local transform is the decomposition of the world one. Near
+    // +-90 degrees around X the rotation must still be rebuilt, not only exactly at the lock.
+    const float offsets[] = {0.f, 1e-7f, 1e-5f, 1e-4f, 1e-3f, 1e-2f};
+    for (float sign : {1.f, -1.f}) {
+        for (float offset : offsets) {
+            const float pitch = sign * (static_cast<float>(PI_2) - offset);
+            checkParenting(TransformComponent{}, TransformComponent{{1.f, -2.f, 3.f}, {0.5f, 2.f, 1.5f}, {pitch, 0.7f, -1.2f}},
+                           "near gimbal lock");
+        }
+    }
+
+    // Away from the lock, under a rotated parent. Its scale is uniform, shears are not representable.
+    checkParenting(TransformComponent{{-1.f, 0.5f, 4.f}, glm::vec3{1.7f}, {0.3f, -2.f, 0.9f}},
+                   TransformComponent{{0.2f, 1.f, -0.5f}, glm::vec3{0.8f}, {-0.4f, 1.1f, 2.5f}}, "general");
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All transform checks passed\n");
+    return 0;
+}